@@ -0,0 +1,68 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+// video, input and timing for the emulator core. the core only talks to the
+// host through the backend of each machine so it can run with or without SDL
+struct backend
+{
+    // returns false if the backend could not be started
+    bool (*init)(struct chip8 *c8);
+    void (*cleanup)(struct chip8 *c8);
+
+    // shows the display, called at most once per frame and only when the
+    // display has changed
+    void (*draw_display)(struct chip8 *c8);
+
+    // drains pending input into c8->keys, called before every batch. if the
+    // machine is waiting for a key and none will ever arrive the backend
+    // halts it
+    void (*poll_input)(struct chip8 *c8);
+
+    // called between unpaced batches while the machine waits for a key,
+    // blocks until there may be new input
+    void (*wait_input)(struct chip8 *c8);
+
+    // polled between batches of frames, true when emulation should stop
+    bool (*quit_requested)(struct chip8 *c8);
+
+    // number of frames to run between polls
+    uint32_t frames_per_poll;
+};
+
+#ifndef CHIP8_NO_SDL
+extern struct backend sdl_backend;
+
+// size of the SDL window and whether presents wait for vertical sync, set
+// before init
+extern int sdl_window_width;
+extern int sdl_window_height;
+extern bool sdl_vsync;
+
+// map chip8 keys to keyboard keys, either a named layout ("hex" for keys 0-F,
+// the default, or "cosmac" for the 1234/QWER/ASDF/ZXCV block) or a file of
+// "<key 0-F> <SDL key name>" lines. false if the map could not be read
+bool sdl_load_keymap(const char *spec);
+#endif
+extern struct backend headless_backend;
+
+// draws to the terminal on stdout and reads keys from stdin, which both
+// have to be terminals. with terminal_braille set before init the display
+// is drawn in braille at 32x8 characters instead of half blocks at 64x16
+extern struct backend terminal_backend;
+extern bool terminal_braille;
+
+// lay the terminal's keys out as "hex" (keys 0-9 and a-f, the default) or
+// "cosmac" (the 1234/qwer/asdf/zxcv block). false for any other layout
+bool terminal_load_keymap(const char *spec);
+
+// replay key presses from a script on a machine using the headless backend
+bool headless_load_input(struct chip8 *c8, const char *path);
+
+// queue one key change for the given instruction count, events have to be
+// queued in order. false if it is out of order or out of memory
+bool headless_add_event(struct chip8 *c8, uint64_t cycle, uint8_t key, bool down);
+
+// write the display of a machine as a pbm image
+void dump_display(struct chip8 *c8, const char *path);
+
+#endif
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "chip8.h"
+#include "backend.h"
+
+// backend with no window: the display stays in memory, input is replayed
+// from a script and the emulator runs as fast as it can
+
+// a key change from the input script, applied once the emulator has
+// executed the given number of instructions
+struct input_event
+{
+    uint64_t cycle;
+    uint8_t key;
+    bool down;
+};
+
+// per machine input state
+struct headless_state
+{
+    struct input_event *events;
+    size_t event_count;
+    size_t event_capacity;
+    size_t next_event;
+};
+
+// queue a key change, false if it comes before the last one queued or
+// there is no memory for it
+bool headless_add_event(struct chip8 *c8, uint64_t cycle, uint8_t key, bool down)
+{
+    struct headless_state *state = c8->backend_data;
+    if (state->event_count > 0 && cycle < state->events[state->event_count - 1].cycle)
+    {
+        return false;
+    }
+    if (state->event_count == state->event_capacity)
+    {
+        size_t capacity = state->event_capacity == 0 ? 64 : state->event_capacity * 2;
+        struct input_event *events = realloc(state->events, capacity * sizeof(struct input_event));
+        if (events == NULL)
+        {
+            return false;
+        }
+        state->events = events;
+        state->event_capacity = capacity;
+    }
+    struct input_event *event = &state->events[state->event_count++];
+    event->cycle = cycle;
+    event->key = key;
+    event->down = down;
+    return true;
+}
+
+// reads lines of the form "<cycle> <key 0-F> <down|up>", blank lines and
+// lines starting with # are ignored
+bool headless_load_input(struct chip8 *c8, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror("unable to open input script");
+        return false;
+    }
+
+    char line[128];
+    int line_number = 0;
+    uint64_t last_cycle = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        unsigned long long cycle;
+        unsigned int key;
+        char direction[8];
+        if (sscanf(line, "%llu %x %7s", &cycle, &key, direction) != 3 || key > 0xf ||
+            (strcmp(direction, "down") != 0 && strcmp(direction, "up") != 0))
+        {
+            printf("bad input script line %d: %s", line_number, line);
+            fclose(f);
+            return false;
+        }
+        if (cycle < last_cycle)
+        {
+            printf("input script line %d is out of order\n", line_number);
+            fclose(f);
+            return false;
+        }
+        if (!headless_add_event(c8, cycle, key, strcmp(direction, "down") == 0))
+        {
+            printf("out of memory reading input script line %d\n", line_number);
+            fclose(f);
+            return false;
+        }
+        last_cycle = cycle;
+    }
+    fclose(f);
+    return true;
+}
+
+static void apply_event(struct chip8 *c8, const struct input_event *event)
+{
+    if (event->down)
+    {
+        c8->keys |= 1 << event->key;
+    }
+    else
+    {
+        c8->keys &= ~(1 << event->key);
+    }
+}
+
+// write the display as a plain pbm image, 1 is a lit pixel
+void dump_display(struct chip8 *c8, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        perror("unable to open display dump");
+        return;
+    }
+    fprintf(f, "P1\n64 32\n");
+    for (int y = 0; y < 32; y++)
+    {
+        for (int x = 0; x < 64; x++)
+        {
+            fprintf(f, "%d ", display_pixel(c8, x, y));
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+}
+
+static bool headless_init(struct chip8 *c8)
+{
+    c8->backend_data = calloc(1, sizeof(struct headless_state));
+    return c8->backend_data != NULL;
+}
+
+static void headless_cleanup(struct chip8 *c8)
+{
+    struct headless_state *state = c8->backend_data;
+    if (state != NULL)
+    {
+        free(state->events);
+        free(state);
+        c8->backend_data = NULL;
+    }
+}
+
+static void headless_draw_display(struct chip8 *c8)
+{
+}
+
+// apply every event that is due at the current instruction count, and end
+// the next batch where the following one is due
+static void headless_poll_input(struct chip8 *c8)
+{
+    struct headless_state *state = c8->backend_data;
+    while (state->next_event < state->event_count &&
+           state->events[state->next_event].cycle <= c8->instruction_count)
+    {
+        apply_event(c8, &state->events[state->next_event]);
+        state->next_event++;
+    }
+    if (state->next_event < state->event_count)
+    {
+        c8->input_deadline = state->events[state->next_event].cycle;
+    }
+    else
+    {
+        c8->input_deadline = UINT64_MAX;
+
+        // the script has run out, a machine waiting for a key would wait
+        // forever
+        if (c8->waiting_key && c8->keys == 0)
+        {
+            c8->halted = true;
+        }
+    }
+}
+
+static void headless_wait_input(struct chip8 *c8)
+{
+    // the script is keyed to instructions, the waiting machine gets to the
+    // next event by idling through batches
+}
+
+static bool headless_quit_requested(struct chip8 *c8)
+{
+    return false;
+}
+
+struct backend headless_backend =
+{
+    headless_init,
+    headless_cleanup,
+    headless_draw_display,
+    headless_poll_input,
+    headless_wait_input,
+    headless_quit_requested,
+    400
+};
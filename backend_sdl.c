@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "chip8.h"
+#include "backend.h"
+#include "snapshot.h"
+
+// chip8 keys 0-F on keyboard keys 0-F
+static const SDL_Scancode hex_keymap[16] =
+{
+    SDL_SCANCODE_0, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+    SDL_SCANCODE_4, SDL_SCANCODE_5, SDL_SCANCODE_6, SDL_SCANCODE_7,
+    SDL_SCANCODE_8, SDL_SCANCODE_9, SDL_SCANCODE_A, SDL_SCANCODE_B,
+    SDL_SCANCODE_C, SDL_SCANCODE_D, SDL_SCANCODE_E, SDL_SCANCODE_F
+};
+
+// the cosmac vip keypad laid over the left hand side of a qwerty keyboard
+//   1 2 3 C      1 2 3 4
+//   4 5 6 D  ->  Q W E R
+//   7 8 9 E      A S D F
+//   A 0 B F      Z X C V
+static const SDL_Scancode cosmac_keymap[16] =
+{
+    SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+    SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+    SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
+};
+
+// keyboard key for each chip8 key, the hex layout unless a map was loaded
+// before init
+static SDL_Scancode keymap[16];
+static bool keymap_loaded;
+
+bool sdl_load_keymap(const char *spec)
+{
+    keymap_loaded = true;
+    memcpy(keymap, strcmp(spec, "cosmac") == 0 ? cosmac_keymap : hex_keymap, sizeof(keymap));
+    if (strcmp(spec, "hex") == 0 || strcmp(spec, "cosmac") == 0)
+    {
+        return true;
+    }
+
+    // lines of "<key 0-F> <SDL key name>", keys not listed keep the hex
+    // layout. key names are as SDL_GetScancodeName gives them, e.g.
+    // "Keypad 7" or "Left Shift"
+    FILE *f = fopen(spec, "r");
+    if (f == NULL)
+    {
+        perror("unable to open keymap");
+        return false;
+    }
+    char line[128];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        unsigned int key;
+        char name[64];
+        SDL_Scancode scancode = SDL_SCANCODE_UNKNOWN;
+        if (sscanf(line, "%x %63[^\r\n]", &key, name) == 2 && key <= 0xf)
+        {
+            scancode = SDL_GetScancodeFromName(name);
+        }
+        if (scancode == SDL_SCANCODE_UNKNOWN)
+        {
+            printf("bad keymap line %d: %s", line_number, line);
+            fclose(f);
+            return false;
+        }
+        keymap[key] = scancode;
+    }
+    fclose(f);
+    return true;
+}
+
+// window size, set before init. the display is scaled to fit the window
+int sdl_window_width = 640;
+int sdl_window_height = 320;
+bool sdl_vsync = false;
+
+static SDL_Window *window;
+static SDL_Renderer *renderer;
+
+// the 64x32 display lives in a streaming texture, the renderer scales it up
+static SDL_Texture *texture;
+
+static bool sdl_init(struct chip8 *c8)
+{
+    if (!keymap_loaded)
+    {
+        memcpy(keymap, hex_keymap, sizeof(keymap));
+    }
+
+    // set up SDL for display output
+    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+    {
+        perror(SDL_GetError());
+        return false;
+    }
+
+    window = SDL_CreateWindow("chip8", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                              sdl_window_width, sdl_window_height, SDL_WINDOW_RESIZABLE);
+    if (window == NULL)
+    {
+        perror(SDL_GetError());
+        return false;
+    }
+    uint32_t flags = SDL_RENDERER_ACCELERATED;
+    if (sdl_vsync)
+    {
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+    }
+    renderer = SDL_CreateRenderer(window, -1, flags);
+    if (renderer == NULL)
+    {
+        perror(SDL_GetError());
+        return false;
+    }
+
+    // keep the pixels square and sharp however the window is sized
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    SDL_RenderSetLogicalSize(renderer, 64, 32);
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                SDL_TEXTUREACCESS_STREAMING, 64, 32);
+    if (texture == NULL)
+    {
+        perror(SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+static void sdl_cleanup(struct chip8 *c8)
+{
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+static void sdl_draw_display(struct chip8 *c8)
+{
+    // upload the whole display in one lock, each row word expands to 64
+    // pixels of white or black
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0)
+    {
+        return;
+    }
+    for (int y = 0; y < 32; y++)
+    {
+        uint32_t *line = (uint32_t *)((uint8_t *)pixels + y * pitch);
+        uint64_t row = c8->display[y];
+        for (int x = 0; x < 64; x++)
+        {
+            line[x] = (row >> (63 - x)) & 0x1 ? 0xffffffff : 0xff000000;
+        }
+    }
+    SDL_UnlockTexture(texture);
+
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+// chip8 keys held down as of the last event, and set by the key events
+// since the last poll. a key tapped between two polls still counts as held
+// for one batch
+static uint16_t held_keys;
+static uint16_t tapped_keys;
+
+static bool quit_pressed;
+
+static void key_event(struct chip8 *c8, const SDL_KeyboardEvent *key)
+{
+    bool down = key->type == SDL_KEYDOWN;
+    for (int i = 0; i < 16; i++)
+    {
+        if (keymap[i] == key->keysym.scancode)
+        {
+            if (down)
+            {
+                held_keys |= 1 << i;
+                tapped_keys |= 1 << i;
+            }
+            else
+            {
+                held_keys &= ~(1 << i);
+            }
+        }
+    }
+
+    // holding backspace runs the game backwards when rewind is enabled
+    if (key->keysym.scancode == SDL_SCANCODE_BACKSPACE)
+    {
+        c8->rewinding = down;
+    }
+    if (!down || key->repeat)
+    {
+        return;
+    }
+
+    // F5 saves the machine to the snapshot file, F9 loads it back
+    switch (key->keysym.scancode)
+    {
+        case SDL_SCANCODE_F5:
+            printf(snapshot_write(c8, snapshot_path) ? "saved %s\n" : "unable to save %s\n", snapshot_path);
+            break;
+        case SDL_SCANCODE_F9:
+            printf(snapshot_read(c8, snapshot_path) ? "loaded %s\n" : "unable to load %s\n", snapshot_path);
+            break;
+        case SDL_SCANCODE_ESCAPE:
+            // If the escape key is pressed stop the emulation loop
+            quit_pressed = true;
+            break;
+        default:
+            break;
+    }
+}
+
+static void sdl_poll_input(struct chip8 *c8)
+{
+    tapped_keys = 0;
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+        {
+            key_event(c8, &event.key);
+        }
+        else if (event.type == SDL_QUIT)
+        {
+            quit_pressed = true;
+        }
+    }
+    c8->keys = held_keys | tapped_keys;
+}
+
+static void sdl_wait_input(struct chip8 *c8)
+{
+    // sleep until something happens, the event stays queued for the next
+    // poll
+    SDL_WaitEvent(NULL);
+}
+
+static bool sdl_quit_requested(struct chip8 *c8)
+{
+    return quit_pressed;
+}
+
+struct backend sdl_backend =
+{
+    sdl_init,
+    sdl_cleanup,
+    sdl_draw_display,
+    sdl_poll_input,
+    sdl_wait_input,
+    sdl_quit_requested,
+    1
+};
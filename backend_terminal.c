@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include "chip8.h"
+#include "backend.h"
+
+// backend for a terminal, e.g. over ssh to a machine with no display. the
+// display is drawn with unicode half blocks, two pixels to a character
+// cell, or braille, eight to a cell. only the cells that changed since the
+// last frame are sent, all in one write. keys are read from the terminal in
+// raw mode, which only says when a key was typed and not when it is let
+// go, so a key counts as held for a few frames after each time it arrives
+// and the terminal's key repeat keeps it held
+
+bool terminal_braille = false;
+
+// polls, one a frame, a key stays held after it was last typed. longer
+// than the gap between repeats of a held key once they start
+#define TERMINAL_HOLD_POLLS 10
+
+// unchanged cells between two changed ones on a row that are written out
+// rather than moving the cursor past them, a move being 6 to 8 bytes
+#define TERMINAL_GAP_CELLS 2
+
+// 64x16 cells of half blocks or 32x8 of braille
+#define TERMINAL_MAX_CELLS (64 * 16)
+
+// every cell redrawn: a cursor move and a 3 byte character each, at most,
+// and the cursor moved out of the way
+static char output[TERMINAL_MAX_CELLS * (10 + 3) + 16];
+
+// hex layout keys 0-9 and a-f, or the cosmac vip keypad laid over
+// 1234/qwer/asdf/zxcv
+static const char hex_keys[] = "0123456789abcdef";
+static const char cosmac_keys[] = "x123qweasdzc4rfv";
+static const char *keymap = hex_keys;
+
+bool terminal_load_keymap(const char *spec)
+{
+    if (strcmp(spec, "hex") == 0 || strcmp(spec, "cosmac") == 0)
+    {
+        keymap = strcmp(spec, "hex") == 0 ? hex_keys : cosmac_keys;
+        return true;
+    }
+    return false;
+}
+
+static struct termios saved_termios;
+static bool raw_mode;
+
+// what each cell shows, blank on the screen cleared at init
+static uint16_t cells[TERMINAL_MAX_CELLS];
+
+// poll each key was last typed in, and backspace for rewinding. polls are
+// counted rather than frames as rewinding takes the frame count back
+static uint64_t polls;
+static uint64_t typed_poll[17];
+static bool typed[17];
+static bool quit_pressed;
+
+static uint64_t frames_drawn;
+static uint64_t bytes_written;
+
+static void write_all(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if (written <= 0)
+        {
+            return;
+        }
+        data += written;
+        size -= written;
+        bytes_written += written;
+    }
+}
+
+static void restore_terminal()
+{
+    if (raw_mode)
+    {
+        raw_mode = false;
+
+        // show the cursor again, under the last frame drawn
+        write_all("\x1b[?25h", 6);
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_termios);
+    }
+}
+
+static bool terminal_init(struct chip8 *c8)
+{
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO))
+    {
+        printf("the terminal backend needs a terminal on stdin and stdout\n");
+        return false;
+    }
+    if (tcgetattr(STDIN_FILENO, &saved_termios) != 0)
+    {
+        perror("unable to read the terminal settings");
+        return false;
+    }
+
+    // no line buffering, echo or signals, reads return at once with
+    // whatever has been typed. ctrl-c arrives as a byte and quits
+    struct termios raw = saved_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cflag |= CS8;
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0)
+    {
+        perror("unable to put the terminal in raw mode");
+        return false;
+    }
+    raw_mode = true;
+
+    // an exit() elsewhere, e.g. on a jit verify mismatch, leaves the terminal usable
+    static bool handler_installed = false;
+    if (!handler_installed)
+    {
+        handler_installed = true;
+        atexit(restore_terminal);
+    }
+
+    // a cleared screen with the cursor hidden
+    write_all("\x1b[2J\x1b[?25l", 10);
+    memset(cells, 0, sizeof(cells));
+    memset(typed, 0, sizeof(typed));
+    quit_pressed = false;
+    frames_drawn = 0;
+    bytes_written = 0;
+    return true;
+}
+
+static void terminal_cleanup(struct chip8 *c8)
+{
+    restore_terminal();
+    if (frames_drawn > 0)
+    {
+        printf("terminal: %llu frames drawn in %llu bytes, %.0f bytes per frame\n",
+               (unsigned long long)frames_drawn, (unsigned long long)bytes_written,
+               (double)bytes_written / frames_drawn);
+    }
+}
+
+// the pixels of the cell at column x, row y as a glyph: 2 bits top and
+// bottom for half blocks, the 8 dots of a braille pattern otherwise
+static uint16_t cell_at(const struct chip8 *c8, int x, int y)
+{
+    if (!terminal_braille)
+    {
+        return display_pixel(c8, x, 2 * y) | display_pixel(c8, x, 2 * y + 1) << 1;
+    }
+
+    // braille numbers the dots down the left column, then the right, with
+    // the bottom row last
+    static const uint8_t dots[4][2] = { { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 } };
+    uint16_t pattern = 0;
+    for (int row = 0; row < 4; row++)
+    {
+        for (int column = 0; column < 2; column++)
+        {
+            if (display_pixel(c8, 2 * x + column, 4 * y + row))
+            {
+                pattern |= dots[row][column];
+            }
+        }
+    }
+    return pattern;
+}
+
+static char *put_glyph(char *p, uint16_t glyph)
+{
+    if (!terminal_braille)
+    {
+        // space, upper half, lower half, full block
+        static const char *blocks[4] = { " ", "\xe2\x96\x80", "\xe2\x96\x84", "\xe2\x96\x88" };
+        size_t length = glyph == 0 ? 1 : 3;
+        memcpy(p, blocks[glyph], length);
+        return p + length;
+    }
+    uint32_t code = 0x2800 + glyph;
+    p[0] = 0xe0 | (code >> 12);
+    p[1] = 0x80 | ((code >> 6) & 0x3f);
+    p[2] = 0x80 | (code & 0x3f);
+    return p + 3;
+}
+
+static void terminal_draw_display(struct chip8 *c8)
+{
+    int width = terminal_braille ? 32 : 64;
+    int height = terminal_braille ? 8 : 16;
+    char *p = output;
+
+    // the cursor moves along as cells are written, so a run of changed
+    // cells on a row only needs the one move to its start, and runs a few
+    // cells apart are joined
+    int cursor_x = -1;
+    int cursor_y = -1;
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint16_t glyph = cell_at(c8, x, y);
+            uint16_t *cell = &cells[y * width + x];
+            if (*cell == glyph)
+            {
+                continue;
+            }
+            *cell = glyph;
+            if (y == cursor_y && x > cursor_x && x - cursor_x <= TERMINAL_GAP_CELLS)
+            {
+                // writing the cells in between over again is shorter
+                for (int i = cursor_x; i < x; i++)
+                {
+                    p = put_glyph(p, cells[y * width + i]);
+                }
+            }
+            else if (x != cursor_x || y != cursor_y)
+            {
+                p += sprintf(p, "\x1b[%d;%dH", y + 1, x + 1);
+            }
+            p = put_glyph(p, glyph);
+            cursor_x = x + 1;
+            cursor_y = y;
+        }
+    }
+    if (p != output)
+    {
+        // park the cursor under the display, where anything else printed
+        // while running and the report at exit go
+        p += sprintf(p, "\x1b[%d;1H", height + 1);
+        write_all(output, p - output);
+    }
+    frames_drawn++;
+}
+
+static void type_key(int key)
+{
+    typed[key] = true;
+    typed_poll[key] = polls;
+}
+
+static bool held(int key)
+{
+    return typed[key] && polls - typed_poll[key] < TERMINAL_HOLD_POLLS;
+}
+
+static void terminal_poll_input(struct chip8 *c8)
+{
+    polls++;
+    char input[256];
+    ssize_t count;
+    while ((count = read(STDIN_FILENO, input, sizeof(input))) > 0)
+    {
+        for (ssize_t i = 0; i < count; i++)
+        {
+            char ch = input[i];
+            if (ch == 0x03 || (ch == 0x1b && i + 1 == count))
+            {
+                // ctrl-c, or escape on its own rather than starting a
+                // sequence
+                quit_pressed = true;
+            }
+            else if (ch == 0x1b)
+            {
+                // skip the sequences of arrow and function keys, escape [
+                // or O then up to a final byte from @ to ~
+                i++;
+                if (input[i] == '[' || input[i] == 'O')
+                {
+                    while (i + 1 < count && !(input[i + 1] >= 0x40 && input[i + 1] <= 0x7e))
+                    {
+                        i++;
+                    }
+                    i++;
+                }
+            }
+            else if (ch == 0x7f || ch == 0x08)
+            {
+                type_key(16);
+            }
+            else
+            {
+                // capitals work with caps lock on, only letters are folded so
+                // control bytes do not land on the digits
+                char lower = ch >= 'A' && ch <= 'Z' ? ch | 0x20 : ch;
+                const char *key = ch != '\0' ? strchr(keymap, lower) : NULL;
+                if (key != NULL)
+                {
+                    type_key(key - keymap);
+                }
+            }
+        }
+    }
+
+    // a key typed since the last poll counts for at least one batch
+    uint16_t keys = 0;
+    for (int key = 0; key < 16; key++)
+    {
+        if (held(key))
+        {
+            keys |= 1 << key;
+        }
+    }
+    c8->keys = keys;
+
+    // holding backspace runs the game backwards when rewind is enabled
+    c8->rewinding = held(16);
+}
+
+static void terminal_wait_input(struct chip8 *c8)
+{
+    // sleep until something is typed, it stays unread for the next poll
+    struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+    poll(&fd, 1, -1);
+}
+
+static bool terminal_quit_requested(struct chip8 *c8)
+{
+    return quit_pressed;
+}
+
+struct backend terminal_backend =
+{
+    terminal_init,
+    terminal_cleanup,
+    terminal_draw_display,
+    terminal_poll_input,
+    terminal_wait_input,
+    terminal_quit_requested,
+    1
+};
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "chip8.h"
+#include "jit.h"
+#include "backend.h"
+#include "snapshot.h"
+#include "replay.h"
+
+// batch runner: runs every job of a job file headless, spread over a pool of
+// worker threads. each worker owns a queue of jobs and takes work from the
+// back of it; a worker whose queue is empty steals from the front of the
+// others, so a few long runs do not leave the rest of the pool idle.
+
+// a rom loaded once and shared by every job that runs it
+struct rom_image
+{
+    char *path;
+    uint8_t *data;
+    size_t size;
+};
+
+struct job
+{
+    size_t rom;
+    uint64_t cycles;
+    char *input_path;
+    bool recording;
+    bool seeded;
+    uint64_t seed;
+
+    // results. a job that halted on an unknown opcode is not ok, pc is
+    // left on it
+    bool ok;
+    bool faulted;
+    uint16_t fault_opcode;
+    uint64_t instructions;
+    uint16_t pc;
+    uint64_t display_hash;
+    uint64_t state_hash;
+    double seconds;
+};
+
+struct work_queue
+{
+    pthread_mutex_t lock;
+    size_t *jobs;
+    size_t head;
+    size_t tail;
+};
+
+struct worker
+{
+    pthread_t thread;
+    int index;
+};
+
+static struct rom_image *roms;
+static size_t rom_count;
+static struct job *jobs;
+static size_t job_count;
+static struct work_queue *queues;
+static int worker_count;
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// returns the index of the rom in the rom list, loading it the first time
+// it is seen, -1 if it cannot be read or -2 if out of memory
+static long find_rom(const char *path)
+{
+    for (size_t i = 0; i < rom_count; i++)
+    {
+        if (strcmp(roms[i].path, path) == 0)
+        {
+            return i;
+        }
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    uint8_t *data = malloc(4096 - 0x200);
+    if (data == NULL)
+    {
+        fclose(file);
+        return -2;
+    }
+    size_t size = fread(data, 1, 4096 - 0x200, file);
+    fclose(file);
+
+    struct rom_image *grown = realloc(roms, (rom_count + 1) * sizeof(struct rom_image));
+    char *copy = strdup(path);
+    if (grown == NULL || copy == NULL)
+    {
+        free(copy);
+        free(data);
+        roms = grown != NULL ? grown : roms;
+        return -2;
+    }
+    roms = grown;
+    struct rom_image *rom = &roms[rom_count++];
+    rom->path = copy;
+    rom->data = data;
+    rom->size = size;
+    return rom_count - 1;
+}
+
+// reads lines of the form "<rom> <cycles> [input script or recording] [seed]",
+// with - for no input. blank lines and lines starting with # are ignored. a
+// recording sets the seed it was made with unless one is given, and 0 cycles
+// runs it to where it stopped
+static bool load_jobs(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror("unable to open job file");
+        return false;
+    }
+
+    size_t capacity = 0;
+    char line[1024];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        char rom_path[512];
+        char input_path[512];
+        char seed[32];
+        unsigned long long cycles;
+        int fields = sscanf(line, "%511s %llu %511s %31s", rom_path, &cycles, input_path, seed);
+        bool has_input = fields >= 3 && strcmp(input_path, "-") != 0;
+        bool recording = has_input && replay_is_recording(input_path);
+        if (fields < 2 || (cycles == 0 && !recording))
+        {
+            printf("bad job file line %d: %s", line_number, line);
+            fclose(f);
+            return false;
+        }
+
+        // roms are resolved up front so the worker threads never touch the
+        // shared rom list
+        long rom = find_rom(rom_path);
+        if (rom < 0)
+        {
+            if (rom == -1)
+            {
+                printf("unable to open rom %s on line %d\n", rom_path, line_number);
+            }
+            else
+            {
+                printf("out of memory loading rom %s on line %d\n", rom_path, line_number);
+            }
+            fclose(f);
+            return false;
+        }
+
+        if (job_count == capacity)
+        {
+            size_t grown_capacity = capacity == 0 ? 256 : capacity * 2;
+            struct job *grown = realloc(jobs, grown_capacity * sizeof(struct job));
+            if (grown == NULL)
+            {
+                printf("out of memory reading job file line %d\n", line_number);
+                fclose(f);
+                return false;
+            }
+            jobs = grown;
+            capacity = grown_capacity;
+        }
+        char *input_copy = has_input ? strdup(input_path) : NULL;
+        if (has_input && input_copy == NULL)
+        {
+            printf("out of memory reading job file line %d\n", line_number);
+            fclose(f);
+            return false;
+        }
+        struct job *job = &jobs[job_count++];
+        memset(job, 0, sizeof(struct job));
+        job->rom = rom;
+        job->cycles = cycles;
+        job->input_path = input_copy;
+        job->recording = recording;
+        job->seeded = fields == 4;
+        job->seed = fields == 4 ? strtoull(seed, NULL, 0) : 0;
+    }
+    fclose(f);
+    return true;
+}
+
+// take a job from the back of our own queue
+static bool pop_job(struct work_queue *queue, size_t *job)
+{
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail > queue->head)
+    {
+        *job = queue->jobs[--queue->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// take a job from the front of another worker's queue
+static bool steal_job(struct work_queue *queue, size_t *job)
+{
+    bool found = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail > queue->head)
+    {
+        *job = queue->jobs[queue->head++];
+        found = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void run_job(struct chip8 *c8, struct job *job)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the worker's machine ran other jobs, and a recording sets its own
+    // rate and profile, so every job starts from the defaults
+    set_cycles_per_second(c8, DEFAULT_CYCLES_PER_SECOND);
+    if (c8->quirks != QUIRKS_MODERN)
+    {
+        set_quirk_profile(c8, QUIRKS_MODERN);
+    }
+    seed_random(c8, job->seed);
+    reset_emulator(c8);
+    c8->backend = &headless_backend;
+    struct rom_image *rom = &roms[job->rom];
+    if (!load_rom_data(c8, rom->data, rom->size) || !c8->backend->init(c8))
+    {
+        return;
+    }
+
+    uint64_t cycles = job->cycles;
+    bool loaded = true;
+    if (job->recording)
+    {
+        uint64_t end;
+        loaded = replay_load(c8, job->input_path, &end);
+        if (cycles == 0)
+        {
+            cycles = end;
+        }
+        if (job->seeded)
+        {
+            seed_random(c8, job->seed);
+        }
+    }
+    else if (job->input_path != NULL)
+    {
+        loaded = headless_load_input(c8, job->input_path);
+    }
+    if (loaded)
+    {
+        run_emulator(c8, cycles, NULL, false);
+        job->ok = !c8->faulted;
+        job->faulted = c8->faulted;
+        job->fault_opcode = c8->fault_opcode;
+        job->seed = c8->random_seed;
+        job->instructions = c8->instruction_count;
+        job->pc = c8->reg_pc;
+        job->display_hash = display_hash(c8);
+        job->state_hash = snapshot_hash(c8);
+    }
+    c8->backend->cleanup(c8);
+
+    job->seconds = elapsed_seconds(&start);
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *worker = arg;
+    struct chip8 *c8 = create_emulator();
+    if (c8 == NULL)
+    {
+        return NULL;
+    }
+    if (dispatch_mode == DISPATCH_JIT)
+    {
+        jit_init(c8);
+    }
+
+    for (;;)
+    {
+        size_t job;
+        bool found = pop_job(&queues[worker->index], &job);
+        for (int i = 1; i < worker_count && !found; i++)
+        {
+            found = steal_job(&queues[(worker->index + i) % worker_count], &job);
+        }
+        if (!found)
+        {
+            // jobs are only ever removed, so every queue being empty means
+            // all the work has been handed out
+            break;
+        }
+        run_job(c8, &jobs[job]);
+    }
+
+    destroy_emulator(c8);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: ./chip8-batch [job file] [--threads=count] [--dispatch=chain|table|threaded|cached|jit]\n");
+        return EXIT_FAILURE;
+    }
+
+    worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            worker_count = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--dispatch=", 11) == 0)
+        {
+            if (!parse_dispatch_mode(argv[i] + 11, &dispatch_mode))
+            {
+                printf("unknown dispatch mode %s\n", argv[i] + 11);
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            printf("unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (worker_count < 1)
+    {
+        worker_count = 1;
+    }
+
+    if (!load_jobs(argv[1]))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // deal the jobs out round robin so every worker starts with a share
+    queues = calloc(worker_count, sizeof(struct work_queue));
+    for (int i = 0; i < worker_count; i++)
+    {
+        pthread_mutex_init(&queues[i].lock, NULL);
+        queues[i].jobs = malloc((job_count / worker_count + 1) * sizeof(size_t));
+    }
+    for (size_t i = 0; i < job_count; i++)
+    {
+        struct work_queue *queue = &queues[i % worker_count];
+        queue->jobs[queue->tail++] = i;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct worker *workers = calloc(worker_count, sizeof(struct worker));
+    int started = 0;
+    while (started < worker_count)
+    {
+        workers[started].index = started;
+        if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0)
+        {
+            break;
+        }
+        started++;
+    }
+    // a worker that could not start runs here, and it and the others steal
+    // the queues of the rest
+    if (started < worker_count)
+    {
+        worker_main(&workers[started]);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    double seconds = elapsed_seconds(&start);
+
+    uint64_t total_instructions = 0;
+    int failures = 0;
+    printf("job rom seed instructions pc display_hash state_hash seconds\n");
+    for (size_t i = 0; i < job_count; i++)
+    {
+        struct job *job = &jobs[i];
+        if (job->faulted)
+        {
+            printf("%zu %s failed: unknown opcode %04X at %03X\n", i, roms[job->rom].path, job->fault_opcode,
+                   job->pc);
+            failures++;
+            continue;
+        }
+        if (!job->ok)
+        {
+            printf("%zu %s failed\n", i, roms[job->rom].path);
+            failures++;
+            continue;
+        }
+        printf("%zu %s %llu %llu %X %016llx %016llx %.6f\n", i, roms[job->rom].path,
+               (unsigned long long)job->seed, (unsigned long long)job->instructions, job->pc,
+               (unsigned long long)job->display_hash, (unsigned long long)job->state_hash, job->seconds);
+        total_instructions += job->instructions;
+    }
+
+    printf("jobs: %zu (%d failed)\n", job_count, failures);
+    printf("threads: %d\n", worker_count);
+    printf("instructions: %llu\n", (unsigned long long)total_instructions);
+    printf("wall time: %.3f s\n", seconds);
+    if (seconds > 0)
+    {
+        printf("instructions/sec: %.0f\n", total_instructions / seconds);
+    }
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        pthread_mutex_destroy(&queues[i].lock);
+        free(queues[i].jobs);
+    }
+    free(queues);
+    free(workers);
+    for (size_t i = 0; i < job_count; i++)
+    {
+        free(jobs[i].input_path);
+    }
+    free(jobs);
+    for (size_t i = 0; i < rom_count; i++)
+    {
+        free(roms[i].path);
+        free(roms[i].data);
+    }
+    free(roms);
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
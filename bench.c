@@ -0,0 +1,951 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "chip8.h"
+#include "jit.h"
+#include "backend.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "lanes.h"
+
+// benchmarks for the emulator core. micro benchmarks run one operation many
+// times on a machine that has been running a rom, macro benchmarks run whole
+// roms headless for a fixed number of instructions. every benchmark is
+// timed over several samples and reported as percentiles of ns per
+// operation, as text, csv or json, and can be compared against the csv of
+// an earlier run to catch regressions. the lanes benchmarks run the roms on
+// the lockstep core, many machines at once
+
+struct benchmark
+{
+    const char *name;
+    void (*run)(struct chip8 *c8, uint32_t iterations);
+
+    // operations per sample
+    uint32_t iterations;
+};
+
+// a rom assembled from opcodes, bundled so the macro benchmarks measure the
+// same programs on every machine and at every commit
+struct bench_rom
+{
+    const char *name;
+    const uint16_t *words;
+    size_t count;
+};
+
+struct result
+{
+    const char *name;
+    const char *kind;
+    uint64_t iterations;
+    uint32_t samples;
+    double p50;
+    double p90;
+    double p99;
+    double min;
+};
+
+static struct snapshot saved;
+static struct snapshot other;
+
+static void bench_snapshot_save(struct chip8 *c8, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        snapshot_save(c8, &saved);
+    }
+}
+
+static void bench_snapshot_restore(struct chip8 *c8, uint32_t iterations)
+{
+    // same program in memory, the decoded code survives
+    snapshot_save(c8, &saved);
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        snapshot_restore(c8, &saved);
+    }
+}
+
+static void bench_snapshot_restore_other(struct chip8 *c8, uint32_t iterations)
+{
+    // alternate between two memory images so every restore drops the
+    // decoded code
+    snapshot_save(c8, &saved);
+    other = saved;
+    other.state[offsetof(struct chip8, memory) + 0xfff] ^= 0xff;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        snapshot_restore(c8, (i & 0x1) ? &other : &saved);
+    }
+    snapshot_restore(c8, &saved);
+}
+
+static void bench_snapshot_file(struct chip8 *c8, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        if (!snapshot_write(c8, "bench.c8s") || !snapshot_read(c8, "bench.c8s"))
+        {
+            printf("snapshot file round trip failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    remove("bench.c8s");
+}
+
+// a frame of instructions at the default rate, the unit rewind records
+static void run_frames(struct chip8 *c8, uint32_t frames, bool capture)
+{
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        execute_cycles(c8, c8->frame_cycles_left, false);
+        if (capture)
+        {
+            rewind_capture(c8);
+        }
+    }
+}
+
+static void bench_frame(struct chip8 *c8, uint32_t iterations)
+{
+    run_frames(c8, iterations, false);
+}
+
+static void bench_frame_rewind(struct chip8 *c8, uint32_t iterations)
+{
+    if (!rewind_open(c8, DEFAULT_REWIND_BUDGET, DEFAULT_REWIND_INTERVAL))
+    {
+        printf("unable to start rewind\n");
+        exit(EXIT_FAILURE);
+    }
+    run_frames(c8, iterations, true);
+    rewind_close(c8);
+}
+
+static void bench_rewind_step_back(struct chip8 *c8, uint32_t iterations)
+{
+    rewind_open(c8, DEFAULT_REWIND_BUDGET, DEFAULT_REWIND_INTERVAL);
+    run_frames(c8, iterations, true);
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        rewind_step_back(c8);
+    }
+    rewind_close(c8);
+}
+
+// instructions through the selected decoder
+static void bench_execute(struct chip8 *c8, uint32_t iterations)
+{
+    execute_cycles(c8, iterations, false);
+}
+
+// fetch and decode every instruction of the rom in turn without running it
+static void bench_fetch_decode(struct chip8 *c8, uint32_t iterations)
+{
+    struct decoded_op op;
+    uint16_t end = 0x200 + (c8->rom_size & ~0x1);
+    uint16_t pc = 0x200;
+    uint32_t check = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        decode_op(c8->memory[pc] << 8 | c8->memory[pc + 1], c8->quirks, &op);
+        check += op.kk;
+        pc += 2;
+        if (pc >= end)
+        {
+            pc = 0x200;
+        }
+    }
+    c8->reg_vx[0] = check;
+}
+
+// the 8xy_ handlers on V1 and V2
+#define ALU_BENCHMARK(name, call) \
+    static void bench_##name(struct chip8 *c8, uint32_t iterations) \
+    { \
+        for (uint32_t i = 0; i < iterations; i++) \
+        { \
+            call; \
+        } \
+    }
+
+ALU_BENCHMARK(alu_ld, load_from_register(c8, 1, 2))
+ALU_BENCHMARK(alu_or, or_registers(c8, 1, 2))
+ALU_BENCHMARK(alu_and, and_registers(c8, 1, 2))
+ALU_BENCHMARK(alu_xor, xor_registers(c8, 1, 2))
+ALU_BENCHMARK(alu_add, add_registers(c8, 1, 2))
+ALU_BENCHMARK(alu_sub, sub_registers(c8, 1, 2))
+ALU_BENCHMARK(alu_shr, shift_register_right(c8, 1, 2))
+ALU_BENCHMARK(alu_subn, subn_registers(c8, 1, 2))
+ALU_BENCHMARK(alu_shl, shift_register_left(c8, 1, 2))
+
+#undef ALU_BENCHMARK
+
+// DRW of a font sprite of n rows at column x, row y
+static void draw_sprites(struct chip8 *c8, uint32_t iterations, uint8_t x, uint8_t y, uint8_t n)
+{
+    c8->reg_vx[0] = x;
+    c8->reg_vx[1] = y;
+    c8->reg_i = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        display_sprite(c8, 0, 1, n);
+    }
+}
+
+static void bench_sprite_1_row(struct chip8 *c8, uint32_t iterations)
+{
+    draw_sprites(c8, iterations, 8, 4, 1);
+}
+
+static void bench_sprite_5_rows(struct chip8 *c8, uint32_t iterations)
+{
+    draw_sprites(c8, iterations, 8, 4, 5);
+}
+
+static void bench_sprite_15_rows(struct chip8 *c8, uint32_t iterations)
+{
+    draw_sprites(c8, iterations, 8, 4, 15);
+}
+
+static void bench_sprite_unaligned(struct chip8 *c8, uint32_t iterations)
+{
+    draw_sprites(c8, iterations, 3, 4, 15);
+}
+
+static void bench_sprite_clipped(struct chip8 *c8, uint32_t iterations)
+{
+    // past the right and bottom edges
+    draw_sprites(c8, iterations, 60, 28, 15);
+}
+
+static void bench_draw_display(struct chip8 *c8, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        draw_display(c8);
+    }
+}
+
+static void bench_present_changed(struct chip8 *c8, uint32_t iterations)
+{
+    // a pixel flips every frame, so every present goes to the backend
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        c8->display[i & 0x1f] ^= 1;
+        c8->display_dirty = true;
+        present_display(c8);
+    }
+}
+
+static void bench_present_unchanged(struct chip8 *c8, uint32_t iterations)
+{
+    // drawn to but the same as last time, the hash check skips the present
+    present_display(c8);
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        c8->display_dirty = true;
+        present_display(c8);
+    }
+}
+
+static void bench_bcd(struct chip8 *c8, uint32_t iterations)
+{
+    c8->reg_i = 0xe00;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        c8->reg_vx[0] = i;
+        store_bcd(c8, 0);
+    }
+}
+
+static void bench_store_registers(struct chip8 *c8, uint32_t iterations)
+{
+    c8->reg_i = 0xe00;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        copy_reg_to_mem(c8, 0xf);
+    }
+}
+
+static void bench_load_registers(struct chip8 *c8, uint32_t iterations)
+{
+    c8->reg_i = 0xe00;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        load_reg_from_mem(c8, 0xf);
+    }
+}
+
+static struct benchmark benchmarks[] =
+{
+    { "execute", bench_execute, 1000000 },
+    { "fetch_decode", bench_fetch_decode, 1000000 },
+    { "alu_ld", bench_alu_ld, 1000000 },
+    { "alu_or", bench_alu_or, 1000000 },
+    { "alu_and", bench_alu_and, 1000000 },
+    { "alu_xor", bench_alu_xor, 1000000 },
+    { "alu_add", bench_alu_add, 1000000 },
+    { "alu_sub", bench_alu_sub, 1000000 },
+    { "alu_shr", bench_alu_shr, 1000000 },
+    { "alu_subn", bench_alu_subn, 1000000 },
+    { "alu_shl", bench_alu_shl, 1000000 },
+    { "sprite_1_row", bench_sprite_1_row, 1000000 },
+    { "sprite_5_rows", bench_sprite_5_rows, 1000000 },
+    { "sprite_15_rows", bench_sprite_15_rows, 200000 },
+    { "sprite_unaligned", bench_sprite_unaligned, 200000 },
+    { "sprite_clipped", bench_sprite_clipped, 200000 },
+    { "draw_display", bench_draw_display, 1000000 },
+    { "present_changed", bench_present_changed, 200000 },
+    { "present_unchanged", bench_present_unchanged, 200000 },
+    { "bcd", bench_bcd, 200000 },
+    { "store_registers", bench_store_registers, 200000 },
+    { "load_registers", bench_load_registers, 1000000 },
+    { "snapshot_save", bench_snapshot_save, 100000 },
+    { "snapshot_restore", bench_snapshot_restore, 100000 },
+    { "snapshot_restore_other", bench_snapshot_restore_other, 10000 },
+    { "snapshot_write_read", bench_snapshot_file, 100 },
+    { "frame", bench_frame, 10000 },
+    { "frame_rewind", bench_frame_rewind, 10000 },
+    { "rewind_capture_and_step_back", bench_rewind_step_back, 1000 },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// every opcode group, subroutines and the timers, the default warmup rom
+static const uint16_t mixed_rom[] =
+{
+    0x6005, 0x6107, 0x6a00, 0x6b00, 0xa300,     // 200 V0=5 V1=7 VA=VB=0 I=300
+    0x8014, 0x8105, 0x8206, 0x820e, 0x8017,     // 20A alu
+    0x8123, 0x8231, 0x8312, 0x7001,
+    0xf033, 0xf265, 0xf355,                     // 21C bcd, load and store at 300
+    0xc3ff, 0xf029, 0xdab5,                     // 222 draw a random digit
+    0x7a03, 0x7b02, 0x4a30, 0x6a00, 0x4b10, 0x6b00,
+    0x224c,                                     // 234 call 24C
+    0x3000, 0x5010, 0x9010, 0x8000,             // 236 skips
+    0xf415, 0xf407, 0xf418,                     // 23E timers
+    0xa300, 0xf01e, 0xa300,
+    0x120a,                                     // 24A jump to 20A
+    0x8c00, 0x7c01, 0x3c80, 0x00ee,             // 24C subroutine
+    0x00e0, 0x00ee,
+};
+
+// straight line register arithmetic, the best case for the decoders
+static const uint16_t alu_rom[] =
+{
+    0x6001, 0x6103, 0x6207,                     // 200 V0=1 V1=3 V2=7
+    0x8014, 0x8125, 0x8203, 0x8011, 0x8122,     // 206 loop
+    0x8206, 0x801e, 0x8127, 0x7301,
+    0x1206,                                     // 218 jump to 206
+};
+
+// digits drawn across the screen row by row, cleared once it is full
+static const uint16_t sprite_rom[] =
+{
+    0x00e0, 0x6000, 0x6100, 0x6200, 0x6f0f,     // 200 CLS V0=V1=V2=0 VF=F
+    0x82f2, 0xf229, 0xd015,                     // 20A I=digit(V2 & F), draw
+    0x7005, 0x7201, 0x3040, 0x120a,             // 210 next column until 64
+    0x6000, 0x7106, 0x411e, 0x1200,             // 218 next row, CLS after 5
+    0x120a,
+};
+
+// a score counter: bcd of a register, read back and spread over memory
+static const uint16_t bcd_rom[] =
+{
+    0x6500,                                     // 200 V5=0
+    0x7501, 0xa300, 0xf533, 0xf265,             // 202 loop: bcd of V5 at 300
+    0xa310, 0xf755, 0xf765,                     // 20A V0-V7 to 310 and back
+    0x1202,                                     // 210 jump to 202
+};
+
+// nested subroutine calls
+static const uint16_t call_rom[] =
+{
+    0x2210, 0x2214, 0x7001, 0x1200,             // 200 call 210, call 214
+    0x0000, 0x0000, 0x0000, 0x0000,
+    0x7101, 0x00ee,                             // 210 V1++
+    0x2210, 0x7201, 0x00ee,                     // 214 call 210, V2++
+};
+
+// rewrites an instruction it then runs, every pass drops decoded code
+static const uint16_t smc_rom[] =
+{
+    0x6072, 0x6100,                             // 200 V0=72 V1=0
+    0x7101, 0xa20c, 0xf155,                     // 204 write 72xx at 20C
+    0x120c,                                     // 20A jump to it
+    0x7200, 0x1204,                             // 20C ADD V2, xx
+};
+
+// waits on the delay timer every frame, as games do to hold 60 Hz
+static const uint16_t timer_rom[] =
+{
+    0x6001,                                     // 200 V0=1
+    0xf015,                                     // 202 DT=V0
+    0xf107, 0x3100, 0x1204,                     // 204 spin until DT is 0
+    0x7201, 0x1202,                             // 20A V2++
+};
+
+// long delay timer waits, the idle loop fast forward skips most of them
+static const uint16_t idle_rom[] =
+{
+    0x601e,                                     // 200 V0=30
+    0xf015,                                     // 202 DT=V0
+    0xf107, 0x3100, 0x1204,                     // 204 spin until DT is 0
+    0x7201, 0x1202,                             // 20A V2++
+};
+
+// the instructions that differ between quirk profiles, with a Bnnn that
+// lands on a different path for the profiles that add Vx
+static const uint16_t quirks_rom[] =
+{
+    0xa300, 0x6a81, 0x6b42,                     // 200 I=300 VA=81 VB=42
+    0x6f07, 0x8ab6, 0x6f07, 0x8cbe,             // 206 shifts
+    0x6f07, 0x8ab1, 0x6f07, 0x8ab2, 0x8db3,     // 20E logic
+    0xf455, 0xf465,                             // 218 store and load at 300
+    0x8050, 0x611e, 0xd015,                     // 21C draw across the bottom edge
+    0x6000, 0x6204, 0xb22a, 0x0000,             // 222 V0=0 V2=4, jump 22A or 22E
+    0x7e01, 0x1230,                             // 22A VE++
+    0x7e10,                                     // 22E VE+=10
+    0x7501, 0x1200,                             // 230 V5++
+};
+
+#define ROM(name, words) { name, words, sizeof(words) / sizeof(words[0]) }
+
+static const struct bench_rom bench_roms[] =
+{
+    ROM("mixed", mixed_rom),
+    ROM("alu", alu_rom),
+    ROM("sprites", sprite_rom),
+    ROM("bcd", bcd_rom),
+    ROM("calls", call_rom),
+    ROM("smc", smc_rom),
+    ROM("timer_wait", timer_rom),
+    ROM("idle", idle_rom),
+};
+
+static const struct bench_rom quirks_bench_rom = ROM("quirks", quirks_rom);
+
+#undef ROM
+
+#define BENCH_ROM_COUNT (sizeof(bench_roms) / sizeof(bench_roms[0]))
+
+// profile every machine runs as, the quirks benchmarks run all of them
+static enum quirk_profile selected_quirks = QUIRKS_MODERN;
+
+static bool load_bench_rom(struct chip8 *c8, const struct bench_rom *rom)
+{
+    uint8_t data[4096];
+    for (size_t i = 0; i < rom->count; i++)
+    {
+        data[2 * i] = rom->words[i] >> 8;
+        data[2 * i + 1] = rom->words[i] & 0xff;
+    }
+    return load_rom_data(c8, data, rom->count * 2);
+}
+
+// a headless machine in the selected dispatch mode and quirk profile
+static struct chip8 *create_machine()
+{
+    struct chip8 *c8 = create_emulator();
+    set_quirk_profile(c8, selected_quirks);
+    c8->backend = &headless_backend;
+    if (!c8->backend->init(c8))
+    {
+        printf("unable to start the headless backend\n");
+        exit(EXIT_FAILURE);
+    }
+    if (dispatch_mode == DISPATCH_JIT)
+    {
+        jit_init(c8);
+    }
+    return c8;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// nearest rank percentile of sorted samples
+static double percentile(const double *sorted, uint32_t count, int percent)
+{
+    uint32_t rank = (count * percent + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void summarize(struct result *r, double *samples)
+{
+    qsort(samples, r->samples, sizeof(double), compare_doubles);
+    r->min = samples[0];
+    r->p50 = percentile(samples, r->samples, 50);
+    r->p90 = percentile(samples, r->samples, 90);
+    r->p99 = percentile(samples, r->samples, 99);
+}
+
+// run a bundled rom, or the rom file at path, headless as the given profile
+// for r->iterations instructions per sample
+static bool time_rom(struct result *r, const struct bench_rom *bundled, const char *path,
+                     enum quirk_profile quirks, double *times)
+{
+    struct chip8 *c8 = create_machine();
+    set_quirk_profile(c8, quirks);
+    for (uint32_t s = 0; s < r->samples; s++)
+    {
+        reset_emulator(c8);
+        bool loaded = bundled != NULL ? load_bench_rom(c8, bundled) : load_rom(c8, path);
+        if (!loaded)
+        {
+            printf("unable to load %s\n", bundled != NULL ? bundled->name : path);
+            cleanup(c8);
+            destroy_emulator(c8);
+            return false;
+        }
+        struct timespec begin;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        run_emulator(c8, r->iterations, NULL, false);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        // a rom that halts early is timed on what it ran
+        uint64_t ran = c8->instruction_count > 0 ? c8->instruction_count : 1;
+        times[s] = elapsed_ns(&begin, &end) / ran;
+    }
+    summarize(r, times);
+    cleanup(c8);
+    destroy_emulator(c8);
+    return true;
+}
+
+// run a bundled rom, or the rom file at path, on count lanes of the lockstep
+// core seeded each with its own index, a frame at a time until they have run
+// r->iterations instructions between them
+static bool time_lanes(struct result *r, const struct bench_rom *bundled, const char *path,
+                       uint32_t count, double *times)
+{
+    struct chip8_lanes *lanes = lanes_create(count);
+    if (lanes == NULL)
+    {
+        printf("unable to allocate %u lanes\n", count);
+        return false;
+    }
+    struct chip8 *c8 = create_emulator();
+    set_quirk_profile(c8, selected_quirks);
+    uint32_t frame = DEFAULT_CYCLES_PER_SECOND / FRAMES_PER_SECOND;
+    uint64_t steps = (r->iterations + (uint64_t)count * frame - 1) / ((uint64_t)count * frame);
+    for (uint32_t s = 0; s < r->samples; s++)
+    {
+        for (uint32_t l = 0; l < count; l++)
+        {
+            reset_emulator(c8);
+            seed_random(c8, l);
+            bool loaded = bundled != NULL ? load_bench_rom(c8, bundled) : load_rom(c8, path);
+            if (!loaded)
+            {
+                printf("unable to load %s\n", bundled != NULL ? bundled->name : path);
+                destroy_emulator(c8);
+                lanes_destroy(lanes);
+                return false;
+            }
+            lanes_set(lanes, l, c8);
+        }
+        struct timespec begin;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        for (uint64_t step = 0; step < steps; step++)
+        {
+            step_batch(lanes, frame);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        // lanes that halt early are timed on what they ran
+        uint64_t ran = 0;
+        for (uint32_t l = 0; l < count; l++)
+        {
+            ran += lanes->instruction_count[l];
+        }
+        times[s] = elapsed_ns(&begin, &end) / (ran > 0 ? ran : 1);
+    }
+    summarize(r, times);
+    destroy_emulator(c8);
+    lanes_destroy(lanes);
+    return true;
+}
+
+enum output_format
+{
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+};
+
+static enum output_format format = FORMAT_TEXT;
+static int printed;
+
+static const char *mode_names[] = { "chain", "table", "threaded", "cached", "jit" };
+
+static void print_header(const char *label, uint32_t samples)
+{
+    const char *mode = mode_names[dispatch_mode];
+    switch (format)
+    {
+        case FORMAT_TEXT:
+            printf("# label=%s dispatch=%s quirks=%s samples=%u\n", label, mode,
+                   quirk_profile_name(selected_quirks), samples);
+            printf("%-30s %-5s %10s %10s %10s %10s %10s %14s\n", "benchmark", "kind", "iterations",
+                   "min", "p50", "p90", "p99", "ops/sec");
+            break;
+        case FORMAT_CSV:
+            printf("benchmark,kind,iterations,samples,min_ns,p50_ns,p90_ns,p99_ns,ops_per_sec,dispatch,label\n");
+            break;
+        case FORMAT_JSON:
+            printf("{\n  \"label\": \"%s\",\n  \"dispatch\": \"%s\",\n  \"samples\": %u,\n  \"results\": [",
+                   label, mode, samples);
+            break;
+    }
+}
+
+// one line per benchmark, ns per operation. for the roms an operation is an
+// instruction, so ops/sec is instructions/sec
+static void print_result(const struct result *r, const char *label)
+{
+    double rate = r->p50 > 0 ? 1e9 / r->p50 : 0;
+    switch (format)
+    {
+        case FORMAT_TEXT:
+            printf("%-30s %-5s %10llu %10.2f %10.2f %10.2f %10.2f %14.0f\n", r->name, r->kind,
+                   (unsigned long long)r->iterations, r->min, r->p50, r->p90, r->p99, rate);
+            break;
+        case FORMAT_CSV:
+            printf("%s,%s,%llu,%u,%.3f,%.3f,%.3f,%.3f,%.0f,%s,%s\n", r->name, r->kind,
+                   (unsigned long long)r->iterations, r->samples, r->min, r->p50, r->p90, r->p99, rate,
+                   mode_names[dispatch_mode], label);
+            break;
+        case FORMAT_JSON:
+            printf("%s\n    { \"benchmark\": \"%s\", \"kind\": \"%s\", \"iterations\": %llu, \"samples\": %u, "
+                   "\"min_ns\": %.3f, \"p50_ns\": %.3f, \"p90_ns\": %.3f, \"p99_ns\": %.3f, \"ops_per_sec\": %.0f }",
+                   printed == 0 ? "" : ",", r->name, r->kind, (unsigned long long)r->iterations, r->samples,
+                   r->min, r->p50, r->p90, r->p99, rate);
+            break;
+    }
+    printed++;
+    fflush(stdout);
+}
+
+static void print_footer()
+{
+    if (format == FORMAT_JSON)
+    {
+        printf("\n  ]\n}\n");
+    }
+}
+
+// p50 of each benchmark in the csv output of an earlier run
+struct baseline
+{
+    char name[64];
+    double p50;
+};
+
+static struct baseline *baselines;
+static size_t baseline_count;
+
+static bool load_baseline(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror("unable to open baseline");
+        return false;
+    }
+    char line[256];
+    size_t capacity = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        char name[64];
+        char kind[16];
+        unsigned long long iterations;
+        unsigned int samples;
+        double min;
+        double p50;
+        if (sscanf(line, "%63[^,],%15[^,],%llu,%u,%lf,%lf", name, kind, &iterations, &samples, &min, &p50) != 6)
+        {
+            // the header
+            continue;
+        }
+        if (baseline_count == capacity)
+        {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            struct baseline *grown = realloc(baselines, capacity * sizeof(struct baseline));
+            if (grown == NULL)
+            {
+                perror("unable to load baseline");
+                fclose(f);
+                free(baselines);
+                baselines = NULL;
+                baseline_count = 0;
+                return false;
+            }
+            baselines = grown;
+        }
+        strcpy(baselines[baseline_count].name, name);
+        baselines[baseline_count].p50 = p50;
+        baseline_count++;
+    }
+    fclose(f);
+    return true;
+}
+
+// compare a result with the baseline on stderr, true if it is slower by
+// more than threshold percent
+static bool regressed(const struct result *r, double threshold)
+{
+    for (size_t i = 0; i < baseline_count; i++)
+    {
+        if (strcmp(baselines[i].name, r->name) == 0 && baselines[i].p50 > 0)
+        {
+            double change = (r->p50 - baselines[i].p50) * 100 / baselines[i].p50;
+            bool slower = change > threshold;
+            fprintf(stderr, "%-30s %10.2f -> %10.2f ns %+7.1f%%%s\n", r->name, baselines[i].p50, r->p50,
+                    change, slower ? "  REGRESSION" : "");
+            return slower;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t warmup = 100000;
+    uint32_t samples = 10;
+    uint64_t rom_cycles = 2000000;
+    const char *filter = NULL;
+    const char *label = "";
+    const char *baseline = NULL;
+    double threshold = 10;
+    uint32_t lane_count = 256;
+    const char *roms[64];
+    int rom_count = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--warmup=", 9) == 0)
+        {
+            warmup = strtoull(argv[i] + 9, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--dispatch=", 11) == 0)
+        {
+            if (!parse_dispatch_mode(argv[i] + 11, &dispatch_mode))
+            {
+                printf("unknown dispatch mode %s\n", argv[i] + 11);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            if (!parse_quirk_profile(argv[i] + 9, &selected_quirks))
+            {
+                printf("unknown quirk profile %s\n", argv[i] + 9);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--no-idle-skip") == 0)
+        {
+            idle_skip = false;
+        }
+        else if (strncmp(argv[i], "--samples=", 10) == 0)
+        {
+            samples = strtoul(argv[i] + 10, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--rom-cycles=", 13) == 0)
+        {
+            rom_cycles = strtoull(argv[i] + 13, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--lanes=", 8) == 0)
+        {
+            lane_count = strtoul(argv[i] + 8, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+        {
+            filter = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--label=", 8) == 0)
+        {
+            label = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--format=", 9) == 0)
+        {
+            const char *name = argv[i] + 9;
+            if (strcmp(name, "text") == 0)
+            {
+                format = FORMAT_TEXT;
+            }
+            else if (strcmp(name, "csv") == 0)
+            {
+                format = FORMAT_CSV;
+            }
+            else if (strcmp(name, "json") == 0)
+            {
+                format = FORMAT_JSON;
+            }
+            else
+            {
+                printf("unknown format %s\n", name);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "--baseline=", 11) == 0)
+        {
+            baseline = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+        {
+            threshold = strtod(argv[i] + 12, NULL);
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("usage: ./chip8-bench [roms...] [--warmup=cycles] [--dispatch=chain|table|threaded|cached|jit]\n"
+                   "       [--samples=count] [--rom-cycles=count] [--filter=text] [--format=text|csv|json]\n"
+                   "       [--label=text] [--baseline=file.csv] [--threshold=percent] [--no-idle-skip]\n"
+                   "       [--quirks=modern|vip|chip48|schip|xochip] [--lanes=count]\n");
+            return EXIT_FAILURE;
+        }
+        else if (rom_count < 64)
+        {
+            roms[rom_count++] = argv[i];
+        }
+    }
+    if (samples == 0)
+    {
+        samples = 1;
+    }
+    if (lane_count == 0)
+    {
+        lane_count = 1;
+    }
+    if (baseline != NULL && !load_baseline(baseline))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // the micro benchmarks run on a machine partway through the first rom
+    // given, or the bundled mixed rom
+    struct chip8 *c8 = create_machine();
+    bool loaded = rom_count > 0 ? load_rom(c8, roms[0]) : load_bench_rom(c8, &bench_roms[0]);
+    if (!loaded)
+    {
+        printf("unable to load %s\n", rom_count > 0 ? roms[0] : bench_roms[0].name);
+        return EXIT_FAILURE;
+    }
+    run_emulator(c8, warmup, NULL, false);
+    struct snapshot *start = malloc(sizeof(struct snapshot));
+    snapshot_save(c8, start);
+
+    double *times = malloc(samples * sizeof(double));
+    bool any_regressed = false;
+    print_header(label, samples);
+
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++)
+    {
+        if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL)
+        {
+            continue;
+        }
+        struct result r = { benchmarks[i].name, "micro", benchmarks[i].iterations, samples };
+        for (uint32_t s = 0; s < samples; s++)
+        {
+            // every sample starts from the same state
+            snapshot_restore(c8, start);
+            struct timespec begin;
+            struct timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &begin);
+            benchmarks[i].run(c8, benchmarks[i].iterations);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            times[s] = elapsed_ns(&begin, &end) / benchmarks[i].iterations;
+        }
+        summarize(&r, times);
+        print_result(&r, label);
+        any_regressed |= regressed(&r, threshold);
+    }
+    cleanup(c8);
+    destroy_emulator(c8);
+
+    // the bundled roms, then any given on the command line
+    for (int i = 0; i < (int)BENCH_ROM_COUNT + rom_count; i++)
+    {
+        bool bundled = i < (int)BENCH_ROM_COUNT;
+        const char *name = bundled ? bench_roms[i].name : roms[i - BENCH_ROM_COUNT];
+        const char *base = strrchr(name, '/');
+        char benchmark_name[256];
+        snprintf(benchmark_name, sizeof(benchmark_name), "rom_%s", base != NULL ? base + 1 : name);
+        if (filter != NULL && strstr(benchmark_name, filter) == NULL)
+        {
+            continue;
+        }
+
+        struct result r = { benchmark_name, "rom", rom_cycles, samples };
+        if (!time_rom(&r, bundled ? &bench_roms[i] : NULL, name, selected_quirks, times))
+        {
+            return EXIT_FAILURE;
+        }
+        print_result(&r, label);
+        any_regressed |= regressed(&r, threshold);
+    }
+
+    // the same roms on the lockstep core, per instruction of one lane
+    for (int i = 0; i < (int)BENCH_ROM_COUNT + rom_count; i++)
+    {
+        bool bundled = i < (int)BENCH_ROM_COUNT;
+        const char *name = bundled ? bench_roms[i].name : roms[i - BENCH_ROM_COUNT];
+        const char *base = strrchr(name, '/');
+        char benchmark_name[256];
+        snprintf(benchmark_name, sizeof(benchmark_name), "lanes_%s", base != NULL ? base + 1 : name);
+        if (filter != NULL && strstr(benchmark_name, filter) == NULL)
+        {
+            continue;
+        }
+
+        struct result r = { benchmark_name, "lanes", rom_cycles, samples };
+        if (!time_lanes(&r, bundled ? &bench_roms[i] : NULL, name, lane_count, times))
+        {
+            return EXIT_FAILURE;
+        }
+        print_result(&r, label);
+        any_regressed |= regressed(&r, threshold);
+    }
+
+    // the same rom as every profile. each profile runs its own copy of the
+    // interpreter with its quirks compiled in, so they should all be as fast
+    // as the modern one, which is the interpreter as it was before profiles
+    for (int q = 0; q < QUIRK_PROFILE_COUNT; q++)
+    {
+        char benchmark_name[64];
+        snprintf(benchmark_name, sizeof(benchmark_name), "quirks_%s", quirk_profile_name(q));
+        if (filter != NULL && strstr(benchmark_name, filter) == NULL)
+        {
+            continue;
+        }
+        struct result r = { benchmark_name, "rom", rom_cycles, samples };
+        if (!time_rom(&r, &quirks_bench_rom, NULL, q, times))
+        {
+            return EXIT_FAILURE;
+        }
+        print_result(&r, label);
+        any_regressed |= regressed(&r, threshold);
+    }
+    print_footer();
+
+    free(times);
+    free(start);
+    return any_regressed ? 2 : 0;
+}
@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "chip8.h"
+#include "capture.h"
+
+// frames the emulator can be ahead of the writer before it drops them, a
+// little over four seconds of emulated time
+#define CAPTURE_RING_FRAMES 256
+
+// slots the writer frees before telling the emulator
+#define CAPTURE_RELEASE_FRAMES 32
+
+// how long the writer sleeps when it has caught up
+#define CAPTURE_IDLE_NS 1000000
+
+enum capture_format
+{
+    CAPTURE_RAW,
+    CAPTURE_Y4M,
+    CAPTURE_PNG
+};
+
+struct capture_slot
+{
+    uint64_t frame;
+    uint64_t display[32];
+};
+
+struct capture
+{
+    enum capture_format format;
+    uint32_t scale;
+    uint32_t width;
+    uint32_t height;
+
+    // single producer single consumer ring. only the emulator writes head
+    // and only the writer writes tail, a slot belongs to the writer from
+    // the head passing it until the tail does. each on its own cache line,
+    // and the emulator only reads tail again when its last copy says the
+    // ring is full
+    struct capture_slot ring[CAPTURE_RING_FRAMES];
+    _Alignas(64) _Atomic uint64_t head;
+    uint64_t known_tail;
+    uint64_t dropped;
+    _Alignas(64) _Atomic uint64_t tail;
+    atomic_bool stopping;
+    pthread_t writer;
+
+    // writer side: the video file or the png name pattern, the image last
+    // encoded and the display it was encoded from, so repeated frames are
+    // not scaled again
+    FILE *file;
+    char *pattern;
+    uint8_t *image;
+    size_t image_size;
+    uint64_t encoded[32];
+    bool have_encoded;
+    uint64_t written;
+    uint64_t bytes;
+    double busy_seconds;
+    bool failed;
+};
+
+// the machine whose frames are written out if the process exits without
+// closing the capture, e.g. on a jit verify mismatch
+static struct chip8 *active;
+
+static const char *y4m_header = "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C420jpeg\n";
+
+static uint32_t crc_table[256];
+
+static void init_crc_table()
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+        {
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+    return p + 4;
+}
+
+// a chunk with its length and crc around data already at p + 8
+static uint8_t *finish_chunk(uint8_t *p, const char *type, uint32_t length)
+{
+    put_be32(p, length);
+    memcpy(p + 4, type, 4);
+    uint32_t crc = crc32(0, p + 4, length + 4);
+    return put_be32(p + 8 + length, crc);
+}
+
+// stored deflate blocks hold up to this many bytes each
+#define DEFLATE_STORED_MAX 65535
+
+// size of a 1 bit grayscale png of the scaled display. the pixel data is
+// stored uncompressed, which needs no zlib and is small at one bit a pixel
+static size_t png_size(const struct capture *c)
+{
+    size_t raw = (size_t)c->height * (1 + c->width / 8);
+    size_t blocks = (raw + DEFLATE_STORED_MAX - 1) / DEFLATE_STORED_MAX;
+    return 8 + (12 + 13) + (12 + 2 + blocks * 5 + raw + 4) + 12;
+}
+
+// the scaled display as a png, in c->image
+static void encode_png(struct capture *c, const uint64_t *display)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint8_t *p = c->image;
+    memcpy(p, signature, 8);
+    p += 8;
+
+    uint8_t *ihdr = p + 8;
+    ihdr = put_be32(ihdr, c->width);
+    ihdr = put_be32(ihdr, c->height);
+    ihdr[0] = 1;
+    ihdr[1] = 0;
+    ihdr[2] = 0;
+    ihdr[3] = 0;
+    ihdr[4] = 0;
+    p = finish_chunk(p, "IHDR", 13);
+
+    // rows with no filter, each pixel of the display as scale bits
+    uint8_t *idat = p;
+    uint8_t *data = p + 8;
+    uint8_t *z = data + 2;
+    size_t row_size = 1 + c->width / 8;
+    size_t raw = (size_t)c->height * row_size;
+    uint8_t row[1 + 64 * 64 / 8];
+    uint32_t a = 1;
+    uint32_t b = 0;
+    size_t block_left = 0;
+    size_t left = raw;
+    data[0] = 0x78;
+    data[1] = 0x01;
+    for (int y = 0; y < 32; y++)
+    {
+        memset(row, 0, row_size);
+        for (uint32_t x = 0; x < 64 * c->scale; x++)
+        {
+            if ((display[y] >> (63 - x / c->scale)) & 1)
+            {
+                row[1 + x / 8] |= 0x80 >> (x & 7);
+            }
+        }
+        for (uint32_t repeat = 0; repeat < c->scale; repeat++)
+        {
+            for (size_t i = 0; i < row_size; i++)
+            {
+                if (block_left == 0)
+                {
+                    block_left = left < DEFLATE_STORED_MAX ? left : DEFLATE_STORED_MAX;
+                    z[0] = block_left == left;
+                    z[1] = block_left;
+                    z[2] = block_left >> 8;
+                    z[3] = ~block_left;
+                    z[4] = ~block_left >> 8;
+                    z += 5;
+                }
+                *z++ = row[i];
+                a = (a + row[i]) % 65521;
+                b = (b + a) % 65521;
+                block_left--;
+                left--;
+            }
+        }
+    }
+    z = put_be32(z, (b << 16) | a);
+    p = finish_chunk(idat, "IDAT", z - data);
+    p = finish_chunk(p, "IEND", 0);
+    c->image_size = p - c->image;
+}
+
+// the scaled display as a video frame, luma then for y4m the two chroma
+// planes at half resolution, in c->image
+static void encode_video(struct capture *c, const uint64_t *display)
+{
+    uint8_t *p = c->image;
+    if (c->format == CAPTURE_Y4M)
+    {
+        memcpy(p, "FRAME\n", 6);
+        p += 6;
+    }
+    for (int y = 0; y < 32; y++)
+    {
+        uint8_t *row = p;
+        for (uint32_t x = 0; x < c->width; x++)
+        {
+            row[x] = (display[y] >> (63 - x / c->scale)) & 1 ? 255 : 0;
+        }
+        p += c->width;
+        for (uint32_t repeat = 1; repeat < c->scale; repeat++)
+        {
+            memcpy(p, row, c->width);
+            p += c->width;
+        }
+    }
+    if (c->format == CAPTURE_Y4M)
+    {
+        size_t chroma = 2 * (size_t)((c->width + 1) / 2) * ((c->height + 1) / 2);
+        memset(p, 128, chroma);
+        p += chroma;
+    }
+    c->image_size = p - c->image;
+}
+
+static void write_slot(struct capture *c, const struct capture_slot *slot)
+{
+    if (!c->have_encoded || memcmp(c->encoded, slot->display, sizeof(c->encoded)) != 0)
+    {
+        if (c->format == CAPTURE_PNG)
+        {
+            encode_png(c, slot->display);
+        }
+        else
+        {
+            encode_video(c, slot->display);
+        }
+        memcpy(c->encoded, slot->display, sizeof(c->encoded));
+        c->have_encoded = true;
+    }
+
+    FILE *file = c->file;
+    if (c->format == CAPTURE_PNG)
+    {
+        char name[4096];
+        snprintf(name, sizeof(name), c->pattern, (unsigned long long)slot->frame);
+        file = fopen(name, "wb");
+        if (file == NULL)
+        {
+            if (!c->failed)
+            {
+                perror("unable to open capture frame");
+            }
+            c->failed = true;
+            return;
+        }
+    }
+    if (fwrite(c->image, 1, c->image_size, file) != c->image_size && !c->failed)
+    {
+        perror("unable to write capture");
+        c->failed = true;
+    }
+    if (c->format == CAPTURE_PNG)
+    {
+        fclose(file);
+    }
+    c->written++;
+    c->bytes += c->image_size;
+}
+
+static double seconds_between(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void *writer_main(void *arg)
+{
+    struct capture *c = arg;
+    uint64_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    for (;;)
+    {
+        uint64_t head = atomic_load_explicit(&c->head, memory_order_acquire);
+        if (head == tail)
+        {
+            // the emulator sets stopping after its last frame, so nothing
+            // is queued once it is seen with the ring empty
+            if (atomic_load_explicit(&c->stopping, memory_order_acquire) &&
+                atomic_load_explicit(&c->head, memory_order_acquire) == tail)
+            {
+                break;
+            }
+            struct timespec idle = { 0, CAPTURE_IDLE_NS };
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        // slots are handed back a few at a time, the emulator reads tail
+        // when the ring is full and each store takes the line from it
+        for (; tail != head; tail++)
+        {
+            write_slot(c, &c->ring[tail % CAPTURE_RING_FRAMES]);
+            if ((tail + 1) % CAPTURE_RELEASE_FRAMES == 0)
+            {
+                atomic_store_explicit(&c->tail, tail + 1, memory_order_release);
+            }
+        }
+        atomic_store_explicit(&c->tail, tail, memory_order_release);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        c->busy_seconds += seconds_between(&start, &end);
+    }
+    return NULL;
+}
+
+// a printf pattern for the frame numbers of a png name, with %05llu put in
+// before the extension unless the name has a number of its own
+static char *png_pattern(const char *path)
+{
+    const char *percent = strchr(path, '%');
+    size_t length = strlen(path);
+    char *pattern = malloc(length + 16);
+    if (pattern == NULL)
+    {
+        return NULL;
+    }
+    if (percent != NULL)
+    {
+        // frame%05d.png, the number is printed as unsigned long long
+        const char *conversion = percent + 1 + strspn(percent + 1, "0123456789");
+        if ((*conversion != 'd' && *conversion != 'u') || strchr(conversion, '%') != NULL)
+        {
+            free(pattern);
+            return NULL;
+        }
+        sprintf(pattern, "%.*sllu%s", (int)(conversion - path), path, conversion + 1);
+    }
+    else
+    {
+        sprintf(pattern, "%.*s%%05llu.png", (int)(length - 4), path);
+    }
+    return pattern;
+}
+
+static bool ends_with(const char *text, const char *suffix)
+{
+    size_t length = strlen(text);
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(text + length - suffix_length, suffix) == 0;
+}
+
+static void close_at_exit()
+{
+    if (active != NULL)
+    {
+        capture_close(active, NULL);
+    }
+}
+
+bool capture_open(struct chip8 *c8, const char *path, uint32_t scale)
+{
+    if (scale == 0 || scale > 64)
+    {
+        printf("unable to start capture, the scale is 1 to 64\n");
+        return false;
+    }
+    struct capture *c = calloc(1, sizeof(struct capture));
+    if (c == NULL)
+    {
+        perror("unable to start capture");
+        return false;
+    }
+    c->scale = scale;
+    c->width = 64 * scale;
+    c->height = 32 * scale;
+    c->format = ends_with(path, ".y4m") ? CAPTURE_Y4M : ends_with(path, ".png") ? CAPTURE_PNG : CAPTURE_RAW;
+
+    size_t image_size = (size_t)c->width * c->height * 2 + 6;
+    if (c->format == CAPTURE_PNG)
+    {
+        init_crc_table();
+        image_size = png_size(c);
+        c->pattern = png_pattern(path);
+        if (c->pattern == NULL)
+        {
+            printf("unable to start capture, the png frame number is %%d or %%0Nd\n");
+            free(c);
+            return false;
+        }
+    }
+    else
+    {
+        c->file = fopen(path, "wb");
+        if (c->file == NULL)
+        {
+            perror("unable to open capture");
+            free(c);
+            return false;
+        }
+        if (c->format == CAPTURE_Y4M)
+        {
+            fprintf(c->file, y4m_header, c->width, c->height);
+        }
+    }
+    c->image = malloc(image_size);
+    if (c->image == NULL)
+    {
+        perror("unable to start capture");
+        if (c->file != NULL)
+        {
+            fclose(c->file);
+        }
+        free(c->pattern);
+        free(c);
+        return false;
+    }
+
+    // pthread_create returns the error rather than setting errno
+    int error = pthread_create(&c->writer, NULL, writer_main, c);
+    if (error != 0)
+    {
+        printf("unable to start capture writer: %s\n", strerror(error));
+        if (c->file != NULL)
+        {
+            fclose(c->file);
+        }
+        free(c->image);
+        free(c->pattern);
+        free(c);
+        return false;
+    }
+
+    if (active == NULL)
+    {
+        static bool handler_installed = false;
+        if (!handler_installed)
+        {
+            handler_installed = true;
+            atexit(close_at_exit);
+        }
+        active = c8;
+    }
+    c8->capture = c;
+    return true;
+}
+
+void capture_close(struct chip8 *c8, FILE *report)
+{
+    struct capture *c = c8->capture;
+    if (c == NULL)
+    {
+        return;
+    }
+    c8->capture = NULL;
+    if (active == c8)
+    {
+        active = NULL;
+    }
+
+    atomic_store_explicit(&c->stopping, true, memory_order_release);
+    pthread_join(c->writer, NULL);
+    if (c->file != NULL && fclose(c->file) != 0 && !c->failed)
+    {
+        perror("unable to write capture");
+    }
+
+    if (report != NULL)
+    {
+        fprintf(report, "capture: %llu frames written, %llu dropped\n",
+                (unsigned long long)c->written, (unsigned long long)c->dropped);
+        if (c->busy_seconds > 0)
+        {
+            fprintf(report, "capture writer: %.0f frames/sec, %.1f MB/sec\n",
+                    c->written / c->busy_seconds, c->bytes / c->busy_seconds / 1e6);
+        }
+    }
+    free(c->image);
+    free(c->pattern);
+    free(c);
+}
+
+void capture_frame(struct chip8 *c8)
+{
+    struct capture *c = c8->capture;
+    uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    if (head - c->known_tail == CAPTURE_RING_FRAMES)
+    {
+        c->known_tail = atomic_load_explicit(&c->tail, memory_order_acquire);
+        if (head - c->known_tail == CAPTURE_RING_FRAMES)
+        {
+            c->dropped++;
+            return;
+        }
+    }
+    struct capture_slot *slot = &c->ring[head % CAPTURE_RING_FRAMES];
+    slot->frame = c8->frame_count;
+    memcpy(slot->display, c8->display, sizeof(slot->display));
+    atomic_store_explicit(&c->head, head + 1, memory_order_release);
+}
@@ -0,0 +1,25 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+// video capture of the display. at the end of every frame the emulator
+// copies the display into a lock free ring, and a background thread scales
+// and encodes the frames. when the writer falls behind frames are dropped
+// instead of holding up the emulator. the format follows the file name:
+// .y4m is YUV4MPEG2 video, a name ending in .png is a numbered image per
+// frame (frame%05d.png, the frame number is filled in), anything else is
+// raw 8 bit grayscale video. lit pixels are white
+
+#define DEFAULT_CAPTURE_SCALE 4
+
+// start capturing the display of a machine from the next frame end, each
+// pixel as scale by scale pixels
+bool capture_open(struct chip8 *c8, const char *path, uint32_t scale);
+
+// write the frames still queued and stop. with a file, report frames
+// written and dropped and the writer's throughput there
+void capture_close(struct chip8 *c8, FILE *report);
+
+// queue the display at the end of a frame, dropped if the ring is full
+void capture_frame(struct chip8 *c8);
+
+#endif
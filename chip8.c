@@ -3,58 +3,93 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdbool.h>
-#include <SDL2/SDL.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include "chip8.h"
+#include "jit.h"
+#include "backend.h"
+#include "timing.h"
+#include "trace.h"
+#include "disasm.h"
+#include "rewind.h"
+#include "profile.h"
+#include "replay.h"
+#include "capture.h"
+
+// decoder used by execute_cycle, selectable on the command line
+enum dispatch_mode dispatch_mode = DISPATCH_CHAIN;
+
+// fast forward through idle loops, see skip_idle_loop
+bool idle_skip = true;
+
+// passes an idle loop has to have left for a jump into it to stop the batch
+#define IDLE_MIN_PASSES 8
+
+const struct quirks quirk_profiles[QUIRK_PROFILE_COUNT] =
+{
+    [QUIRKS_MODERN] = { .shift_vy = false, .logic_clears_vf = false, .load_store_moves_i = false,
+                        .load_store_off_by_one = false, .jump_vx = false, .wrap_sprites = false },
+    [QUIRKS_VIP] = { .shift_vy = true, .logic_clears_vf = true, .load_store_moves_i = true,
+                     .load_store_off_by_one = false, .jump_vx = false, .wrap_sprites = false },
+    [QUIRKS_CHIP48] = { .shift_vy = false, .logic_clears_vf = false, .load_store_moves_i = true,
+                        .load_store_off_by_one = true, .jump_vx = true, .wrap_sprites = false },
+    [QUIRKS_SCHIP] = { .shift_vy = false, .logic_clears_vf = false, .load_store_moves_i = false,
+                       .load_store_off_by_one = false, .jump_vx = true, .wrap_sprites = false },
+    [QUIRKS_XOCHIP] = { .shift_vy = true, .logic_clears_vf = false, .load_store_moves_i = true,
+                        .load_store_off_by_one = false, .jump_vx = false, .wrap_sprites = true },
+};
+
+static const char *quirk_profile_names[QUIRK_PROFILE_COUNT] =
+{
+    "modern", "vip", "chip48", "schip", "xochip"
+};
 
-// registers 16 1 byte registers
-uint8_t reg_vx[16];
-
-// I register 2 bytes
-uint16_t reg_i;
-
-// delay and sound time registers 1 bytes each
-uint8_t reg_delay;
-uint8_t reg_sound;
-
-// program counter register 2 bytes
-uint16_t reg_pc;
-
-// stack pointer register 1 byte
-uint8_t reg_sp;
-
-// stack 16 2 byte values
-uint16_t stack[16];
-
-// memory 4K bytes
-uint8_t memory[4096];
-
-// display information 64x32 display
-uint8_t display[64][32];
-
-// opcode 2 bytes
-uint16_t current_opcode;
-
-// maps key to enum value (SDL library) by index
-static int sdl_keymapping[16] =
-{
-    SDL_SCANCODE_0,
-    SDL_SCANCODE_1,
-    SDL_SCANCODE_2,
-    SDL_SCANCODE_3,
-    SDL_SCANCODE_4,
-    SDL_SCANCODE_5,
-    SDL_SCANCODE_6,
-    SDL_SCANCODE_7,
-    SDL_SCANCODE_8,
-    SDL_SCANCODE_9,
-    SDL_SCANCODE_A,
-    SDL_SCANCODE_B,
-    SDL_SCANCODE_C,
-    SDL_SCANCODE_D,
-    SDL_SCANCODE_E,
-    SDL_SCANCODE_F
+// the instructions that differ between profiles take the profile as an
+// argument and are always inlined. core.h calls them with a constant, so
+// each profile's copy of the interpreter has its quirks compiled in and
+// tests none of them while running
+#if defined(__GNUC__)
+#define QUIRKS_INLINE static inline __attribute__((always_inline))
+#else
+#define QUIRKS_INLINE static inline
+#endif
+
+QUIRKS_INLINE void or_registers_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q);
+QUIRKS_INLINE void and_registers_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q);
+QUIRKS_INLINE void xor_registers_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q);
+QUIRKS_INLINE void shift_register_right_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q);
+QUIRKS_INLINE void shift_register_left_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q);
+QUIRKS_INLINE void jump_reg_plus_value_as(struct chip8 *c8, uint16_t opcode, enum quirk_profile q);
+QUIRKS_INLINE void display_sprite_as(struct chip8 *c8, uint8_t x, uint8_t y, uint8_t n, enum quirk_profile q);
+QUIRKS_INLINE void copy_reg_to_mem_as(struct chip8 *c8, uint8_t x, enum quirk_profile q);
+QUIRKS_INLINE void load_reg_from_mem_as(struct chip8 *c8, uint8_t x, enum quirk_profile q);
+
+// handler wrapper that calls an instruction handler with decoded operands
+typedef void (*op_handler)(struct chip8 *c8, const struct decoded_op *op);
+
+// jump table indexed by the first nibble, plus sub tables for the groups
+// that need more of the opcode to pick a handler. the tables holding an
+// instruction that differs between profiles have one copy per profile
+static op_handler dispatch_table[QUIRK_PROFILE_COUNT][16];
+static op_handler group_0_table[256];
+static op_handler group_8_table[QUIRK_PROFILE_COUNT][16];
+static op_handler group_e_table[256];
+static op_handler group_f_table[QUIRK_PROFILE_COUNT][256];
+
+// one profile's copy of the interpreter, built from core.h
+struct core
+{
+    void (*fill_tables)();
+    void (*decode_chain)(struct chip8 *c8, uint16_t opcode);
+    void (*decode_and_execute)(struct chip8 *c8, uint16_t opcode);
+    void (*run_decoder)(struct chip8 *c8, uint32_t count);
+    void (*execute_threaded)(struct chip8 *c8, uint32_t count);
+    void (*execute_cached)(struct chip8 *c8, uint32_t count);
 };
 
+static const struct core cores[QUIRK_PROFILE_COUNT];
+
 static uint8_t fontset[80] =
 {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -75,86 +110,136 @@ static uint8_t fontset[80] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-SDL_Window *window;
-SDL_Renderer *renderer;
-
-int main(int argc, char *argv[])
+// allocate a machine in its power on state, with no rom or backend
+struct chip8 *create_emulator()
 {
-    char *path;
-    bool debug;
-    if (argc == 3)
-    {
-        path = argv[1];
-        if (strcmp(argv[2], "true") == 0)
-        {
-            debug = true;
-        }
-    }
-    else
-    {
-        printf("usage: ./chip8 [full path to rom] [debug]\n");
-        return EXIT_FAILURE;
-    }
+    init_dispatch_tables();
 
-    init_emulator(path, debug);
-    for (;;)
+    struct chip8 *c8 = malloc(sizeof(struct chip8));
+    if (c8 == NULL)
     {
-        execute_cycle(debug);
-
-        // If the escape key is pressed stop the emulation loop
-        const uint8_t *keys = SDL_GetKeyboardState(NULL);
-        SDL_PumpEvents();
-        if (keys[SDL_SCANCODE_ESCAPE] != 0)
-        {
-            break;
-        }
-
-        usleep(1600);
+        return NULL;
     }
-
-    cleanup();
-    return 0;
+    memset(c8, 0, sizeof(struct chip8));
+    c8->cycles_per_second = DEFAULT_CYCLES_PER_SECOND;
+    c8->input_deadline = UINT64_MAX;
+    reset_emulator(c8);
+    return c8;
 }
 
-void cleanup()
+void destroy_emulator(struct chip8 *c8)
 {
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    record_close(c8);
+    profile_close(c8);
+    rewind_close(c8);
+    trace_close(c8);
+    capture_close(c8, NULL);
+    jit_cleanup(c8);
+    free(c8);
 }
 
 // Sets all registers to their initial values
-void init_emulator(char * path_to_rom, bool debug)
+void reset_emulator(struct chip8 *c8)
 {
+    memset(c8->reg_vx, 0, sizeof(c8->reg_vx));
+    memset(c8->stack, 0, sizeof(c8->stack));
+    memset(c8->memory, 0, sizeof(c8->memory));
+    memset(c8->display, 0, sizeof(c8->display));
+    c8->rom_size = 0;
+    c8->reg_i = 0;
+    c8->reg_delay = 0;
+    c8->reg_sound = 0;
+    c8->reg_sp = 0;
+    c8->current_opcode = 0;
+    c8->instruction_count = 0;
+    c8->halted = false;
+    c8->faulted = false;
+    c8->fault_pc = 0;
+    c8->fault_opcode = 0;
+    c8->keys = 0;
+    c8->waiting_key = false;
+    c8->frame_count = 0;
+    c8->frame_cycles_left = frame_cycles(c8, 0);
+    seed_random(c8, c8->random_seed);
+
+    // the cleared display has not been shown yet
+    c8->display_dirty = true;
+    c8->presented_hash = 0;
+    c8->present_count = 0;
+    c8->idle_skipped = 0;
+    c8->idle_miss_frame = UINT64_MAX;
+
     // the program starts at 0x200
-    reg_pc = 0x200;
+    c8->reg_pc = 0x200;
 
     // load fontset into memory
     for (int i = 0; i < 80; i++)
     {
-        memory[i] = fontset[i];
+        c8->memory[i] = fontset[i];
     }
+    invalidate_decode_cache(c8, 0, sizeof(c8->memory));
+    jit_invalidate(c8, 0, sizeof(c8->memory));
+}
 
-    // load rom into memory
-    printf("loading %s\n", path_to_rom);
+// load rom into memory at 0x200
+bool load_rom(struct chip8 *c8, const char *path_to_rom)
+{
     FILE *file = fopen(path_to_rom, "rb");
-    if (file != NULL)
+    if (file == NULL)
     {
-        fread(memory + 0x200, 1, sizeof(memory) - 0x200, file);
+        return false;
     }
-    else
+    uint8_t data[sizeof(c8->memory) - 0x200];
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    return load_rom_data(c8, data, size);
+}
+
+// copy a rom that is already in host memory to 0x200
+bool load_rom_data(struct chip8 *c8, const uint8_t *data, size_t size)
+{
+    if (size > sizeof(c8->memory) - 0x200)
+    {
+        return false;
+    }
+    memcpy(c8->memory + 0x200, data, size);
+    c8->rom_size = size;
+    invalidate_decode_cache(c8, 0x200, size);
+    jit_invalidate(c8, 0x200, size);
+    return true;
+}
+
+void cleanup(struct chip8 *c8)
+{
+    rewind_close(c8);
+    trace_close(c8);
+    capture_close(c8, NULL);
+    jit_cleanup(c8);
+    c8->backend->cleanup(c8);
+}
+
+// reset the machine, load the rom and start the backend set on the machine
+void init_emulator(struct chip8 *c8, char * path_to_rom, bool debug)
+{
+    reset_emulator(c8);
+
+    printf("loading %s\n", path_to_rom);
+    if (!load_rom(c8, path_to_rom))
     {
         perror("unable to open rom!\n");
         exit(EXIT_FAILURE);
     }
 
-    // set up SDL for display output
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+    if (dispatch_mode == DISPATCH_JIT && !jit_init(c8))
+    {
+        printf("jit not available, using the predecoded interpreter\n");
+    }
+
+    // set up the host display and input
+    if (!c8->backend->init(c8))
     {
-        perror(SDL_GetError());
         exit(EXIT_FAILURE);
     }
-    SDL_CreateWindowAndRenderer(640, 320, 0, &window, &renderer);
 
     // disassemble the rom in memory if debug flag is true
     if (debug)
@@ -166,746 +251,1185 @@ void init_emulator(char * path_to_rom, bool debug)
         }
         else
         {
-            for (int i = 0x200; i < 4094; i+=2)
+            struct disassembly d;
+            disasm_init(&d);
+            if (disassemble_program(&d, c8->memory, c8->rom_size))
+            {
+                fwrite(d.text, 1, d.length, f);
+            }
+            else
             {
-                uint16_t opcode = memory[i] << 8 | memory[i + 1];
-                fprintf(f, "%4X | %4X | ", i, opcode);
-                disassemble(opcode, f);
+                printf("unable to disassemble the rom, out of memory\n");
             }
+            disasm_free(&d);
             fclose(f);
         }
+
+        // trace every instruction executed from here on
+        if (!trace_open(c8, trace_path, trace_last))
+        {
+            exit(EXIT_FAILURE);
+        }
     }
 }
 
-void disassemble(uint16_t op, FILE *f)
+// change the emulated instruction rate, the current frame keeps the
+// instructions it has already run
+void set_cycles_per_second(struct chip8 *c8, uint32_t cycles_per_second)
 {
-    uint8_t nibbles[4];
-    nibbles[0] = (op >> 12) & 0xf;
-    nibbles[1] = (op >> 8) & 0xf;
-    nibbles[2] = (op >> 4) & 0xf;
-    nibbles[3] = op & 0xf;
+    uint32_t done = frame_cycles(c8, c8->frame_count) - c8->frame_cycles_left;
+    c8->cycles_per_second = cycles_per_second;
 
-    if (op == 0x00e0)
-    {
-        fprintf(f, "CLS\n");
-    }
-    else if (op == 0x00ee)
-    {
-        fprintf(f, "RET\n");
-    }
-    else if (nibbles[0] == 0x1)
-    {
-        fprintf(f, "JP %X\n", op & 0xfff);
-    }
-    else if (nibbles[0] == 0x2)
-    {
-        fprintf(f, "CALL %X\n", op & 0xfff);
-    }
-    else if (nibbles[0] == 0x3)
-    {
-        fprintf(f, "SE V%X, %X\n", nibbles[1], op & 0xff);
-    }
-    else if (nibbles[0] == 0x4)
-    {
-        fprintf(f, "SNE V%X, %X\n", nibbles[1], op & 0xff);
-    }
-    else if (nibbles[0] == 0x5 && nibbles[3] == 0x0)
-    {
-        fprintf(f, "SE V%X, V%X\n", nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x6)
-    {
-        fprintf(f, "LD V%X, %X\n", nibbles[1], op & 0xff);
-    }
-    else if (nibbles[0] == 0x7)
-    {
-        fprintf(f, "ADD V%X, %X\n", nibbles[1], op & 0xff);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x0)
+    uint32_t length = frame_cycles(c8, c8->frame_count);
+    c8->frame_cycles_left = done < length ? length - done : 1;
+}
+
+// start the random number generator from a seed, the same seed gives the
+// same sequence of Cxkk results. the seed also applies to later resets
+void seed_random(struct chip8 *c8, uint64_t seed)
+{
+    // one splitmix64 step spreads nearby seeds apart. xorshift gets stuck
+    // on a zero state so that one is swapped for another
+    uint64_t z = seed + 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z ^= z >> 31;
+    c8->random_seed = seed;
+    c8->random_state = z != 0 ? z : 0x9e3779b97f4a7c15;
+}
+
+// run the machine's program as the given variant from now on, e.g. after
+// loading a rom written for it
+void set_quirk_profile(struct chip8 *c8, enum quirk_profile quirks)
+{
+    // decoded and translated instructions belong to the old profile
+    c8->quirks = quirks;
+    invalidate_decode_cache(c8, 0, sizeof(c8->memory));
+    jit_invalidate(c8, 0, sizeof(c8->memory));
+}
+
+bool parse_quirk_profile(const char *name, enum quirk_profile *quirks)
+{
+    for (int i = 0; i < QUIRK_PROFILE_COUNT; i++)
     {
-        fprintf(f, "LD V%X, V%X\n", nibbles[1], nibbles[2]);
+        if (strcmp(name, quirk_profile_names[i]) == 0)
+        {
+            *quirks = i;
+            return true;
+        }
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x1)
-    {
-        fprintf(f, "OR V%X, V%X\n", nibbles[1], nibbles[2]);
+    return false;
+}
+
+const char *quirk_profile_name(enum quirk_profile quirks)
+{
+    return quirks < QUIRK_PROFILE_COUNT ? quirk_profile_names[quirks] : "unknown";
+}
+
+// next byte from the machine's xorshift64* generator, the top byte of the
+// scrambled output is the best distributed
+static inline uint8_t random_byte(struct chip8 *c8)
+{
+    uint64_t x = c8->random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    c8->random_state = x;
+    return (x * 0x2545f4914f6cdd1d) >> 56;
+}
+
+// number of instructions in the given frame. rates that are not a multiple
+// of 60 are spread over the frames so every second runs exactly
+// cycles_per_second instructions
+uint32_t frame_cycles(const struct chip8 *c8, uint64_t frame)
+{
+    return (frame + 1) * c8->cycles_per_second / FRAMES_PER_SECOND -
+           frame * c8->cycles_per_second / FRAMES_PER_SECOND;
+}
+
+// run until the program halts, the backend asks to stop or cycle_limit
+// instructions have executed (0 runs forever). with a clock each frame of
+// instructions is held to its 60 Hz slot of wall time, without one the
+// emulator runs as fast as it can
+void run_emulator(struct chip8 *c8, uint64_t cycle_limit, struct frame_clock *clock, bool debug)
+{
+    while (!c8->halted)
+    {
+        // run to the end of the current frame, and when unpaced on through
+        // whole frames for backends that poll less often. rewind records
+        // every frame, so with it open batches stop at each frame end
+        uint32_t frames = clock != NULL || c8->rewind != NULL ? 1 : c8->backend->frames_per_poll;
+        uint64_t batch = c8->frame_cycles_left +
+                         (uint64_t)(frames - 1) * c8->cycles_per_second / FRAMES_PER_SECOND;
+        if (cycle_limit != 0)
+        {
+            if (c8->instruction_count >= cycle_limit)
+            {
+                break;
+            }
+            if (cycle_limit - c8->instruction_count < batch)
+            {
+                batch = cycle_limit - c8->instruction_count;
+            }
+        }
+
+        // the keys hold still for the whole batch, so end it where the
+        // backend has a key change due
+        c8->backend->poll_input(c8);
+        if (c8->recorder != NULL)
+        {
+            record_input(c8);
+        }
+        if (c8->halted)
+        {
+            break;
+        }
+        if (c8->input_deadline > c8->instruction_count &&
+            c8->input_deadline - c8->instruction_count < batch)
+        {
+            batch = c8->input_deadline - c8->instruction_count;
+        }
+
+        if (c8->rewinding && c8->rewind != NULL)
+        {
+            // one recorded frame back per frame of wall time
+            rewind_step_back(c8);
+        }
+        else
+        {
+            uint64_t start = c8->instruction_count;
+            uint64_t frame = c8->frame_count;
+            execute_cycles(c8, batch, debug);
+            if (c8->waiting_key)
+            {
+                // nothing runs until a key is held, the rest of the frame
+                // goes by with Fx0A spinning in place. it runs again at the
+                // start of the next one
+                uint64_t idle = batch - (c8->instruction_count - start);
+                if (c8->frame_cycles_left < idle)
+                {
+                    idle = c8->frame_cycles_left;
+                }
+                finish_cycles(c8, idle);
+            }
+            if (c8->rewind != NULL && c8->frame_count != frame)
+            {
+                // a batch cut short by a key change or the cycle limit ends
+                // mid frame, the frame is recorded when the next one ends it
+                rewind_capture(c8);
+            }
+        }
+        present_display(c8);
+        PROFILE_POLL(c8);
+
+        if (c8->backend->quit_requested(c8))
+        {
+            break;
+        }
+
+        if (clock != NULL)
+        {
+            frame_clock_wait(clock);
+        }
+        else if (c8->waiting_key)
+        {
+            // unpaced there is no frame to wait for, so sleep until the
+            // backend has input
+            c8->backend->wait_input(c8);
+        }
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x2)
+}
+
+void draw_display(struct chip8 *c8)
+{
+    PROFILE_PRESENT(c8, c8->backend->draw_display(c8));
+    c8->present_count++;
+}
+
+// present the display if it was drawn to since the last present. a frame
+// that ends up looking like the last one presented, e.g. a sprite drawn and
+// then erased again, is not presented
+void present_display(struct chip8 *c8)
+{
+    if (!c8->display_dirty)
     {
-        fprintf(f, "AND V%X, V%X\n", nibbles[1], nibbles[2]);
+        return;
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x3)
+    c8->display_dirty = false;
+
+    uint64_t hash = display_hash(c8);
+    if (hash == c8->presented_hash && c8->present_count > 0)
     {
-        fprintf(f, "XOR V%X, V%X\n", nibbles[1], nibbles[2]);
+        return;
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x4)
+    c8->presented_hash = hash;
+    draw_display(c8);
+}
+
+// hash of the display, cheap enough to compare frames with
+uint64_t display_hash(const struct chip8 *c8)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 32; i++)
     {
-        fprintf(f, "ADD V%X, V%X\n", nibbles[1], nibbles[2]);
+        hash = (hash ^ c8->display[i]) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x5)
+    return hash;
+}
+
+// execute a single cycle: fetch, decode, and execute
+void execute_cycle(struct chip8 *c8, bool debug)
+{
+    if (dispatch_mode == DISPATCH_THREADED)
     {
-        fprintf(f, "SUB V%X, V%X\n", nibbles[1], nibbles[2]);
+        execute_threaded(c8, 1);
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x6)
+    else if (dispatch_mode == DISPATCH_CACHED)
     {
-        fprintf(f, "SHR V%X {, V%X}\n", nibbles[1], nibbles[2]);
+        execute_cached(c8, 1);
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x7)
+    else if (dispatch_mode == DISPATCH_JIT)
     {
-        fprintf(f, "SUBN V%X, V%X\n", nibbles[1], nibbles[2]);
+        execute_jit(c8, 1);
     }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0xe)
+    else
     {
-        fprintf(f, "SHL V%X {, V%X}\n", nibbles[1], nibbles[2]);
+        cores[c8->quirks].run_decoder(c8, 1);
     }
-    else if (nibbles[0] == 0x9 && nibbles[3] == 0x0)
+    if (debug)
     {
-        fprintf(f, "SNE V%X, V%X\n", nibbles[1], nibbles[2]);
+        trace_step(c8);
     }
-    else if (nibbles[0] == 0xa)
+}
+
+// execute a batch of cycles, letting the threaded interpreter run the whole
+// batch without returning when debug output is not needed
+static void run_cycles(struct chip8 *c8, uint32_t count, bool debug)
+{
+    if (dispatch_mode == DISPATCH_THREADED && !debug)
     {
-        fprintf(f, "LD I, %X\n", op & 0xfff);
+        execute_threaded(c8, count);
+        return;
     }
-    else if (nibbles[0] == 0xb)
+    if (dispatch_mode == DISPATCH_CACHED && !debug)
     {
-        fprintf(f, "JP V0, %X\n", op & 0xfff);
+        execute_cached(c8, count);
+        return;
     }
-    else if (nibbles[0] == 0xc)
+    if (dispatch_mode == DISPATCH_JIT && !debug)
     {
-        fprintf(f, "RND V%X, %X\n", nibbles[1], op & 0xff);
+        execute_jit(c8, count);
+        return;
     }
-    else if (nibbles[0] == 0xd)
+    if (!debug)
     {
-        fprintf(f, "DRW V%X, V%X, %X\n", nibbles[1], nibbles[2], nibbles[3]);
+        cores[c8->quirks].run_decoder(c8, count);
+        return;
     }
-    else if (nibbles[0] == 0xe && nibbles[2] == 0x9 && nibbles[3] == 0xe)
+    c8->stop_batch = false;
+    for (uint32_t i = 0; i < count && !c8->stop_batch; i++)
     {
-        fprintf(f, "SKP V%X\n", nibbles[1]);
+        execute_cycle(c8, debug);
     }
-    else if (nibbles[0] == 0xe && nibbles[2] == 0xa && nibbles[3] == 0x1)
+}
+
+static uint16_t opcode_at(const struct chip8 *c8, uint16_t pc)
+{
+    return c8->memory[pc & 0xfff] << 8 | c8->memory[(pc + 1) & 0xfff];
+}
+
+// length in instructions of the idle loop starting at head, 0 if there is
+// none. an idle loop changes nothing but its own registers, the same way
+// every time round, until something outside it changes:
+//   1nnn to itself                    spins forever
+//   Ex9E or ExA1, 1nnn to the skip    waits for a key to change
+//   Fx07, 3xkk or 4xkk, 1nnn to Fx07  waits for the delay timer
+static int idle_loop_length(const struct chip8 *c8, uint16_t head)
+{
+    uint16_t jump = 0x1000 | head;
+    uint16_t first = opcode_at(c8, head);
+    if (first == jump)
     {
-        fprintf(f, "SKNP V%X\n", nibbles[1]);
+        return 1;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x0 && nibbles[3] == 0x7)
+    if ((first & 0xf0ff) == 0xe09e || (first & 0xf0ff) == 0xe0a1)
     {
-        fprintf(f, "LD V%X, DT\n", nibbles[1]);
+        return opcode_at(c8, head + 2) == jump ? 2 : 0;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x0 && nibbles[3] == 0xa)
+    if ((first & 0xf0ff) == 0xf007)
     {
-        fprintf(f, "LD V%X, K\n", nibbles[1]);
+        uint16_t skip = opcode_at(c8, head + 2);
+        bool same_register = ((skip >> 8) & 0xf) == ((first >> 8) & 0xf);
+        bool skip_on_value = (skip & 0xf000) == 0x3000 || (skip & 0xf000) == 0x4000;
+        return same_register && skip_on_value && opcode_at(c8, head + 4) == jump ? 3 : 0;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0x5)
+    return 0;
+}
+
+// frame ends until the delay timer loop at pc reads a value that lets it
+// leave, 0 if it leaves on this pass and -1 if it never does. the timer
+// stops at 0
+static int idle_ticks(const struct chip8 *c8)
+{
+    uint16_t skip = opcode_at(c8, c8->reg_pc + 2);
+    uint8_t kk = skip & 0xff;
+    bool skip_if_equal = (skip & 0xf000) == 0x3000;
+    for (int i = 0; i <= c8->reg_delay; i++)
     {
-        fprintf(f, "LD DT, V%X\n", nibbles[1]);
+        uint8_t value = c8->reg_delay - i;
+        if ((value == kk) == skip_if_equal)
+        {
+            return i;
+        }
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0x8)
+    return -1;
+}
+
+// number of times round the idle loop at pc before it can leave, reading
+// the machine as it is now, capped at limit
+static uint64_t idle_iterations(const struct chip8 *c8, int length, uint64_t limit)
+{
+    uint16_t first = opcode_at(c8, c8->reg_pc);
+    if (length == 1)
     {
-        fprintf(f, "LD ST, V%X\n", nibbles[1]);
+        return limit;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0xe)
+    if (length == 2)
     {
-        fprintf(f, "ADD I, V%X\n", nibbles[1]);
+        // the keys hold still for the whole batch
+        bool held = (c8->keys >> (c8->reg_vx[(first >> 8) & 0xf] & 0xf)) & 1;
+        bool leaves = (first & 0xff) == 0x9e ? held : !held;
+        return leaves ? 0 : limit;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x2 && nibbles[3] == 0x9)
+
+    int ticks = idle_ticks(c8);
+    if (ticks <= 0)
     {
-        fprintf(f, "LD F, V%X\n", nibbles[1]);
+        return ticks == 0 ? 0 : limit;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x3 && nibbles[3] == 0x3)
+
+    // every pass that starts before that tick reads a value that keeps it
+    // looping. the tick comes at the end of frame frame_count + ticks - 1
+    uint64_t rate = c8->cycles_per_second;
+    uint64_t until = c8->frame_cycles_left + (c8->frame_count + ticks) * rate / FRAMES_PER_SECOND -
+                     (c8->frame_count + 1) * rate / FRAMES_PER_SECOND;
+    uint64_t passes = (until + length - 1) / length;
+    return passes < limit ? passes : limit;
+}
+
+// true if pc is at the top of an idle loop that goes round enough times for
+// stopping the decoder to fast forward it to pay off. a wait that is over
+// within the frame costs less to run than to skip. this runs on every jump
+// to a loop, so the delay timer wait is estimated without dividing
+bool at_idle_loop(const struct chip8 *c8)
+{
+    int length = idle_loop_length(c8, c8->reg_pc);
+    if (length != 3)
     {
-        fprintf(f, "LD B, V%X\n", nibbles[1]);
+        return length != 0 && idle_iterations(c8, length, 1) != 0;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x5 && nibbles[3] == 0x5)
+    int ticks = idle_ticks(c8);
+    if (ticks <= 0)
     {
-        fprintf(f, "LD [I], V%X\n", nibbles[1]);
+        return ticks < 0;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x6 && nibbles[3] == 0x5)
+    uint32_t until = c8->frame_cycles_left + (ticks - 1) * (c8->cycles_per_second / FRAMES_PER_SECOND);
+    return until >= IDLE_MIN_PASSES * 3;
+}
+
+// when pc is at the top of an idle loop, skip the passes round it that
+// would change nothing, up to budget instructions. returns the number of
+// instructions skipped
+static uint32_t skip_idle_loop(struct chip8 *c8, uint32_t budget)
+{
+    int length = idle_loop_length(c8, c8->reg_pc);
+    if (length == 0)
     {
-        fprintf(f, "LD V%X, [I]\n", nibbles[1]);
+        return 0;
     }
-    else
+
+    // the last pass runs for real, so the registers it writes and the
+    // current opcode end up as if every pass had
+    uint64_t passes = idle_iterations(c8, length, budget / length);
+    if (passes < 2)
     {
-        fprintf(f, "Unknown\n");
+        return 0;
     }
+    uint32_t skipped = (passes - 1) * length;
+    finish_cycles(c8, skipped);
+    c8->idle_skipped += skipped;
+    return skipped;
 }
 
-void draw_display()
+void execute_cycles(struct chip8 *c8, uint32_t count, bool debug)
 {
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    for (int i = 0; i < 640; i++)
+    // a machine waiting for a key runs Fx0A again, which either takes a key
+    // that is now held or ends the batch waiting
+    c8->waiting_key = false;
+
+    // a jump to the top of an idle loop stops the decoder, and the loop is
+    // fast forwarded to where it can leave. debug traces and the profiler
+    // see every instruction, so nothing is skipped for them
+    c8->skip_idle = idle_skip && !debug && c8->profile == NULL;
+    while (count > 0 && !c8->waiting_key && !c8->halted)
     {
-        for (int j = 0; j < 320; j++)
+        if (c8->skip_idle)
         {
-            if (display[i/10][j/10] == 0x1)
-            {
-                SDL_RenderDrawPoint(renderer, i, j);
-            }
+            count -= skip_idle_loop(c8, count);
         }
+        uint64_t start = c8->instruction_count;
+        run_cycles(c8, count, debug);
+        count -= c8->instruction_count - start;
     }
-
-    SDL_RenderPresent(renderer);
 }
 
-// execute a single cycle: fetch, decode, and execute
-void execute_cycle(bool debug)
+// end the current 60 Hz frame, the timers count down once per frame
+static void next_frame(struct chip8 *c8)
 {
-    // fetch opcode (left shift the first byte and or it with the second byte)
-    current_opcode =  memory[reg_pc] << 8 | memory[reg_pc + 1];
-    decode_and_execute(current_opcode);
-    if (reg_delay > 0)
+    if (c8->capture != NULL)
     {
-        reg_delay--;
+        capture_frame(c8);
     }
-    if (reg_sound > 0)
+    if (c8->reg_delay > 0)
     {
-        reg_sound--;
+        c8->reg_delay--;
     }
-    if (debug)
+    if (c8->reg_sound > 0)
     {
-        write_debug();
+        c8->reg_sound--;
     }
+    c8->frame_count++;
+    c8->frame_cycles_left = frame_cycles(c8, c8->frame_count);
 }
 
-void write_debug()
+// per instruction bookkeeping, run after every executed instruction
+void finish_cycle(struct chip8 *c8)
 {
-    FILE *f = fopen("debug.txt", "a");
-    if (f == NULL)
+    c8->instruction_count++;
+    if (--c8->frame_cycles_left == 0)
     {
-        printf("error opening file debug.txt!\n");
+        next_frame(c8);
     }
-    else
-    {
-        // print disassembled instruction
-        disassemble(current_opcode, f);
-
-        // print pc and opcode
-        fprintf(f, "pc=%X opcode=%X\n", reg_pc, current_opcode);
-
-        // print Vx registers
-        for (int i = 0; i < 16; i++)
-        {
-            fprintf(f, "V%X=%X ", i, reg_vx[i]);
-        }
-        fprintf(f, "\n");
-
-        // print index, stack pointer, delay, sound timer
-        fprintf(f, "I=%X sp=%X delay=%X sound=%X\n", reg_i, reg_sp, reg_delay, reg_sound);
-
-        // print the stack
-        for (int i = 0; i < 16; i++)
-        {
-            fprintf(f, "S%X=%X ", i, stack[i]);
-        }
-        fprintf(f, "\n");
-
-        if (current_opcode >> 12 == 0xd)
-        {
-            for (int i = 0; i < 32; i++)
-            {
-                for (int j = 0; j < 64; j++)
-                {
-                    fprintf(f, "%X ", display[i][j]);
-                }
-                fprintf(f, "\n");
-            }
-        }
-        fprintf(f, "\n");
+}
 
-        fclose(f);
+// bookkeeping for count instructions run in one go, none of which read the
+// timers
+void finish_cycles(struct chip8 *c8, uint32_t count)
+{
+    c8->instruction_count += count;
+    while (count >= c8->frame_cycles_left)
+    {
+        count -= c8->frame_cycles_left;
+        next_frame(c8);
     }
+    c8->frame_cycles_left -= count;
 }
 
-void decode_and_execute(uint16_t opcode)
+// decode and run one instruction as the machine's profile
+void decode_and_execute(struct chip8 *c8, uint16_t opcode)
 {
-    // get each nibble of the opcode to decode
-    uint8_t nibbles[4];
-    nibbles[0] = (opcode >> 12) & 0xf;
-    nibbles[1] = (opcode >> 8) & 0xf;
-    nibbles[2] = (opcode >> 4) & 0xf;
-    nibbles[3] = opcode & 0xf;
+    cores[c8->quirks].decode_and_execute(c8, opcode);
+}
 
-    if (opcode == 0x00e0)
-    {
-        clear_display();
-    }
-    else if (opcode == 0x00ee)
-    {
-        return_instruction();
-    }
-    else if (nibbles[0] == 0x1)
-    {
-        jump_instruction(opcode);
-    }
-    else if (nibbles[0] == 0x2)
-    {
-        call_instruction(opcode);
-    }
-    else if (nibbles[0] == 0x3)
-    {
-        skip_if_reg_equals_value(nibbles[1], opcode);
-    }
-    else if (nibbles[0] == 0x4)
-    {
-        skip_if_reg_not_equals_value(nibbles[1], opcode);
-    }
-    else if (nibbles[0] == 0x5 && nibbles[3] == 0x0)
-    {
-        skip_if_reg_equal(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x6)
-    {
-        load_value(nibbles[1], opcode);
-    }
-    else if (nibbles[0] == 0x7)
-    {
-        add_value(nibbles[1], opcode);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x0)
-    {
-        load_from_register(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x1)
-    {
-        or_registers(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x2)
-    {
-        and_registers(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x3)
-    {
-        xor_registers(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x4)
-    {
-        add_registers(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x5)
-    {
-        sub_registers(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x6)
-    {
-        shift_register_right(nibbles[1]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0x7)
-    {
-        subn_registers(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0x8 && nibbles[3] == 0xe)
-    {
-        shift_register_left(nibbles[1]);
-    }
-    else if (nibbles[0] == 0x9 && nibbles[3] == 0x0)
-    {
-        skip_if_reg_not_equal(nibbles[1], nibbles[2]);
-    }
-    else if (nibbles[0] == 0xa)
-    {
-        load_i_value(opcode);
-    }
-    else if (nibbles[0] == 0xb)
+void decode_chain(struct chip8 *c8, uint16_t opcode)
+{
+    cores[c8->quirks].decode_chain(c8, opcode);
+}
+
+bool parse_dispatch_mode(const char *name, enum dispatch_mode *mode)
+{
+    if (strcmp(name, "chain") == 0)
     {
-        jump_reg_plus_value(opcode);
+        *mode = DISPATCH_CHAIN;
     }
-    else if (nibbles[0] == 0xc)
+    else if (strcmp(name, "table") == 0)
     {
-        set_reg_random_byte(nibbles[1], opcode);
+        *mode = DISPATCH_TABLE;
     }
-    else if (nibbles[0] == 0xd)
+    else if (strcmp(name, "threaded") == 0)
     {
-        display_sprite(nibbles[1], nibbles[2], nibbles[3]);
+        *mode = DISPATCH_THREADED;
     }
-    else if (nibbles[0] == 0xe && nibbles[2] == 0x9 && nibbles[3] == 0xe)
+    else if (strcmp(name, "cached") == 0)
     {
-        skip_if_key_pressed(nibbles[1]);
+        *mode = DISPATCH_CACHED;
     }
-    else if (nibbles[0] == 0xe && nibbles[2] == 0xa && nibbles[3] == 0x1)
+    else if (strcmp(name, "jit") == 0)
     {
-        skip_if_key_not_pressed(nibbles[1]);
+        *mode = DISPATCH_JIT;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x0 && nibbles[3] == 0x7)
+    else
     {
-        delay_timer_to_reg(nibbles[1]);
+        return false;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x0 && nibbles[3] == 0xa)
+    return true;
+}
+
+// an opcode no variant defines halts the machine with pc left on it. the
+// instruction is not counted, the finish_cycle after it is taken back
+// beforehand
+static void halt_unknown_opcode(struct chip8 *c8, uint16_t opcode)
+{
+    c8->halted = true;
+    c8->stop_batch = true;
+    c8->faulted = true;
+    c8->fault_pc = c8->reg_pc;
+    c8->fault_opcode = opcode;
+    c8->instruction_count--;
+    c8->frame_cycles_left++;
+}
+
+static void op_unknown(struct chip8 *c8, const struct decoded_op *op)
+{
+    halt_unknown_opcode(c8, op->opcode);
+}
+
+// group handlers pick a sub table entry, the 0 and E groups also need the
+// second nibble to be zero or the opcode is not valid
+static void op_group_0(struct chip8 *c8, const struct decoded_op *op)
+{
+    if (op->x != 0)
     {
-        store_key_press(nibbles[1]);
+        op_unknown(c8, op);
+        return;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0x5)
+    group_0_table[op->kk](c8, op);
+}
+
+static void op_group_e(struct chip8 *c8, const struct decoded_op *op)
+{
+    group_e_table[op->kk](c8, op);
+}
+
+
+// wrappers that unpack the operands and call the instruction handlers, the
+// ones for instructions that differ between profiles are in core.h
+static void op_00e0(struct chip8 *c8, const struct decoded_op *op) { clear_display(c8); }
+static void op_00ee(struct chip8 *c8, const struct decoded_op *op) { return_instruction(c8); }
+static void op_1nnn(struct chip8 *c8, const struct decoded_op *op) { jump_instruction(c8, op->opcode); }
+static void op_2nnn(struct chip8 *c8, const struct decoded_op *op) { call_instruction(c8, op->opcode); }
+static void op_3xkk(struct chip8 *c8, const struct decoded_op *op) { skip_if_reg_equals_value(c8, op->x, op->opcode); }
+static void op_4xkk(struct chip8 *c8, const struct decoded_op *op) { skip_if_reg_not_equals_value(c8, op->x, op->opcode); }
+static void op_6xkk(struct chip8 *c8, const struct decoded_op *op) { load_value(c8, op->x, op->opcode); }
+static void op_7xkk(struct chip8 *c8, const struct decoded_op *op) { add_value(c8, op->x, op->opcode); }
+static void op_8xy0(struct chip8 *c8, const struct decoded_op *op) { load_from_register(c8, op->x, op->y); }
+static void op_8xy4(struct chip8 *c8, const struct decoded_op *op) { add_registers(c8, op->x, op->y); }
+static void op_8xy5(struct chip8 *c8, const struct decoded_op *op) { sub_registers(c8, op->x, op->y); }
+static void op_8xy7(struct chip8 *c8, const struct decoded_op *op) { subn_registers(c8, op->x, op->y); }
+static void op_annn(struct chip8 *c8, const struct decoded_op *op) { load_i_value(c8, op->opcode); }
+static void op_cxkk(struct chip8 *c8, const struct decoded_op *op) { set_reg_random_byte(c8, op->x, op->opcode); }
+static void op_ex9e(struct chip8 *c8, const struct decoded_op *op) { skip_if_key_pressed(c8, op->x); }
+static void op_exa1(struct chip8 *c8, const struct decoded_op *op) { skip_if_key_not_pressed(c8, op->x); }
+static void op_fx07(struct chip8 *c8, const struct decoded_op *op) { delay_timer_to_reg(c8, op->x); }
+static void op_fx0a(struct chip8 *c8, const struct decoded_op *op) { store_key_press(c8, op->x); }
+static void op_fx15(struct chip8 *c8, const struct decoded_op *op) { set_delay_timer(c8, op->x); }
+static void op_fx18(struct chip8 *c8, const struct decoded_op *op) { set_sound_timer(c8, op->x); }
+static void op_fx1e(struct chip8 *c8, const struct decoded_op *op) { add_reg_to_i(c8, op->x); }
+static void op_fx29(struct chip8 *c8, const struct decoded_op *op) { set_i_sprite_location(c8, op->x); }
+static void op_fx33(struct chip8 *c8, const struct decoded_op *op) { store_bcd(c8, op->x); }
+
+static void op_5xy0(struct chip8 *c8, const struct decoded_op *op)
+{
+    if (op->n != 0)
     {
-        set_delay_timer(nibbles[1]);
+        op_unknown(c8, op);
+        return;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0x8)
+    skip_if_reg_equal(c8, op->x, op->y);
+}
+
+static void op_9xy0(struct chip8 *c8, const struct decoded_op *op)
+{
+    if (op->n != 0)
     {
-        set_sound_timer(nibbles[1]);
+        op_unknown(c8, op);
+        return;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0xe)
+    skip_if_reg_not_equal(c8, op->x, op->y);
+}
+
+#define CORE_PROFILE QUIRKS_MODERN
+#define CORE(name) name##_modern
+#include "core.h"
+#undef CORE
+#undef CORE_PROFILE
+
+#define CORE_PROFILE QUIRKS_VIP
+#define CORE(name) name##_vip
+#include "core.h"
+#undef CORE
+#undef CORE_PROFILE
+
+#define CORE_PROFILE QUIRKS_CHIP48
+#define CORE(name) name##_chip48
+#include "core.h"
+#undef CORE
+#undef CORE_PROFILE
+
+#define CORE_PROFILE QUIRKS_SCHIP
+#define CORE(name) name##_schip
+#include "core.h"
+#undef CORE
+#undef CORE_PROFILE
+
+#define CORE_PROFILE QUIRKS_XOCHIP
+#define CORE(name) name##_xochip
+#include "core.h"
+#undef CORE
+#undef CORE_PROFILE
+
+#define CORE_FUNCTIONS(name) \
+    { \
+        fill_tables_##name, decode_chain_##name, decode_and_execute_##name, \
+        run_decoder_##name, execute_threaded_##name, execute_cached_##name \
+    }
+
+static const struct core cores[QUIRK_PROFILE_COUNT] =
+{
+    [QUIRKS_MODERN] = CORE_FUNCTIONS(modern),
+    [QUIRKS_VIP] = CORE_FUNCTIONS(vip),
+    [QUIRKS_CHIP48] = CORE_FUNCTIONS(chip48),
+    [QUIRKS_SCHIP] = CORE_FUNCTIONS(schip),
+    [QUIRKS_XOCHIP] = CORE_FUNCTIONS(xochip),
+};
+
+#undef CORE_FUNCTIONS
+
+static void fill_dispatch_tables()
+{
+    for (int i = 0; i < 256; i++)
     {
-        add_reg_to_i(nibbles[1]);
+        group_0_table[i] = op_unknown;
+        group_e_table[i] = op_unknown;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x2 && nibbles[3] == 0x9)
+    group_0_table[0xe0] = op_00e0;
+    group_0_table[0xee] = op_00ee;
+    group_e_table[0x9e] = op_ex9e;
+    group_e_table[0xa1] = op_exa1;
+
+    for (int i = 0; i < QUIRK_PROFILE_COUNT; i++)
     {
-        set_i_sprite_location(nibbles[1]);
+        cores[i].fill_tables();
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x3 && nibbles[3] == 0x3)
-    {
-        store_bcd(nibbles[1]);
+}
+
+// the tables are shared by every machine, fill them once no matter how many
+// threads create machines
+void init_dispatch_tables()
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, fill_dispatch_tables);
+}
+
+// the threaded interpreter and the predecoded cache run a batch in the copy
+// built for the machine's profile
+void execute_threaded(struct chip8 *c8, uint32_t count)
+{
+    cores[c8->quirks].execute_threaded(c8, count);
+}
+
+void execute_cached(struct chip8 *c8, uint32_t count)
+{
+    cores[c8->quirks].execute_cached(c8, count);
+}
+
+// split an opcode into its operands and find the profile's handler for it
+void decode_op(uint16_t opcode, enum quirk_profile quirks, struct decoded_op *op)
+{
+    op->opcode = opcode;
+    op->nnn = opcode & 0xfff;
+    op->x = (opcode >> 8) & 0xf;
+    op->y = (opcode >> 4) & 0xf;
+    op->n = opcode & 0xf;
+    op->kk = opcode & 0xff;
+
+    // resolve the groups down to the instruction handler so a cached entry
+    // costs a single indirect call
+    switch (opcode >> 12)
+    {
+        case 0x0:
+            op->handler = op->x == 0 ? group_0_table[op->kk] : op_unknown;
+            break;
+        case 0x8:
+            op->handler = group_8_table[quirks][op->n];
+            break;
+        case 0xe:
+            op->handler = group_e_table[op->kk];
+            break;
+        case 0xf:
+            op->handler = group_f_table[quirks][op->kk];
+            break;
+        default:
+            op->handler = dispatch_table[quirks][opcode >> 12];
+            break;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x5 && nibbles[3] == 0x5)
+}
+
+// drop the cache entries that overlap a write of length bytes at address
+void invalidate_decode_cache(struct chip8 *c8, uint16_t address, uint16_t length)
+{
+    if (length == 0)
     {
-        copy_reg_to_mem(nibbles[1]);
+        return;
     }
-    else if (nibbles[0] == 0xf && nibbles[2] == 0x6 && nibbles[3] == 0x5)
+    uint16_t first = (address & 0xfff) >> 1;
+    uint16_t last = ((address + length - 1) & 0xfff) >> 1;
+    if (last < first)
     {
-        load_reg_from_mem(nibbles[1]);
+        // the write wrapped past the end of memory
+        last = 2047;
+        invalidate_decode_cache(c8, 0, (address + length) & 0xfff);
     }
-    else
+    for (uint16_t i = first; i <= last; i++)
     {
-        perror("unknown opcode\n");
-        exit(EXIT_FAILURE);
+        c8->decode_cache[i].handler = NULL;
     }
 }
 
-void clear_display()
+void clear_display(struct chip8 *c8)
 {
-    memset(display, 0, sizeof(display[0][0] * 32 * 64));
-    draw_display();
-    reg_pc += 2;
+    memset(c8->display, 0, sizeof(c8->display));
+    c8->display_dirty = true;
+    c8->reg_pc += 2;
 }
 
-void return_instruction()
+void return_instruction(struct chip8 *c8)
 {
     // sets the program counter to the address at the top of the stack,
     // then subtracts 1 from the stack pointer
-    reg_sp--;
-    reg_pc = stack[reg_sp];
-    reg_pc += 2;
+    c8->reg_sp--;
+    c8->reg_pc = c8->stack[c8->reg_sp];
+    c8->reg_pc += 2;
 }
 
-void jump_instruction(uint16_t opcode)
+void jump_instruction(struct chip8 *c8, uint16_t opcode)
 {
     // set the pc to the last 12 bits of the opcode
-    reg_pc = opcode & 0xfff;
+    uint16_t from = c8->reg_pc;
+    c8->reg_pc = opcode & 0xfff;
+
+    // landing on an idle loop ends the batch so it can be fast forwarded.
+    // the jump closing one is at most two instructions past its top. a loop
+    // too short to be worth it is not looked at again until the next frame
+    if (c8->skip_idle && (uint16_t)(from - c8->reg_pc) <= 4 &&
+        (c8->reg_pc != c8->idle_miss_pc || c8->frame_count != c8->idle_miss_frame))
+    {
+        if (at_idle_loop(c8))
+        {
+            c8->stop_batch = true;
+        }
+        else
+        {
+            c8->idle_miss_pc = c8->reg_pc;
+            c8->idle_miss_frame = c8->frame_count;
+        }
+    }
 }
 
-void call_instruction(uint16_t opcode)
+void call_instruction(struct chip8 *c8, uint16_t opcode)
 {
     // increment sp and store pc on stack, then call jump
-    stack[reg_sp] = reg_pc;
-    reg_sp++;
-    jump_instruction(opcode);
+    c8->stack[c8->reg_sp] = c8->reg_pc;
+    c8->reg_sp++;
+    jump_instruction(c8, opcode);
 }
 
-void skip_if_reg_equals_value(uint8_t x, uint16_t opcode)
+void skip_if_reg_equals_value(struct chip8 *c8, uint8_t x, uint16_t opcode)
 {
     // increment the pc by two if Vx = value
     uint8_t value = opcode & 0xff;
-    if (reg_vx[x] == value)
+    PROFILE_SKIP(c8, c8->reg_vx[x] == value);
+    if (c8->reg_vx[x] == value)
     {
-        reg_pc += 2;
+        c8->reg_pc += 2;
     }
-    reg_pc += 2;
+    c8->reg_pc += 2;
 }
 
-void skip_if_reg_not_equals_value(uint8_t x, uint16_t opcode)
+void skip_if_reg_not_equals_value(struct chip8 *c8, uint8_t x, uint16_t opcode)
 {
     // increment the pc by two if Vx != value
     uint8_t value = opcode & 0xff;
-    if (reg_vx[x] != value)
+    PROFILE_SKIP(c8, c8->reg_vx[x] != value);
+    if (c8->reg_vx[x] != value)
     {
-        reg_pc += 2;
+        c8->reg_pc += 2;
     }
-    reg_pc += 2;
+    c8->reg_pc += 2;
 }
 
-void skip_if_reg_equal(uint8_t x, uint8_t y)
+void skip_if_reg_equal(struct chip8 *c8, uint8_t x, uint8_t y)
 {
     // increment the pc by two if Vx = Vy
-    if (reg_vx[x] == reg_vx[y])
+    PROFILE_SKIP(c8, c8->reg_vx[x] == c8->reg_vx[y]);
+    if (c8->reg_vx[x] == c8->reg_vx[y])
     {
-        reg_pc += 2;
+        c8->reg_pc += 2;
     }
-    reg_pc += 2;
+    c8->reg_pc += 2;
 }
 
-void load_value(uint8_t x, uint16_t opcode)
+void load_value(struct chip8 *c8, uint8_t x, uint16_t opcode)
 {
     // load the last byte of the opcode into Vx
-    reg_vx[x] = opcode & 0xff;
-    reg_pc += 2;
+    c8->reg_vx[x] = opcode & 0xff;
+    c8->reg_pc += 2;
 }
 
-void add_value(uint8_t x, uint16_t opcode)
+void add_value(struct chip8 *c8, uint8_t x, uint16_t opcode)
 {
     // add the last byte of the opcode to Vx and store in Vx
-    reg_vx[x] += opcode & 0xff;
-    reg_pc += 2;
+    c8->reg_vx[x] += opcode & 0xff;
+    c8->reg_pc += 2;
 }
 
-void load_from_register(uint8_t x, uint8_t y)
+void load_from_register(struct chip8 *c8, uint8_t x, uint8_t y)
 {
     // set Vx to the value in Vy
-    reg_vx[x] = reg_vx[y];
-    reg_pc += 2;
+    c8->reg_vx[x] = c8->reg_vx[y];
+    c8->reg_pc += 2;
 }
 
-void or_registers(uint8_t x, uint8_t y)
+QUIRKS_INLINE void or_registers_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q)
 {
-    // do a bitwise or of Vx and Vy and store in Vx
-    reg_vx[x] |= reg_vx[y];
-    reg_pc += 2;
+    // do a bitwise or of Vx and Vy and store in Vx, the VIP clears Vf
+    c8->reg_vx[x] |= c8->reg_vx[y];
+    if (quirk_profiles[q].logic_clears_vf)
+    {
+        c8->reg_vx[0xf] = 0;
+    }
+    c8->reg_pc += 2;
 }
 
-void and_registers(uint8_t x, uint8_t y)
+QUIRKS_INLINE void and_registers_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q)
 {
     // do a bitwise and of Vx and Vy and store in Vx
-    reg_vx[x] &= reg_vx[y];
-    reg_pc += 2;
+    c8->reg_vx[x] &= c8->reg_vx[y];
+    if (quirk_profiles[q].logic_clears_vf)
+    {
+        c8->reg_vx[0xf] = 0;
+    }
+    c8->reg_pc += 2;
 }
 
-void xor_registers(uint8_t x, uint8_t y)
+QUIRKS_INLINE void xor_registers_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q)
 {
     // do a bitwise xor of Vx and Vy and store in Vx
-    reg_vx[x] ^= reg_vx[y];
-    reg_pc += 2;
+    c8->reg_vx[x] ^= c8->reg_vx[y];
+    if (quirk_profiles[q].logic_clears_vf)
+    {
+        c8->reg_vx[0xf] = 0;
+    }
+    c8->reg_pc += 2;
 }
 
-void add_registers(uint8_t x, uint8_t y)
+void add_registers(struct chip8 *c8, uint8_t x, uint8_t y)
 {
     // add Vx and Vy and store in Vx, if it overflows set the carry bit Vf
-    if (reg_vx[x] > 0xff - reg_vx[y])
+    if (c8->reg_vx[x] > 0xff - c8->reg_vx[y])
     {
-        reg_vx[0xf] = 0x1;
+        c8->reg_vx[0xf] = 0x1;
     }
     else
     {
-        reg_vx[0xf] = 0x0;
+        c8->reg_vx[0xf] = 0x0;
     }
-    reg_vx[x] += reg_vx[y];
-    reg_pc += 2;
+    c8->reg_vx[x] += c8->reg_vx[y];
+    c8->reg_pc += 2;
 }
 
-void sub_registers(uint8_t x, uint8_t y)
+void sub_registers(struct chip8 *c8, uint8_t x, uint8_t y)
 {
     // set Vf to not borrow if Vx > Vy, then subtract Vy from Vx and store in Vx
-    if (reg_vx[x] > reg_vx[y])
+    if (c8->reg_vx[x] > c8->reg_vx[y])
     {
-        reg_vx[0xf] = 0x1;
+        c8->reg_vx[0xf] = 0x1;
     }
     else
     {
-        reg_vx[0xf] = 0x0;
+        c8->reg_vx[0xf] = 0x0;
     }
-    reg_vx[x] -= reg_vx[y];
-    reg_pc += 2;
+    c8->reg_vx[x] -= c8->reg_vx[y];
+    c8->reg_pc += 2;
 }
 
-void shift_register_right(uint8_t x)
+QUIRKS_INLINE void shift_register_right_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q)
 {
-    // shift Vx right by 1, if the LSB is one store it in Vf
-    reg_vx[0xf] = reg_vx[x] & 0x1;
-    reg_vx[x] >>= 1;
-    reg_pc += 2;
+    // shift Vx right by 1, if the LSB is one store it in Vf. some profiles
+    // shift Vy and store the result in Vx
+    uint8_t source = quirk_profiles[q].shift_vy ? y : x;
+    c8->reg_vx[0xf] = c8->reg_vx[source] & 0x1;
+    c8->reg_vx[x] = c8->reg_vx[source] >> 1;
+    c8->reg_pc += 2;
 }
 
-void subn_registers(uint8_t x, uint8_t y)
+void subn_registers(struct chip8 *c8, uint8_t x, uint8_t y)
 {
     // set Vf to not borrow if Vy > Vx, then subtract Vx from Vy and store in Vx
-    if (reg_vx[y] > reg_vx[x])
+    if (c8->reg_vx[y] > c8->reg_vx[x])
     {
-        reg_vx[0xf] = 0x1;
+        c8->reg_vx[0xf] = 0x1;
     }
     else
     {
-        reg_vx[0xf] = 0x0;
+        c8->reg_vx[0xf] = 0x0;
     }
-    reg_vx[x] = reg_vx[y] - reg_vx[x];
-    reg_pc += 2;
+    c8->reg_vx[x] = c8->reg_vx[y] - c8->reg_vx[x];
+    c8->reg_pc += 2;
 }
 
-void shift_register_left(uint8_t x)
+QUIRKS_INLINE void shift_register_left_as(struct chip8 *c8, uint8_t x, uint8_t y, enum quirk_profile q)
 {
-    // shift Vx left by 1, if the MSB is one store it in Vf
-    reg_vx[0xf] = (reg_vx[x] >> 7) & 0x1;
-    reg_vx[x] <<= 1;
-    reg_pc += 2;
+    // shift Vx left by 1, if the MSB is one store it in Vf. some profiles
+    // shift Vy and store the result in Vx
+    uint8_t source = quirk_profiles[q].shift_vy ? y : x;
+    c8->reg_vx[0xf] = (c8->reg_vx[source] >> 7) & 0x1;
+    c8->reg_vx[x] = c8->reg_vx[source] << 1;
+    c8->reg_pc += 2;
 }
 
-void skip_if_reg_not_equal(uint8_t x, uint8_t y)
+void skip_if_reg_not_equal(struct chip8 *c8, uint8_t x, uint8_t y)
 {
     // increment the pc by two if Vx != Vy
-    if (reg_vx[x] != reg_vx[y])
+    PROFILE_SKIP(c8, c8->reg_vx[x] != c8->reg_vx[y]);
+    if (c8->reg_vx[x] != c8->reg_vx[y])
     {
-        reg_pc += 2;
+        c8->reg_pc += 2;
     }
-    reg_pc += 2;
+    c8->reg_pc += 2;
 }
 
-void load_i_value(uint16_t opcode)
+void load_i_value(struct chip8 *c8, uint16_t opcode)
 {
     // load the last 12 bits of the opcode into I
-    reg_i = opcode & 0xfff;
-    reg_pc += 2;
+    c8->reg_i = opcode & 0xfff;
+    c8->reg_pc += 2;
 }
 
-void jump_reg_plus_value(uint16_t opcode)
+QUIRKS_INLINE void jump_reg_plus_value_as(struct chip8 *c8, uint16_t opcode, enum quirk_profile q)
 {
-    // the pc will be set to V0 + last 12 bits of opcode
+    // the pc will be set to V0 + last 12 bits of opcode, or on CHIP-48 and
+    // SUPER-CHIP to Vx + the last 12 bits, x being the second nibble
     uint16_t value = opcode & 0xfff;
-    reg_pc = reg_vx[0] + value;
+    uint8_t x = quirk_profiles[q].jump_vx ? (opcode >> 8) & 0xf : 0;
+    c8->reg_pc = c8->reg_vx[x] + value;
 }
 
-void set_reg_random_byte(uint8_t x, uint16_t opcode)
+void set_reg_random_byte(struct chip8 *c8, uint8_t x, uint16_t opcode)
 {
     // set Vx to be a random byte anded with the last byte of the opcode
     uint8_t value = opcode & 0xff;
-    reg_vx[x] = (rand() % 0xff) & value;
-    reg_pc += 2;
+    c8->reg_vx[x] = random_byte(c8) & value;
+    c8->reg_pc += 2;
 }
 
-void display_sprite(uint8_t x, uint8_t y, uint8_t n)
+QUIRKS_INLINE void display_sprite_as(struct chip8 *c8, uint8_t x, uint8_t y, uint8_t n, enum quirk_profile q)
 {
-    reg_vx[0xf] = 0;
-    uint8_t reg_x = reg_vx[x];
-    uint8_t reg_y = reg_vx[y];
-
-    for (int i = 0; i < n; i++)
-    {
-        uint8_t pixel = memory[reg_i + i];
-        for (int j = 0; j < 8; j++)
+    // the sprite starts at (Vx mod 64, Vy mod 32), anything that runs past
+    // the right or bottom edge is clipped, or on XO-CHIP wraps around to
+    // the other side. VF can be a coordinate, it is read before it is
+    // cleared for the collision flag
+    uint8_t reg_x = c8->reg_vx[x] & 0x3f;
+    uint8_t reg_y = c8->reg_vx[y] & 0x1f;
+    c8->reg_vx[0xf] = 0;
+    PROFILE_DRAW(c8, reg_x, reg_y, n);
+
+    bool wrap = quirk_profiles[q].wrap_sprites;
+    for (int i = 0; i < n && (wrap || reg_y + i < 32); i++)
+    {
+        // line the sprite byte up with column reg_x, bit 63 is column 0
+        uint64_t bits = (uint64_t)c8->memory[(c8->reg_i + i) & 0xfff] << 56;
+        uint64_t row = bits >> reg_x;
+        if (wrap && reg_x != 0)
         {
-            uint8_t pixel_bit = (pixel & (0x80 >> j)) >> (7 - j);
-            uint8_t display_bit = display[reg_x + j][reg_y + i];
-            if ((pixel_bit & display_bit) == 0x1)
-            {
-                reg_vx[0xf] = 1;
-            }
-            display[reg_x + j][reg_y + i] ^= pixel_bit;
+            row |= bits << (64 - reg_x);
         }
+        uint8_t line = (reg_y + i) & 0x1f;
+        if (c8->display[line] & row)
+        {
+            c8->reg_vx[0xf] = 1;
+        }
+        c8->display[line] ^= row;
     }
-    reg_pc += 2;
-    draw_display();
+    c8->reg_pc += 2;
+    c8->display_dirty = true;
 }
 
-void skip_if_key_pressed(uint8_t x)
+void skip_if_key_pressed(struct chip8 *c8, uint8_t x)
 {
     // skip the next instruction if the key in Vx is pressed
-    const uint8_t *keys = SDL_GetKeyboardState(NULL);
-    SDL_PumpEvents();
-
-    int key = sdl_keymapping[reg_vx[x]];
-    if (keys[key] != 0)
+    PROFILE_SKIP(c8, (c8->keys >> (c8->reg_vx[x] & 0xf)) & 0x1);
+    if ((c8->keys >> (c8->reg_vx[x] & 0xf)) & 0x1)
     {
-        reg_pc += 2;
+        c8->reg_pc += 2;
     }
-    reg_pc += 2;
+    c8->reg_pc += 2;
 }
 
-void skip_if_key_not_pressed(uint8_t x)
+void skip_if_key_not_pressed(struct chip8 *c8, uint8_t x)
 {
     // skip the next instruction if the key in Vx is not pressed
-    const uint8_t *keys = SDL_GetKeyboardState(NULL);
-    SDL_PumpEvents();
-
-    int key = sdl_keymapping[reg_vx[x]];
-    if (keys[key] == 0)
+    PROFILE_SKIP(c8, !((c8->keys >> (c8->reg_vx[x] & 0xf)) & 0x1));
+    if (!((c8->keys >> (c8->reg_vx[x] & 0xf)) & 0x1))
     {
-        reg_pc += 2;
+        c8->reg_pc += 2;
     }
-    reg_pc += 2;
+    c8->reg_pc += 2;
 }
 
-void delay_timer_to_reg(uint8_t x)
+void delay_timer_to_reg(struct chip8 *c8, uint8_t x)
 {
-    reg_vx[x] = reg_delay;
-    reg_pc += 2;
+    c8->reg_vx[x] = c8->reg_delay;
+    c8->reg_pc += 2;
 }
 
-void store_key_press(uint8_t x)
+void store_key_press(struct chip8 *c8, uint8_t x)
 {
-    // wait for a valid key to be pressed and store it in Vx
-    const uint8_t *keys = SDL_GetKeyboardState(NULL);
-
-    while (true)
+    // store the lowest held key in Vx. with none held the machine waits,
+    // leaving pc on this instruction, and the run loop idles until the
+    // backend reports a key
+    if (c8->keys == 0)
     {
-        printf("awaiting valid key press\n");
-        SDL_PumpEvents();
-
-        for (int i = 0; i < 16; i++)
-        {
-            if (keys[sdl_keymapping[i]] != 0)
-            {
-                reg_vx[x] = i;
-                reg_pc += 2;
-                return;
-            }
-        }
-        // todo: may want to add sleep to slow down this loop
+        c8->waiting_key = true;
+        c8->stop_batch = true;
+        return;
+    }
+    uint8_t key = 0;
+    while (!((c8->keys >> key) & 0x1))
+    {
+        key++;
     }
+    c8->waiting_key = false;
+    c8->reg_vx[x] = key;
+    c8->reg_pc += 2;
 }
 
-void set_delay_timer(uint8_t x)
+void set_delay_timer(struct chip8 *c8, uint8_t x)
 {
-    reg_delay = reg_vx[x];
-    reg_pc += 2;
+    c8->reg_delay = c8->reg_vx[x];
+    c8->reg_pc += 2;
 }
 
-void set_sound_timer(uint8_t x)
+void set_sound_timer(struct chip8 *c8, uint8_t x)
 {
-    reg_sound = reg_vx[x];
-    reg_pc += 2;
+    c8->reg_sound = c8->reg_vx[x];
+    c8->reg_pc += 2;
 }
 
-void add_reg_to_i(uint8_t x)
+void add_reg_to_i(struct chip8 *c8, uint8_t x)
 {
     // if there is an overflow set Vf to 1, 0 otherwise
-    if (reg_i + reg_vx[x] > 0xfff)
+    if (c8->reg_i + c8->reg_vx[x] > 0xfff)
     {
-        reg_vx[0xf] = 1;
+        c8->reg_vx[0xf] = 1;
     }
     else
     {
-        reg_vx[0xf] = 0;
+        c8->reg_vx[0xf] = 0;
     }
-    reg_i += reg_vx[x];
-    reg_pc += 2;
+    c8->reg_i += c8->reg_vx[x];
+    c8->reg_pc += 2;
 }
 
-void set_i_sprite_location(uint8_t x)
+void set_i_sprite_location(struct chip8 *c8, uint8_t x)
 {
     // set I to be the location of the font corresponding to the value in Vx
     // since the fonts are 5 bytes long and in memory at 0x0, we can muliply the value
     // in Vx by 5 to get the location in memory
-    reg_i = reg_vx[x] * 5;
-    reg_pc += 2;
+    c8->reg_i = c8->reg_vx[x] * 5;
+    c8->reg_pc += 2;
 }
 
-void store_bcd(uint8_t x)
+void store_bcd(struct chip8 *c8, uint8_t x)
 {
     // get decimal value of Vx and store it in memory as BCD at I, I+1, I+2
-    memory[reg_i] = reg_vx[x] / 100;
-    memory[reg_i + 1] = (reg_vx[x] / 10) % 10;
-    memory[reg_i + 2] = reg_vx[x] % 10;
-    reg_pc += 2;
+    c8->memory[c8->reg_i & 0xfff] = c8->reg_vx[x] / 100;
+    c8->memory[(c8->reg_i + 1) & 0xfff] = (c8->reg_vx[x] / 10) % 10;
+    c8->memory[(c8->reg_i + 2) & 0xfff] = c8->reg_vx[x] % 10;
+    invalidate_decode_cache(c8, c8->reg_i, 3);
+    jit_invalidate(c8, c8->reg_i, 3);
+    c8->reg_pc += 2;
+}
+
+// where Fx55 and Fx65 leave I after copying registers V0 to Vx
+QUIRKS_INLINE void advance_i_as(struct chip8 *c8, uint8_t x, enum quirk_profile q)
+{
+    if (quirk_profiles[q].load_store_moves_i)
+    {
+        c8->reg_i += quirk_profiles[q].load_store_off_by_one ? x : x + 1;
+    }
 }
 
-void copy_reg_to_mem(uint8_t x)
+QUIRKS_INLINE void copy_reg_to_mem_as(struct chip8 *c8, uint8_t x, enum quirk_profile q)
 {
-    // copies registers V0 to Vx to memory starting at I
+    // copies registers V0 to Vx to memory starting at I, wrapping at the end
+    // of memory as the profiles that move I can take it past there
     for (int i = 0; i <= x; i++)
     {
-        memory[reg_i + i] = reg_vx[i];
+        c8->memory[(c8->reg_i + i) & 0xfff] = c8->reg_vx[i];
     }
-    reg_pc += 2;
+    invalidate_decode_cache(c8, c8->reg_i, x + 1);
+    jit_invalidate(c8, c8->reg_i, x + 1);
+    advance_i_as(c8, x, q);
+    c8->reg_pc += 2;
 }
 
-void load_reg_from_mem(uint8_t x)
+QUIRKS_INLINE void load_reg_from_mem_as(struct chip8 *c8, uint8_t x, enum quirk_profile q)
 {
     // load registers V0 to Vx from memory starting at I
     for (int i = 0; i <= x; i++)
     {
-        reg_vx[i] = memory[reg_i + i];
+        c8->reg_vx[i] = c8->memory[(c8->reg_i + i) & 0xfff];
     }
-    reg_pc += 2;
+    advance_i_as(c8, x, q);
+    c8->reg_pc += 2;
+}
+
+// the instructions that differ between profiles for callers outside the
+// interpreter, e.g. the benchmarks. unlike the copies in the interpreter
+// these look the machine's quirks up every time
+void or_registers(struct chip8 *c8, uint8_t x, uint8_t y)
+{
+    or_registers_as(c8, x, y, c8->quirks);
+}
+
+void and_registers(struct chip8 *c8, uint8_t x, uint8_t y)
+{
+    and_registers_as(c8, x, y, c8->quirks);
+}
+
+void xor_registers(struct chip8 *c8, uint8_t x, uint8_t y)
+{
+    xor_registers_as(c8, x, y, c8->quirks);
+}
+
+void shift_register_right(struct chip8 *c8, uint8_t x, uint8_t y)
+{
+    shift_register_right_as(c8, x, y, c8->quirks);
+}
+
+void shift_register_left(struct chip8 *c8, uint8_t x, uint8_t y)
+{
+    shift_register_left_as(c8, x, y, c8->quirks);
+}
+
+void jump_reg_plus_value(struct chip8 *c8, uint16_t opcode)
+{
+    jump_reg_plus_value_as(c8, opcode, c8->quirks);
+}
+
+void display_sprite(struct chip8 *c8, uint8_t x, uint8_t y, uint8_t n)
+{
+    display_sprite_as(c8, x, y, n, c8->quirks);
+}
+
+void copy_reg_to_mem(struct chip8 *c8, uint8_t x)
+{
+    copy_reg_to_mem_as(c8, x, c8->quirks);
+}
+
+void load_reg_from_mem(struct chip8 *c8, uint8_t x)
+{
+    load_reg_from_mem_as(c8, x, c8->quirks);
 }
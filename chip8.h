@@ -1,46 +1,288 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
-void cleanup();
-void init_emulator(char * path_to_rom, bool debug);
-void disassemble(uint16_t op, FILE *f);
-void draw_display();
-void execute_cycle(bool debug);
-void write_debug();
-void decode_and_execute(uint16_t opcode);
-void clear_display();
-void return_instruction();
-void jump_instruction(uint16_t opcode);
-void call_instruction(uint16_t opcode);
-void skip_if_reg_equals_value(uint8_t x, uint16_t opcode);
-void skip_if_reg_not_equals_value(uint8_t x, uint16_t opcode);
-void skip_if_reg_equal(uint8_t x, uint8_t y);
-void load_value(uint8_t x, uint16_t opcode);
-void add_value(uint8_t x, uint16_t opcode);
-void load_from_register(uint8_t x, uint8_t y);
-void or_registers(uint8_t x, uint8_t y);
-void and_registers(uint8_t x, uint8_t y);
-void xor_registers(uint8_t x, uint8_t y);
-void add_registers(uint8_t x, uint8_t y);
-void sub_registers(uint8_t x, uint8_t y);
-void shift_register_right(uint8_t x);
-void subn_registers(uint8_t x, uint8_t y);
-void shift_register_left(uint8_t x);
-void skip_if_reg_not_equal(uint8_t x, uint8_t y);
-void load_i_value(uint16_t opcode);
-void jump_reg_plus_value(uint16_t opcode);
-void set_reg_random_byte(uint8_t x, uint16_t opcode);
-void display_sprite(uint8_t x, uint8_t y, uint8_t n);
-void skip_if_key_pressed(uint8_t x);
-void skip_if_key_not_pressed(uint8_t x);
-void delay_timer_to_reg(uint8_t x);
-void store_key_press(uint8_t x);
-void set_delay_timer(uint8_t x);
-void set_sound_timer(uint8_t x);
-void add_reg_to_i(uint8_t x);
-void set_i_sprite_location(uint8_t x);
-void store_bcd(uint8_t x);
-void copy_reg_to_mem(uint8_t x);
-void load_reg_from_mem(uint8_t x);
+// instruction decoder used by execute_cycle
+enum dispatch_mode
+{
+    DISPATCH_CHAIN,
+    DISPATCH_TABLE,
+    DISPATCH_THREADED,
+    DISPATCH_CACHED,
+    DISPATCH_JIT
+};
+
+// instruction set variants. interpreters since the original COSMAC VIP one
+// disagree on a handful of instructions, see struct quirks. modern is what
+// this emulator has always done and what most current roms expect
+enum quirk_profile
+{
+    QUIRKS_MODERN,
+    QUIRKS_VIP,
+    QUIRKS_CHIP48,
+    QUIRKS_SCHIP,
+    QUIRKS_XOCHIP,
+    QUIRK_PROFILE_COUNT
+};
+
+// how a profile runs the instructions that differ between variants
+struct quirks
+{
+    // 8xy6 and 8xyE shift Vy into Vx instead of shifting Vx in place
+    bool shift_vy;
+
+    // 8xy1, 8xy2 and 8xy3 clear Vf
+    bool logic_clears_vf;
+
+    // Fx55 and Fx65 leave I past the last register copied, or with
+    // off_by_one on the last register copied, instead of unchanged
+    bool load_store_moves_i;
+    bool load_store_off_by_one;
+
+    // Bnnn jumps to nnn plus Vx, x being the top nibble of nnn, not plus V0
+    bool jump_vx;
+
+    // sprites wrap around the edges of the display instead of being clipped
+    bool wrap_sprites;
+};
+
+// emulated instruction rate unless set otherwise on the machine. the timers
+// and the display run at 60 frames per second of emulated time
+#define DEFAULT_CYCLES_PER_SECOND 600
+#define FRAMES_PER_SECOND 60
+
+struct chip8;
+struct backend;
+struct frame_clock;
+struct jit_state;
+struct tracer;
+struct rewind_buffer;
+struct profile;
+struct recorder;
+struct capture;
+
+// an opcode split into its operands along with the handler that runs it
+struct decoded_op
+{
+    void (*handler)(struct chip8 *c8, const struct decoded_op *op);
+    uint16_t opcode;
+    uint16_t nnn;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t kk;
+};
+
+// complete state of one machine. every handler works on the machine passed
+// to it, so any number of machines can run side by side.
+// everything before decode_cache is the emulated machine and is copied as
+// one block by snapshots, host side state goes after it
+struct chip8
+{
+    // registers 16 1 byte registers
+    uint8_t reg_vx[16];
+
+    // I register 2 bytes
+    uint16_t reg_i;
+
+    // delay and sound time registers 1 bytes each
+    uint8_t reg_delay;
+    uint8_t reg_sound;
+
+    // program counter register 2 bytes
+    uint16_t reg_pc;
+
+    // stack pointer register 1 byte
+    uint8_t reg_sp;
+
+    // stack 16 2 byte values
+    uint16_t stack[16];
+
+    // memory 4K bytes
+    uint8_t memory[4096];
+
+    // size of the rom loaded at 0x200
+    uint16_t rom_size;
+
+    // display information 64x32 display, one word per row with column 0 in
+    // the most significant bit
+    uint64_t display[32];
+
+    // opcode 2 bytes
+    uint16_t current_opcode;
+
+    // instructions executed since the machine was reset
+    uint64_t instruction_count;
+
+    // instructions per second of emulated time, at least FRAMES_PER_SECOND
+    uint32_t cycles_per_second;
+
+    // 60 Hz frames since the machine was reset and the instructions left
+    // before the current one ends. the timers tick and the display is
+    // presented at the end of each frame
+    uint64_t frame_count;
+    uint32_t frame_cycles_left;
+
+    // set when the program can make no further progress, e.g. waiting for a
+    // key after the headless input script has run out
+    bool halted;
+
+    // bit n is set while chip8 key n is held down. the backend updates it
+    // between batches, the key instructions only read it
+    uint16_t keys;
+
+    // set while Fx0A waits for a key. the instruction has not finished, pc
+    // still points at it and it runs again once a key is held down
+    bool waiting_key;
+
+    // xorshift64* state behind Cxkk, never 0
+    uint64_t random_state;
+
+    // enum quirk_profile the program runs as, picks the copy of the
+    // interpreter built for it
+    uint8_t quirks;
+
+    // set when halted by an opcode no variant defines, with the address and
+    // opcode of that instruction, 0 otherwise
+    bool faulted;
+    uint16_t fault_pc;
+    uint16_t fault_opcode;
+
+    // predecoded instructions, one entry per even address in memory. an entry
+    // with no handler has not been decoded yet or was invalidated by a write
+    struct decoded_op decode_cache[2048];
+
+    // instruction count at which the backend next needs to update the keys,
+    // batches end there. UINT64_MAX if polling between batches is enough
+    uint64_t input_deadline;
+
+    // set for batches that fast forward through idle loops, and the
+    // instructions skipped that way instead of executed
+    bool skip_idle;
+    uint64_t idle_skipped;
+
+    // the last loop found too short to fast forward and the frame it was
+    // seen in
+    uint16_t idle_miss_pc;
+    uint64_t idle_miss_frame;
+
+    // ends the batch being run before its count is reached: set by Fx0A
+    // when it starts waiting and by a jump to the top of an idle loop
+    bool stop_batch;
+
+    // seed the random number generator is reset to
+    uint64_t random_seed;
+
+    // set by CLS and DRW, cleared when the display is next presented
+    bool display_dirty;
+
+    // hash of the display as last presented and the number of presents
+    uint64_t presented_hash;
+    uint64_t present_count;
+
+    // translated blocks, NULL unless the jit is in use
+    struct jit_state *jit;
+
+    // debug trace, NULL unless tracing
+    struct tracer *trace;
+
+    // execution counters, NULL unless profiling
+    struct profile *profile;
+
+    // key changes being logged for replay, NULL unless recording
+    struct recorder *recorder;
+
+    // recent frames to step back through, NULL unless rewind is enabled.
+    // while rewinding is set the run loop steps back instead of running
+    struct rewind_buffer *rewind;
+    bool rewinding;
+
+    // frames being written out as video, NULL unless capturing
+    struct capture *capture;
+
+    // host video, input and timing, with state private to the backend
+    struct backend *backend;
+    void *backend_data;
+};
+
+// 1 if the pixel at column x, row y is lit
+static inline int display_pixel(const struct chip8 *c8, int x, int y)
+{
+    return (c8->display[y] >> (63 - x)) & 0x1;
+}
+
+// decoder used by every machine, set before machines start running
+extern enum dispatch_mode dispatch_mode;
+
+// quirks of each profile, indexed by enum quirk_profile
+extern const struct quirks quirk_profiles[QUIRK_PROFILE_COUNT];
+
+// fast forward through loops that only wait for the delay timer or a key,
+// on by default. the results are the same either way
+extern bool idle_skip;
+
+struct chip8 *create_emulator();
+void destroy_emulator(struct chip8 *c8);
+void reset_emulator(struct chip8 *c8);
+bool load_rom(struct chip8 *c8, const char *path_to_rom);
+bool load_rom_data(struct chip8 *c8, const uint8_t *data, size_t size);
+void cleanup(struct chip8 *c8);
+void init_emulator(struct chip8 *c8, char * path_to_rom, bool debug);
+void run_emulator(struct chip8 *c8, uint64_t cycle_limit, struct frame_clock *clock, bool debug);
+void draw_display(struct chip8 *c8);
+void present_display(struct chip8 *c8);
+uint64_t display_hash(const struct chip8 *c8);
+void execute_cycle(struct chip8 *c8, bool debug);
+void execute_cycles(struct chip8 *c8, uint32_t count, bool debug);
+void execute_threaded(struct chip8 *c8, uint32_t count);
+void execute_cached(struct chip8 *c8, uint32_t count);
+void decode_op(uint16_t opcode, enum quirk_profile quirks, struct decoded_op *op);
+void invalidate_decode_cache(struct chip8 *c8, uint16_t address, uint16_t length);
+void finish_cycle(struct chip8 *c8);
+void finish_cycles(struct chip8 *c8, uint32_t count);
+bool at_idle_loop(const struct chip8 *c8);
+uint32_t frame_cycles(const struct chip8 *c8, uint64_t frame);
+void set_cycles_per_second(struct chip8 *c8, uint32_t cycles_per_second);
+void seed_random(struct chip8 *c8, uint64_t seed);
+void set_quirk_profile(struct chip8 *c8, enum quirk_profile quirks);
+bool parse_quirk_profile(const char *name, enum quirk_profile *quirks);
+const char *quirk_profile_name(enum quirk_profile quirks);
+bool parse_dispatch_mode(const char *name, enum dispatch_mode *mode);
+void init_dispatch_tables();
+void decode_and_execute(struct chip8 *c8, uint16_t opcode);
+void decode_chain(struct chip8 *c8, uint16_t opcode);
+void clear_display(struct chip8 *c8);
+void return_instruction(struct chip8 *c8);
+void jump_instruction(struct chip8 *c8, uint16_t opcode);
+void call_instruction(struct chip8 *c8, uint16_t opcode);
+void skip_if_reg_equals_value(struct chip8 *c8, uint8_t x, uint16_t opcode);
+void skip_if_reg_not_equals_value(struct chip8 *c8, uint8_t x, uint16_t opcode);
+void skip_if_reg_equal(struct chip8 *c8, uint8_t x, uint8_t y);
+void load_value(struct chip8 *c8, uint8_t x, uint16_t opcode);
+void add_value(struct chip8 *c8, uint8_t x, uint16_t opcode);
+void load_from_register(struct chip8 *c8, uint8_t x, uint8_t y);
+void or_registers(struct chip8 *c8, uint8_t x, uint8_t y);
+void and_registers(struct chip8 *c8, uint8_t x, uint8_t y);
+void xor_registers(struct chip8 *c8, uint8_t x, uint8_t y);
+void add_registers(struct chip8 *c8, uint8_t x, uint8_t y);
+void sub_registers(struct chip8 *c8, uint8_t x, uint8_t y);
+void shift_register_right(struct chip8 *c8, uint8_t x, uint8_t y);
+void subn_registers(struct chip8 *c8, uint8_t x, uint8_t y);
+void shift_register_left(struct chip8 *c8, uint8_t x, uint8_t y);
+void skip_if_reg_not_equal(struct chip8 *c8, uint8_t x, uint8_t y);
+void load_i_value(struct chip8 *c8, uint16_t opcode);
+void jump_reg_plus_value(struct chip8 *c8, uint16_t opcode);
+void set_reg_random_byte(struct chip8 *c8, uint8_t x, uint16_t opcode);
+void display_sprite(struct chip8 *c8, uint8_t x, uint8_t y, uint8_t n);
+void skip_if_key_pressed(struct chip8 *c8, uint8_t x);
+void skip_if_key_not_pressed(struct chip8 *c8, uint8_t x);
+void delay_timer_to_reg(struct chip8 *c8, uint8_t x);
+void store_key_press(struct chip8 *c8, uint8_t x);
+void set_delay_timer(struct chip8 *c8, uint8_t x);
+void set_sound_timer(struct chip8 *c8, uint8_t x);
+void add_reg_to_i(struct chip8 *c8, uint8_t x);
+void set_i_sprite_location(struct chip8 *c8, uint8_t x);
+void store_bcd(struct chip8 *c8, uint8_t x);
+void copy_reg_to_mem(struct chip8 *c8, uint8_t x);
+void load_reg_from_mem(struct chip8 *c8, uint8_t x);
 
 #endif
@@ -0,0 +1,500 @@
+// the parts of the interpreter that depend on the quirk profile. chip8.c
+// includes this file once per profile, with CORE_PROFILE set to the profile
+// and CORE(name) naming that copy's functions, so every quirk test in a copy
+// is on a constant and compiled out. not a normal header, it has no include
+// guard
+
+// handlers for the table and cached decoders
+static void CORE(op_8xy1)(struct chip8 *c8, const struct decoded_op *op) { or_registers_as(c8, op->x, op->y, CORE_PROFILE); }
+static void CORE(op_8xy2)(struct chip8 *c8, const struct decoded_op *op) { and_registers_as(c8, op->x, op->y, CORE_PROFILE); }
+static void CORE(op_8xy3)(struct chip8 *c8, const struct decoded_op *op) { xor_registers_as(c8, op->x, op->y, CORE_PROFILE); }
+static void CORE(op_8xy6)(struct chip8 *c8, const struct decoded_op *op) { shift_register_right_as(c8, op->x, op->y, CORE_PROFILE); }
+static void CORE(op_8xye)(struct chip8 *c8, const struct decoded_op *op) { shift_register_left_as(c8, op->x, op->y, CORE_PROFILE); }
+static void CORE(op_bnnn)(struct chip8 *c8, const struct decoded_op *op) { jump_reg_plus_value_as(c8, op->opcode, CORE_PROFILE); }
+static void CORE(op_dxyn)(struct chip8 *c8, const struct decoded_op *op) { display_sprite_as(c8, op->x, op->y, op->n, CORE_PROFILE); }
+static void CORE(op_fx55)(struct chip8 *c8, const struct decoded_op *op) { copy_reg_to_mem_as(c8, op->x, CORE_PROFILE); }
+static void CORE(op_fx65)(struct chip8 *c8, const struct decoded_op *op) { load_reg_from_mem_as(c8, op->x, CORE_PROFILE); }
+
+static void CORE(op_group_8)(struct chip8 *c8, const struct decoded_op *op)
+{
+    group_8_table[CORE_PROFILE][op->n](c8, op);
+}
+
+static void CORE(op_group_f)(struct chip8 *c8, const struct decoded_op *op)
+{
+    group_f_table[CORE_PROFILE][op->kk](c8, op);
+}
+
+// this profile's tables, the 0 and E groups are the same for every profile
+static void CORE(fill_tables)()
+{
+    op_handler *table = dispatch_table[CORE_PROFILE];
+    op_handler *group_8 = group_8_table[CORE_PROFILE];
+    op_handler *group_f = group_f_table[CORE_PROFILE];
+    for (int i = 0; i < 256; i++)
+    {
+        group_f[i] = op_unknown;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        group_8[i] = op_unknown;
+    }
+
+    table[0x0] = op_group_0;
+    table[0x1] = op_1nnn;
+    table[0x2] = op_2nnn;
+    table[0x3] = op_3xkk;
+    table[0x4] = op_4xkk;
+    table[0x5] = op_5xy0;
+    table[0x6] = op_6xkk;
+    table[0x7] = op_7xkk;
+    table[0x8] = CORE(op_group_8);
+    table[0x9] = op_9xy0;
+    table[0xa] = op_annn;
+    table[0xb] = CORE(op_bnnn);
+    table[0xc] = op_cxkk;
+    table[0xd] = CORE(op_dxyn);
+    table[0xe] = op_group_e;
+    table[0xf] = CORE(op_group_f);
+
+    group_8[0x0] = op_8xy0;
+    group_8[0x1] = CORE(op_8xy1);
+    group_8[0x2] = CORE(op_8xy2);
+    group_8[0x3] = CORE(op_8xy3);
+    group_8[0x4] = op_8xy4;
+    group_8[0x5] = op_8xy5;
+    group_8[0x6] = CORE(op_8xy6);
+    group_8[0x7] = op_8xy7;
+    group_8[0xe] = CORE(op_8xye);
+
+    group_f[0x07] = op_fx07;
+    group_f[0x0a] = op_fx0a;
+    group_f[0x15] = op_fx15;
+    group_f[0x18] = op_fx18;
+    group_f[0x1e] = op_fx1e;
+    group_f[0x29] = op_fx29;
+    group_f[0x33] = op_fx33;
+    group_f[0x55] = CORE(op_fx55);
+    group_f[0x65] = CORE(op_fx65);
+}
+
+// original decoder, kept as the baseline to measure the other modes against
+static void CORE(decode_chain)(struct chip8 *c8, uint16_t opcode)
+{
+    // get each nibble of the opcode to decode
+    uint8_t nibbles[4];
+    nibbles[0] = (opcode >> 12) & 0xf;
+    nibbles[1] = (opcode >> 8) & 0xf;
+    nibbles[2] = (opcode >> 4) & 0xf;
+    nibbles[3] = opcode & 0xf;
+
+    if (opcode == 0x00e0)
+    {
+        clear_display(c8);
+    }
+    else if (opcode == 0x00ee)
+    {
+        return_instruction(c8);
+    }
+    else if (nibbles[0] == 0x1)
+    {
+        jump_instruction(c8, opcode);
+    }
+    else if (nibbles[0] == 0x2)
+    {
+        call_instruction(c8, opcode);
+    }
+    else if (nibbles[0] == 0x3)
+    {
+        skip_if_reg_equals_value(c8, nibbles[1], opcode);
+    }
+    else if (nibbles[0] == 0x4)
+    {
+        skip_if_reg_not_equals_value(c8, nibbles[1], opcode);
+    }
+    else if (nibbles[0] == 0x5 && nibbles[3] == 0x0)
+    {
+        skip_if_reg_equal(c8, nibbles[1], nibbles[2]);
+    }
+    else if (nibbles[0] == 0x6)
+    {
+        load_value(c8, nibbles[1], opcode);
+    }
+    else if (nibbles[0] == 0x7)
+    {
+        add_value(c8, nibbles[1], opcode);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x0)
+    {
+        load_from_register(c8, nibbles[1], nibbles[2]);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x1)
+    {
+        or_registers_as(c8, nibbles[1], nibbles[2], CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x2)
+    {
+        and_registers_as(c8, nibbles[1], nibbles[2], CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x3)
+    {
+        xor_registers_as(c8, nibbles[1], nibbles[2], CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x4)
+    {
+        add_registers(c8, nibbles[1], nibbles[2]);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x5)
+    {
+        sub_registers(c8, nibbles[1], nibbles[2]);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x6)
+    {
+        shift_register_right_as(c8, nibbles[1], nibbles[2], CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0x7)
+    {
+        subn_registers(c8, nibbles[1], nibbles[2]);
+    }
+    else if (nibbles[0] == 0x8 && nibbles[3] == 0xe)
+    {
+        shift_register_left_as(c8, nibbles[1], nibbles[2], CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0x9 && nibbles[3] == 0x0)
+    {
+        skip_if_reg_not_equal(c8, nibbles[1], nibbles[2]);
+    }
+    else if (nibbles[0] == 0xa)
+    {
+        load_i_value(c8, opcode);
+    }
+    else if (nibbles[0] == 0xb)
+    {
+        jump_reg_plus_value_as(c8, opcode, CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0xc)
+    {
+        set_reg_random_byte(c8, nibbles[1], opcode);
+    }
+    else if (nibbles[0] == 0xd)
+    {
+        display_sprite_as(c8, nibbles[1], nibbles[2], nibbles[3], CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0xe && nibbles[2] == 0x9 && nibbles[3] == 0xe)
+    {
+        skip_if_key_pressed(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xe && nibbles[2] == 0xa && nibbles[3] == 0x1)
+    {
+        skip_if_key_not_pressed(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x0 && nibbles[3] == 0x7)
+    {
+        delay_timer_to_reg(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x0 && nibbles[3] == 0xa)
+    {
+        store_key_press(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0x5)
+    {
+        set_delay_timer(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0x8)
+    {
+        set_sound_timer(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x1 && nibbles[3] == 0xe)
+    {
+        add_reg_to_i(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x2 && nibbles[3] == 0x9)
+    {
+        set_i_sprite_location(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x3 && nibbles[3] == 0x3)
+    {
+        store_bcd(c8, nibbles[1]);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x5 && nibbles[3] == 0x5)
+    {
+        copy_reg_to_mem_as(c8, nibbles[1], CORE_PROFILE);
+    }
+    else if (nibbles[0] == 0xf && nibbles[2] == 0x6 && nibbles[3] == 0x5)
+    {
+        load_reg_from_mem_as(c8, nibbles[1], CORE_PROFILE);
+    }
+    else
+    {
+        halt_unknown_opcode(c8, opcode);
+    }
+}
+
+static void CORE(decode_and_execute)(struct chip8 *c8, uint16_t opcode)
+{
+    if (dispatch_mode == DISPATCH_CHAIN)
+    {
+        CORE(decode_chain)(c8, opcode);
+    }
+    else
+    {
+        struct decoded_op op;
+        decode_op(opcode, CORE_PROFILE, &op);
+        dispatch_table[CORE_PROFILE][opcode >> 12](c8, &op);
+    }
+}
+
+// run a batch through the chain or table decoder
+static void CORE(run_decoder)(struct chip8 *c8, uint32_t count)
+{
+    c8->stop_batch = false;
+    for (uint32_t i = 0; i < count && !c8->stop_batch; i++)
+    {
+        // fetch opcode (left shift the first byte and or it with the second byte)
+        c8->current_opcode = c8->memory[c8->reg_pc] << 8 | c8->memory[c8->reg_pc + 1];
+        PROFILE_STEP(c8);
+        CORE(decode_and_execute)(c8, c8->current_opcode);
+        finish_cycle(c8);
+    }
+}
+
+// threaded interpreter: with computed goto every handler label jumps straight
+// to the label of the next instruction instead of returning to a loop, so the
+// branch predictor gets one indirect branch per handler to learn from.
+// compilers without labels as values fall back to the table decoder.
+static void CORE(execute_threaded)(struct chip8 *c8, uint32_t count)
+{
+    c8->stop_batch = false;
+    if (count == 0)
+    {
+        return;
+    }
+
+#if defined(__GNUC__)
+    static void *labels[16] =
+    {
+        &&group_0, &&op_1nnn, &&op_2nnn, &&op_3xkk,
+        &&op_4xkk, &&op_5xy0, &&op_6xkk, &&op_7xkk,
+        &&group_8, &&op_9xy0, &&op_annn, &&op_bnnn,
+        &&op_cxkk, &&op_dxyn, &&group_e, &&group_f
+    };
+    static void *labels_8[16] =
+    {
+        &&op_8xy0, &&op_8xy1, &&op_8xy2, &&op_8xy3,
+        &&op_8xy4, &&op_8xy5, &&op_8xy6, &&op_8xy7,
+        &&unknown, &&unknown, &&unknown, &&unknown,
+        &&unknown, &&unknown, &&op_8xye, &&unknown
+    };
+    uint8_t x;
+    uint8_t y;
+
+#define NEXT() \
+    do \
+    { \
+        c8->current_opcode = c8->memory[c8->reg_pc] << 8 | c8->memory[c8->reg_pc + 1]; \
+        PROFILE_STEP(c8); \
+        x = (c8->current_opcode >> 8) & 0xf; \
+        y = (c8->current_opcode >> 4) & 0xf; \
+        goto *labels[c8->current_opcode >> 12]; \
+    } while (0)
+
+#define DISPATCH() \
+    do \
+    { \
+        finish_cycle(c8); \
+        if (--count == 0) \
+        { \
+            return; \
+        } \
+        NEXT(); \
+    } while (0)
+
+    NEXT();
+
+group_0:
+    if (c8->current_opcode == 0x00e0)
+    {
+        clear_display(c8);
+        DISPATCH();
+    }
+    if (c8->current_opcode == 0x00ee)
+    {
+        return_instruction(c8);
+        DISPATCH();
+    }
+    goto unknown;
+op_1nnn:
+    jump_instruction(c8, c8->current_opcode);
+    if (c8->stop_batch)
+    {
+        finish_cycle(c8);
+        return;
+    }
+    DISPATCH();
+op_2nnn:
+    call_instruction(c8, c8->current_opcode);
+    DISPATCH();
+op_3xkk:
+    skip_if_reg_equals_value(c8, x, c8->current_opcode);
+    DISPATCH();
+op_4xkk:
+    skip_if_reg_not_equals_value(c8, x, c8->current_opcode);
+    DISPATCH();
+op_5xy0:
+    if ((c8->current_opcode & 0xf) != 0)
+    {
+        goto unknown;
+    }
+    skip_if_reg_equal(c8, x, y);
+    DISPATCH();
+op_6xkk:
+    load_value(c8, x, c8->current_opcode);
+    DISPATCH();
+op_7xkk:
+    add_value(c8, x, c8->current_opcode);
+    DISPATCH();
+group_8:
+    goto *labels_8[c8->current_opcode & 0xf];
+op_8xy0:
+    load_from_register(c8, x, y);
+    DISPATCH();
+op_8xy1:
+    or_registers_as(c8, x, y, CORE_PROFILE);
+    DISPATCH();
+op_8xy2:
+    and_registers_as(c8, x, y, CORE_PROFILE);
+    DISPATCH();
+op_8xy3:
+    xor_registers_as(c8, x, y, CORE_PROFILE);
+    DISPATCH();
+op_8xy4:
+    add_registers(c8, x, y);
+    DISPATCH();
+op_8xy5:
+    sub_registers(c8, x, y);
+    DISPATCH();
+op_8xy6:
+    shift_register_right_as(c8, x, y, CORE_PROFILE);
+    DISPATCH();
+op_8xy7:
+    subn_registers(c8, x, y);
+    DISPATCH();
+op_8xye:
+    shift_register_left_as(c8, x, y, CORE_PROFILE);
+    DISPATCH();
+op_9xy0:
+    if ((c8->current_opcode & 0xf) != 0)
+    {
+        goto unknown;
+    }
+    skip_if_reg_not_equal(c8, x, y);
+    DISPATCH();
+op_annn:
+    load_i_value(c8, c8->current_opcode);
+    DISPATCH();
+op_bnnn:
+    jump_reg_plus_value_as(c8, c8->current_opcode, CORE_PROFILE);
+    DISPATCH();
+op_cxkk:
+    set_reg_random_byte(c8, x, c8->current_opcode);
+    DISPATCH();
+op_dxyn:
+    display_sprite_as(c8, x, y, c8->current_opcode & 0xf, CORE_PROFILE);
+    DISPATCH();
+group_e:
+    switch (c8->current_opcode & 0xff)
+    {
+        case 0x9e:
+            skip_if_key_pressed(c8, x);
+            DISPATCH();
+        case 0xa1:
+            skip_if_key_not_pressed(c8, x);
+            DISPATCH();
+    }
+    goto unknown;
+group_f:
+    switch (c8->current_opcode & 0xff)
+    {
+        case 0x07:
+            delay_timer_to_reg(c8, x);
+            DISPATCH();
+        case 0x0a:
+            store_key_press(c8, x);
+            if (c8->stop_batch)
+            {
+                finish_cycle(c8);
+                return;
+            }
+            DISPATCH();
+        case 0x15:
+            set_delay_timer(c8, x);
+            DISPATCH();
+        case 0x18:
+            set_sound_timer(c8, x);
+            DISPATCH();
+        case 0x1e:
+            add_reg_to_i(c8, x);
+            DISPATCH();
+        case 0x29:
+            set_i_sprite_location(c8, x);
+            DISPATCH();
+        case 0x33:
+            store_bcd(c8, x);
+            DISPATCH();
+        case 0x55:
+            copy_reg_to_mem_as(c8, x, CORE_PROFILE);
+            DISPATCH();
+        case 0x65:
+            load_reg_from_mem_as(c8, x, CORE_PROFILE);
+            DISPATCH();
+    }
+    goto unknown;
+unknown:
+    {
+        struct decoded_op op;
+        decode_op(c8->current_opcode, CORE_PROFILE, &op);
+        op_unknown(c8, &op);
+        finish_cycle(c8);
+    }
+
+#undef DISPATCH
+#undef NEXT
+#else
+    for (uint32_t i = 0; i < count && !c8->stop_batch; i++)
+    {
+        c8->current_opcode = c8->memory[c8->reg_pc] << 8 | c8->memory[c8->reg_pc + 1];
+        PROFILE_STEP(c8);
+        CORE(decode_and_execute)(c8, c8->current_opcode);
+        finish_cycle(c8);
+    }
+#endif
+}
+
+// run instructions from the predecoded cache, decoding an entry only the
+// first time its address is executed or after it was overwritten
+static void CORE(execute_cached)(struct chip8 *c8, uint32_t count)
+{
+    c8->stop_batch = false;
+    for (uint32_t i = 0; i < count && !c8->stop_batch; i++)
+    {
+        if ((c8->reg_pc & 0x1) != 0 || c8->reg_pc > 4094)
+        {
+            // instructions at odd addresses are rare, decode them every time
+            c8->current_opcode = c8->memory[c8->reg_pc] << 8 | c8->memory[c8->reg_pc + 1];
+            PROFILE_STEP(c8);
+            CORE(decode_and_execute)(c8, c8->current_opcode);
+        }
+        else
+        {
+            struct decoded_op *op = &c8->decode_cache[c8->reg_pc >> 1];
+            if (op->handler == NULL)
+            {
+                decode_op(c8->memory[c8->reg_pc] << 8 | c8->memory[c8->reg_pc + 1], CORE_PROFILE, op);
+            }
+            c8->current_opcode = op->opcode;
+            PROFILE_STEP(c8);
+            op->handler(c8, op);
+        }
+        finish_cycle(c8);
+    }
+}
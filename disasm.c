@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "disasm.h"
+
+// an opcode matches an entry when (op & mask) == match. formats use %x and
+// %y for the register nibbles, %n for the last nibble, %k for the low byte
+// and %a for the low 12 bits
+struct mnemonic
+{
+    uint16_t mask;
+    uint16_t match;
+    const char *format;
+};
+
+static const struct mnemonic mnemonics[] =
+{
+    { 0xffff, 0x00e0, "CLS" },
+    { 0xffff, 0x00ee, "RET" },
+    { 0xf000, 0x1000, "JP %a" },
+    { 0xf000, 0x2000, "CALL %a" },
+    { 0xf000, 0x3000, "SE V%x, %k" },
+    { 0xf000, 0x4000, "SNE V%x, %k" },
+    { 0xf00f, 0x5000, "SE V%x, V%y" },
+    { 0xf000, 0x6000, "LD V%x, %k" },
+    { 0xf000, 0x7000, "ADD V%x, %k" },
+    { 0xf00f, 0x8000, "LD V%x, V%y" },
+    { 0xf00f, 0x8001, "OR V%x, V%y" },
+    { 0xf00f, 0x8002, "AND V%x, V%y" },
+    { 0xf00f, 0x8003, "XOR V%x, V%y" },
+    { 0xf00f, 0x8004, "ADD V%x, V%y" },
+    { 0xf00f, 0x8005, "SUB V%x, V%y" },
+    { 0xf00f, 0x8006, "SHR V%x {, V%y}" },
+    { 0xf00f, 0x8007, "SUBN V%x, V%y" },
+    { 0xf00f, 0x800e, "SHL V%x {, V%y}" },
+    { 0xf00f, 0x9000, "SNE V%x, V%y" },
+    { 0xf000, 0xa000, "LD I, %a" },
+    { 0xf000, 0xb000, "JP V0, %a" },
+    { 0xf000, 0xc000, "RND V%x, %k" },
+    { 0xf000, 0xd000, "DRW V%x, V%y, %n" },
+    { 0xf0ff, 0xe09e, "SKP V%x" },
+    { 0xf0ff, 0xe0a1, "SKNP V%x" },
+    { 0xf0ff, 0xf007, "LD V%x, DT" },
+    { 0xf0ff, 0xf00a, "LD V%x, K" },
+    { 0xf0ff, 0xf015, "LD DT, V%x" },
+    { 0xf0ff, 0xf018, "LD ST, V%x" },
+    { 0xf0ff, 0xf01e, "ADD I, V%x" },
+    { 0xf0ff, 0xf029, "LD F, V%x" },
+    { 0xf0ff, 0xf033, "LD B, V%x" },
+    { 0xf0ff, 0xf055, "LD [I], V%x" },
+    { 0xf0ff, 0xf065, "LD V%x, [I]" },
+};
+
+#define MNEMONIC_COUNT (sizeof(mnemonics) / sizeof(mnemonics[0]))
+
+_Static_assert(MNEMONIC_COUNT == DISASM_CLASS_UNKNOWN, "DISASM_CLASS_UNKNOWN must match the mnemonic table");
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static const struct mnemonic *find_mnemonic(uint16_t op)
+{
+    for (size_t i = 0; i < MNEMONIC_COUNT; i++)
+    {
+        if ((op & mnemonics[i].mask) == mnemonics[i].match)
+        {
+            return &mnemonics[i];
+        }
+    }
+    return NULL;
+}
+
+// value in hex without leading zeros, as printf's %X would
+static int put_hex(char *buffer, unsigned int value)
+{
+    char digits[8];
+    int count = 0;
+    do
+    {
+        digits[count++] = hex_digits[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+
+    for (int i = 0; i < count; i++)
+    {
+        buffer[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+int format_op(uint16_t op, char *buffer)
+{
+    const struct mnemonic *mnemonic = find_mnemonic(op);
+    const char *format = mnemonic != NULL ? mnemonic->format : "Unknown";
+
+    int length = 0;
+    for (const char *c = format; *c != '\0'; c++)
+    {
+        if (*c != '%')
+        {
+            buffer[length++] = *c;
+            continue;
+        }
+        c++;
+        switch (*c)
+        {
+        case 'x':
+            buffer[length++] = hex_digits[(op >> 8) & 0xf];
+            break;
+        case 'y':
+            buffer[length++] = hex_digits[(op >> 4) & 0xf];
+            break;
+        case 'n':
+            buffer[length++] = hex_digits[op & 0xf];
+            break;
+        case 'k':
+            length += put_hex(buffer + length, op & 0xff);
+            break;
+        case 'a':
+            length += put_hex(buffer + length, op & 0xfff);
+            break;
+        }
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+int opcode_class(uint16_t op)
+{
+    const struct mnemonic *mnemonic = find_mnemonic(op);
+    return mnemonic != NULL ? (int)(mnemonic - mnemonics) : DISASM_CLASS_UNKNOWN;
+}
+
+int format_class(int op_class, char *buffer)
+{
+    if (op_class < 0 || op_class >= DISASM_CLASS_UNKNOWN)
+    {
+        return sprintf(buffer, "Unknown");
+    }
+
+    // the operands keep the names the instruction set documents use
+    int length = 0;
+    for (const char *c = mnemonics[op_class].format; *c != '\0'; c++)
+    {
+        if (*c != '%')
+        {
+            buffer[length++] = *c;
+            continue;
+        }
+        c++;
+        const char *operand = *c == 'x' ? "x" : *c == 'y' ? "y" : *c == 'n' ? "n" : *c == 'k' ? "kk" : "nnn";
+        length += sprintf(buffer + length, "%s", operand);
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+void disassemble(uint16_t op, FILE *f)
+{
+    char buffer[DISASM_OP_MAX];
+    int length = format_op(op, buffer);
+    buffer[length++] = '\n';
+    fwrite(buffer, 1, length, f);
+}
+
+void disasm_init(struct disassembly *d)
+{
+    memset(d, 0, sizeof(struct disassembly));
+}
+
+void disasm_free(struct disassembly *d)
+{
+    free(d->xrefs);
+    free(d->text);
+    disasm_init(d);
+}
+
+static void add_xref(struct disassembly *d, uint16_t from, uint16_t to)
+{
+    if (d->xref_count == d->xref_capacity)
+    {
+        size_t capacity = d->xref_capacity == 0 ? 256 : d->xref_capacity * 2;
+        struct xref *xrefs = realloc(d->xrefs, capacity * sizeof(struct xref));
+        if (xrefs == NULL)
+        {
+            d->failed = true;
+            return;
+        }
+        d->xrefs = xrefs;
+        d->xref_capacity = capacity;
+    }
+    d->xrefs[d->xref_count].from = from;
+    d->xrefs[d->xref_count].to = to;
+    d->xref_count++;
+}
+
+static int compare_xrefs(const void *a, const void *b)
+{
+    const struct xref *x = a;
+    const struct xref *y = b;
+    if (x->to != y->to)
+    {
+        return x->to - y->to;
+    }
+    return x->from - y->from;
+}
+
+// make sure the listing has room for another length bytes, false if out of
+// memory
+static bool reserve(struct disassembly *d, size_t length)
+{
+    if (d->length + length + 1 > d->capacity)
+    {
+        size_t capacity = d->capacity;
+        while (d->length + length + 1 > capacity)
+        {
+            capacity = capacity == 0 ? 16384 : capacity * 2;
+        }
+        char *text = realloc(d->text, capacity);
+        if (text == NULL)
+        {
+            d->failed = true;
+            return false;
+        }
+        d->text = text;
+        d->capacity = capacity;
+    }
+    return true;
+}
+
+static void append(struct disassembly *d, const char *text, size_t length)
+{
+    if (!reserve(d, length))
+    {
+        return;
+    }
+    memcpy(d->text + d->length, text, length);
+    d->length += length;
+}
+
+static void append_address(struct disassembly *d, uint16_t address)
+{
+    char digits[4] =
+    {
+        hex_digits[(address >> 12) & 0xf],
+        hex_digits[(address >> 8) & 0xf],
+        hex_digits[(address >> 4) & 0xf],
+        hex_digits[address & 0xf]
+    };
+    append(d, digits, 4);
+}
+
+// label line for address, with the instructions that refer to it
+static void append_label(struct disassembly *d, uint16_t address, size_t *next_xref)
+{
+    uint8_t flags = d->flags[address];
+    if (flags & DISASM_CALL)
+    {
+        append(d, "\n; subroutine\nsub_", 18);
+    }
+    else if (flags & DISASM_JUMP)
+    {
+        append(d, "label_", 6);
+    }
+    else
+    {
+        append(d, "data_", 5);
+    }
+    append_address(d, address);
+    append(d, ":", 1);
+
+    // xrefs are sorted by target, so the ones for this label are next
+    while (*next_xref < d->xref_count && d->xrefs[*next_xref].to < address)
+    {
+        (*next_xref)++;
+    }
+    bool first = true;
+    while (*next_xref < d->xref_count && d->xrefs[*next_xref].to == address)
+    {
+        append(d, first ? " ; from " : " ", first ? 8 : 1);
+        append_address(d, d->xrefs[*next_xref].from);
+        first = false;
+        (*next_xref)++;
+    }
+    append(d, "\n", 1);
+}
+
+// mark the instructions reachable from 0x200
+static void follow_control_flow(struct disassembly *d, const uint8_t *memory, uint16_t end)
+{
+    uint16_t pending[4096];
+    int pending_count = 0;
+    pending[pending_count++] = 0x200;
+    d->flags[0x200] |= DISASM_QUEUED;
+
+    while (pending_count > 0)
+    {
+        uint16_t address = pending[--pending_count];
+
+        // walk straight-line code until the path ends or joins code that
+        // has already been followed
+        while (address >= 0x200 && address + 1 < end && !(d->flags[address] & DISASM_CODE))
+        {
+            uint16_t op = memory[address] << 8 | memory[address + 1];
+            if (find_mnemonic(op) == NULL)
+            {
+                // not an instruction, so this path ran into data
+                break;
+            }
+            d->flags[address] |= DISASM_CODE;
+            d->flags[address + 1] |= DISASM_OPERAND;
+
+            uint16_t target = 0xffff;
+            bool falls_through = true;
+            bool skips = false;
+            switch (op >> 12)
+            {
+            case 0x0:
+                falls_through = op != 0x00ee;
+                break;
+            case 0x1:
+                target = op & 0xfff;
+                d->flags[target] |= DISASM_JUMP;
+                falls_through = false;
+                break;
+            case 0x2:
+                target = op & 0xfff;
+                d->flags[target] |= DISASM_CALL;
+                break;
+            case 0x3:
+            case 0x4:
+            case 0x5:
+            case 0x9:
+            case 0xe:
+                skips = true;
+                break;
+            case 0xa:
+                // only label data inside the program, not the font
+                if ((op & 0xfff) >= 0x200 && (op & 0xfff) < end)
+                {
+                    d->flags[op & 0xfff] |= DISASM_DATA;
+                    add_xref(d, address, op & 0xfff);
+                }
+                break;
+            case 0xb:
+                // the jump goes somewhere past nnn, follow the V0 = 0 case
+                target = op & 0xfff;
+                d->flags[target] |= DISASM_JUMP;
+                falls_through = false;
+                break;
+            }
+
+            if (target != 0xffff)
+            {
+                add_xref(d, address, target);
+                if (!(d->flags[target] & (DISASM_CODE | DISASM_QUEUED)))
+                {
+                    d->flags[target] |= DISASM_QUEUED;
+                    pending[pending_count++] = target;
+                }
+            }
+            if (skips && address + 4 < 4096 && !(d->flags[address + 4] & (DISASM_CODE | DISASM_QUEUED)))
+            {
+                d->flags[address + 4] |= DISASM_QUEUED;
+                pending[pending_count++] = address + 4;
+            }
+            if (!falls_through)
+            {
+                break;
+            }
+            address += 2;
+        }
+    }
+}
+
+bool disassemble_program(struct disassembly *d, const uint8_t *memory, size_t size)
+{
+    if (size > 4096 - 0x200)
+    {
+        return false;
+    }
+    uint16_t end = 0x200 + size;
+    memset(d->flags, 0, sizeof(d->flags));
+    d->xref_count = 0;
+    d->length = 0;
+    d->failed = false;
+
+    follow_control_flow(d, memory, end);
+    qsort(d->xrefs, d->xref_count, sizeof(struct xref), compare_xrefs);
+
+    size_t next_xref = 0;
+    uint16_t address = 0x200;
+    while (address < end && !d->failed)
+    {
+        uint8_t flags = d->flags[address];
+        if (flags & (DISASM_JUMP | DISASM_CALL | DISASM_DATA))
+        {
+            append_label(d, address, &next_xref);
+        }
+
+        if (flags & DISASM_CODE)
+        {
+            // "0200: 00E0  CLS"
+            uint16_t op = memory[address] << 8 | memory[address + 1];
+            if (!reserve(d, 12 + DISASM_OP_MAX))
+            {
+                break;
+            }
+            append_address(d, address);
+            append(d, ": ", 2);
+            append_address(d, op);
+            append(d, "  ", 2);
+            d->length += format_op(op, d->text + d->length);
+            append(d, "\n", 1);
+            address += 2;
+            continue;
+        }
+
+        // "0300: db F0 90 90" up to 8 bytes, stopping at code or a label
+        append_address(d, address);
+        append(d, ": db", 4);
+        int count = 0;
+        do
+        {
+            char byte[3] = { ' ', hex_digits[memory[address] >> 4], hex_digits[memory[address] & 0xf] };
+            append(d, byte, 3);
+            address++;
+            count++;
+        } while (count < 8 && address < end &&
+                 !(d->flags[address] & (DISASM_CODE | DISASM_JUMP | DISASM_CALL | DISASM_DATA)));
+        append(d, "\n", 1);
+    }
+
+    if (d->failed || !reserve(d, 0))
+    {
+        return false;
+    }
+    d->text[d->length] = '\0';
+    return true;
+}
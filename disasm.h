@@ -0,0 +1,69 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+// disassembler that follows control flow from 0x200 to tell code from data,
+// and lists the program with labels, subroutines and cross references
+
+// what the control flow pass found at each address
+#define DISASM_CODE 0x01      // an instruction starts here
+#define DISASM_OPERAND 0x02   // second byte of an instruction
+#define DISASM_JUMP 0x04      // target of JP or JP V0
+#define DISASM_CALL 0x08      // start of a subroutine
+#define DISASM_DATA 0x10      // loaded into I
+#define DISASM_QUEUED 0x20    // waiting to be followed
+
+// address to_address refers to, from the instruction at from
+struct xref
+{
+    uint16_t from;
+    uint16_t to;
+};
+
+// results of disassembling a program. the buffers are kept between calls so
+// indexing many roms with one disassembly does not allocate per rom
+struct disassembly
+{
+    uint8_t flags[4096];
+
+    // sorted by target, then by source
+    struct xref *xrefs;
+    size_t xref_count;
+    size_t xref_capacity;
+
+    // the listing, nul terminated
+    char *text;
+    size_t length;
+    size_t capacity;
+
+    // set when a buffer could not grow, the results are incomplete
+    bool failed;
+};
+
+void disasm_init(struct disassembly *d);
+void disasm_free(struct disassembly *d);
+
+// follow control flow through a program of size bytes at 0x200 in memory
+// and format the listing into d->text. false if the rom does not fit or
+// out of memory
+bool disassemble_program(struct disassembly *d, const uint8_t *memory, size_t size);
+
+// write the mnemonic for one opcode into buffer, which must hold at least
+// DISASM_OP_MAX bytes. returns the length
+#define DISASM_OP_MAX 32
+int format_op(uint16_t op, char *buffer);
+
+// instructions grouped by mnemonic, one class per instruction handler
+// in the emulator. opcode_class gives DISASM_CLASS_UNKNOWN for an opcode
+// that is not an instruction, the last of DISASM_CLASS_COUNT classes
+#define DISASM_CLASS_UNKNOWN 34
+#define DISASM_CLASS_COUNT (DISASM_CLASS_UNKNOWN + 1)
+int opcode_class(uint16_t op);
+
+// write the mnemonic of a class with its operands named, e.g.
+// "ADD Vx, kk", into a buffer of DISASM_OP_MAX bytes. returns the length
+int format_class(int op_class, char *buffer);
+
+// write the mnemonic for one opcode and a newline to a file
+void disassemble(uint16_t op, FILE *f);
+
+#endif
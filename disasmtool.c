@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "disasm.h"
+
+// disassembles any number of roms, printing each listing or with --quiet
+// only the time taken, to index a rom library
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: ./chip8-disasm [rom] [more roms...] [--quiet]\n");
+        return EXIT_FAILURE;
+    }
+
+    bool quiet = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quiet") == 0)
+        {
+            quiet = true;
+        }
+    }
+
+    struct disassembly d;
+    disasm_init(&d);
+    uint8_t memory[4096];
+    int roms = 0;
+    double seconds = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quiet") == 0)
+        {
+            continue;
+        }
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL)
+        {
+            printf("unable to open rom %s\n", argv[i]);
+            continue;
+        }
+        memset(memory, 0, sizeof(memory));
+        size_t size = fread(memory + 0x200, 1, sizeof(memory) - 0x200, file);
+        fclose(file);
+
+        // only the disassembly itself is timed, not reading or printing
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        bool ok = disassemble_program(&d, memory, size);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!ok)
+        {
+            printf("unable to disassemble %s, out of memory\n", argv[i]);
+            disasm_free(&d);
+            return EXIT_FAILURE;
+        }
+        seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        roms++;
+
+        if (!quiet)
+        {
+            printf("; %s\n", argv[i]);
+            fwrite(d.text, 1, d.length, stdout);
+            printf("\n");
+        }
+    }
+
+    if (roms > 0)
+    {
+        fprintf(stderr, "disassembled %d roms in %.3f ms, %.1f us per rom\n",
+                roms, seconds * 1e3, seconds * 1e6 / roms);
+    }
+    disasm_free(&d);
+    return 0;
+}
@@ -0,0 +1,591 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "chip8.h"
+#include "jit.h"
+#include "snapshot.h"
+#include "explore.h"
+
+// the machine state outside memory: the fields before it and those after it
+// up to decode_cache, as snapshots lay it out
+#define FRONT_SIZE offsetof(struct chip8, memory)
+#define BACK_START offsetof(struct chip8, rom_size)
+#define BACK_SIZE (SNAPSHOT_STATE_SIZE - BACK_START)
+
+// a page of memory shared by every state that has not written to it. the
+// reference counts only change between levels, on the thread running the
+// search
+struct page
+{
+    uint32_t refs;
+    uint64_t hash;
+    uint8_t bytes[EXPLORE_PAGE_SIZE];
+};
+
+struct node
+{
+    // the state forked from and the key held since, for the path back
+    struct node *parent;
+    uint8_t key;
+    uint64_t cycle;
+
+    double score;
+    uint64_t hash;
+    bool duplicate;
+    bool failed;
+
+    // the state, released once it has been forked or dropped. pages the
+    // fork wrote are its own, the others its parent's
+    struct page *pages[EXPLORE_PAGES];
+    uint16_t own_pages;
+    uint8_t front[FRONT_SIZE];
+    uint8_t back[BACK_SIZE];
+    bool released;
+};
+
+// a worker thread and the machine it runs forks on. pages holds what its
+// memory was last loaded from or saved to, so the next fork only copies
+// the pages that differ
+struct worker
+{
+    pthread_t thread;
+    struct explore *explore;
+    struct chip8 *c8;
+    struct page *pages[EXPLORE_PAGES];
+    uint64_t pages_copied;
+    uint64_t instructions;
+};
+
+// one level of the search being run
+struct explore
+{
+    const struct explore_config *config;
+    struct node **frontier;
+    uint32_t frontier_count;
+    struct node *children;
+
+    // next fork to hand out
+    pthread_mutex_t lock;
+    uint32_t next;
+};
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+static struct page *new_page(const uint8_t *bytes)
+{
+    struct page *page = malloc(sizeof(struct page));
+    if (page == NULL)
+    {
+        return NULL;
+    }
+    page->refs = 1;
+    memcpy(page->bytes, bytes, EXPLORE_PAGE_SIZE);
+    page->hash = hash_bytes(0xcbf29ce484222325, bytes, EXPLORE_PAGE_SIZE);
+    return page;
+}
+
+static void release_node(struct node *node)
+{
+    if (node->released)
+    {
+        return;
+    }
+    node->released = true;
+    for (int p = 0; p < EXPLORE_PAGES; p++)
+    {
+        if (node->pages[p] != NULL && --node->pages[p]->refs == 0)
+        {
+            free(node->pages[p]);
+        }
+        node->pages[p] = NULL;
+    }
+}
+
+// what makes two states the same: memory, display and registers, but not
+// the instruction and frame counts, so a state reached again later is
+// still a repeat
+static uint64_t state_hash(const struct chip8 *c8, struct page *const *pages)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (int p = 0; p < EXPLORE_PAGES; p++)
+    {
+        hash = (hash ^ pages[p]->hash) * 0x100000001b3;
+    }
+    hash = hash_bytes(hash, c8->reg_vx, sizeof(c8->reg_vx));
+    hash = hash_bytes(hash, &c8->reg_i, sizeof(c8->reg_i));
+    hash = hash_bytes(hash, &c8->reg_delay, sizeof(c8->reg_delay));
+    hash = hash_bytes(hash, &c8->reg_sound, sizeof(c8->reg_sound));
+    hash = hash_bytes(hash, &c8->reg_pc, sizeof(c8->reg_pc));
+    hash = hash_bytes(hash, &c8->reg_sp, sizeof(c8->reg_sp));
+    hash = hash_bytes(hash, c8->stack, sizeof(c8->stack));
+    hash = hash_bytes(hash, c8->display, sizeof(c8->display));
+    hash = hash_bytes(hash, &c8->random_state, sizeof(c8->random_state));
+    hash = hash_bytes(hash, &c8->waiting_key, sizeof(c8->waiting_key));
+    return hash;
+}
+
+// put the state of a node on the worker's machine
+static void load_node(struct worker *worker, const struct node *node)
+{
+    struct chip8 *c8 = worker->c8;
+    memcpy(c8, node->front, FRONT_SIZE);
+    memcpy((uint8_t *)c8 + BACK_START, node->back, BACK_SIZE);
+    for (int p = 0; p < EXPLORE_PAGES; p++)
+    {
+        if (worker->pages[p] == node->pages[p])
+        {
+            continue;
+        }
+        memcpy(c8->memory + p * EXPLORE_PAGE_SIZE, node->pages[p]->bytes, EXPLORE_PAGE_SIZE);
+        invalidate_decode_cache(c8, p * EXPLORE_PAGE_SIZE, EXPLORE_PAGE_SIZE);
+        jit_invalidate(c8, p * EXPLORE_PAGE_SIZE, EXPLORE_PAGE_SIZE);
+        worker->pages[p] = node->pages[p];
+        worker->pages_copied++;
+    }
+}
+
+// save the worker's machine as a fork of parent, sharing the pages it left
+// as they were. false if out of memory
+static bool save_node(struct worker *worker, const struct node *parent, struct node *node)
+{
+    struct chip8 *c8 = worker->c8;
+    memcpy(node->front, c8, FRONT_SIZE);
+    memcpy(node->back, (uint8_t *)c8 + BACK_START, BACK_SIZE);
+    for (int p = 0; p < EXPLORE_PAGES; p++)
+    {
+        const uint8_t *bytes = c8->memory + p * EXPLORE_PAGE_SIZE;
+        if (memcmp(bytes, parent->pages[p]->bytes, EXPLORE_PAGE_SIZE) == 0)
+        {
+            node->pages[p] = parent->pages[p];
+            continue;
+        }
+        node->pages[p] = new_page(bytes);
+        if (node->pages[p] == NULL)
+        {
+            return false;
+        }
+        node->own_pages |= 1 << p;
+        worker->pages[p] = node->pages[p];
+    }
+    node->hash = state_hash(c8, node->pages);
+    return true;
+}
+
+// frames with the keys held still, as run_emulator runs them: a machine
+// waiting for a key spins for the rest of the frame
+static void run_frames(struct chip8 *c8, uint32_t frames)
+{
+    for (uint32_t f = 0; f < frames; f++)
+    {
+        uint32_t batch = c8->frame_cycles_left;
+        uint64_t start = c8->instruction_count;
+        execute_cycles(c8, batch, false);
+        if (c8->waiting_key)
+        {
+            finish_cycles(c8, batch - (uint32_t)(c8->instruction_count - start));
+        }
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *worker = arg;
+    struct explore *explore = worker->explore;
+    const struct explore_config *config = explore->config;
+    uint32_t total = explore->frontier_count * EXPLORE_BRANCHES;
+    for (;;)
+    {
+        pthread_mutex_lock(&explore->lock);
+        uint32_t fork = explore->next < total ? explore->next++ : total;
+        pthread_mutex_unlock(&explore->lock);
+        if (fork == total)
+        {
+            break;
+        }
+
+        // the forks of a parent are handed out together, so a worker mostly
+        // goes from one to the next copying only what the last one wrote
+        struct node *parent = explore->frontier[fork / EXPLORE_BRANCHES];
+        struct node *node = &explore->children[fork];
+        node->parent = parent;
+        node->key = fork % EXPLORE_BRANCHES;
+
+        load_node(worker, parent);
+        struct chip8 *c8 = worker->c8;
+        c8->keys = node->key == EXPLORE_NO_KEY ? 0 : 1 << node->key;
+        node->cycle = c8->instruction_count;
+        run_frames(c8, config->frames);
+        worker->instructions += c8->instruction_count - node->cycle;
+
+        if (!save_node(worker, parent, node))
+        {
+            node->failed = true;
+            continue;
+        }
+        node->score = config->score(c8, config->context);
+    }
+    return NULL;
+}
+
+// hashes of every state reached so far, open addressing with 0 for empty
+struct seen
+{
+    uint64_t *hashes;
+    size_t capacity;
+    size_t count;
+};
+
+// false if the hash was already there. the table has to have room for it,
+// see seen_reserve
+static bool seen_add(struct seen *seen, uint64_t hash)
+{
+    hash = hash != 0 ? hash : 1;
+    size_t i = hash & (seen->capacity - 1);
+    while (seen->hashes[i] != 0)
+    {
+        if (seen->hashes[i] == hash)
+        {
+            return false;
+        }
+        i = (i + 1) & (seen->capacity - 1);
+    }
+    seen->hashes[i] = hash;
+    seen->count++;
+    return true;
+}
+
+// grow the table so count more hashes keep it at most half full, false if
+// out of memory
+static bool seen_reserve(struct seen *seen, size_t count)
+{
+    size_t capacity = seen->capacity;
+    while ((seen->count + count) * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+    if (capacity == seen->capacity)
+    {
+        return true;
+    }
+    struct seen grown = { calloc(capacity, sizeof(uint64_t)), capacity, 0 };
+    if (grown.hashes == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < seen->capacity; i++)
+    {
+        if (seen->hashes[i] != 0)
+        {
+            seen_add(&grown, seen->hashes[i]);
+        }
+    }
+    free(seen->hashes);
+    *seen = grown;
+    return true;
+}
+
+// best score first, ties to the earlier fork so the search does not depend
+// on which thread ran what
+static int compare_nodes(const void *a, const void *b)
+{
+    const struct node *x = *(struct node *const *)a;
+    const struct node *y = *(struct node *const *)b;
+    if (x->score != y->score)
+    {
+        return x->score > y->score ? -1 : 1;
+    }
+    return x < y ? -1 : x > y;
+}
+
+// fork every state of the frontier and run the forks on the workers, then
+// count the pages the forks took from their parents, drop repeats and keep
+// the best of the rest as the next frontier
+static bool run_level(struct explore *explore, struct worker *workers, int worker_count, struct seen *seen,
+                      struct explore_result *result)
+{
+    const struct explore_config *config = explore->config;
+    uint32_t count = explore->frontier_count * EXPLORE_BRANCHES;
+    explore->children = calloc(count, sizeof(struct node));
+    if (explore->children == NULL)
+    {
+        return false;
+    }
+    explore->next = 0;
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        // pages of the last level may be gone
+        memset(workers[i].pages, 0, sizeof(workers[i].pages));
+        workers[i].explore = explore;
+    }
+    if (worker_count == 1)
+    {
+        worker_main(&workers[0]);
+    }
+    else
+    {
+        int started = 0;
+        while (started < worker_count &&
+               pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) == 0)
+        {
+            started++;
+        }
+        // a worker that could not start runs here, the forks are shared out
+        // as they are taken
+        if (started < worker_count)
+        {
+            worker_main(&workers[started]);
+        }
+        for (int i = 0; i < started; i++)
+        {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    // the pages forks share are counted here rather than on the workers
+    bool failed = false;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        struct node *node = &explore->children[i];
+        for (int p = 0; p < EXPLORE_PAGES; p++)
+        {
+            if (node->pages[p] != NULL && !(node->own_pages & (1 << p)))
+            {
+                node->pages[p]->refs++;
+                result->pages_shared++;
+            }
+        }
+        failed |= node->failed;
+    }
+    // room for every fork is made before any is dropped, so a repeat is
+    // never confused with running out of memory
+    struct node **kept = failed ? NULL : malloc(count * sizeof(struct node *));
+    if (kept == NULL || !seen_reserve(seen, count))
+    {
+        free(kept);
+        return false;
+    }
+    uint32_t kept_count = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        struct node *node = &explore->children[i];
+        result->forks++;
+        if (!seen_add(seen, node->hash))
+        {
+            node->duplicate = true;
+            result->duplicates++;
+            release_node(node);
+            continue;
+        }
+        kept[kept_count++] = node;
+    }
+
+    // the frontier has been forked, only the path through it is needed now
+    for (uint32_t i = 0; i < explore->frontier_count; i++)
+    {
+        release_node(explore->frontier[i]);
+    }
+    qsort(kept, kept_count, sizeof(struct node *), compare_nodes);
+    for (uint32_t i = config->beam; i < kept_count; i++)
+    {
+        release_node(kept[i]);
+    }
+    explore->frontier = kept;
+    explore->frontier_count = kept_count < config->beam ? kept_count : config->beam;
+    return true;
+}
+
+// the machine a node's state is of
+static struct chip8 *node_machine(const struct node *node)
+{
+    struct chip8 *c8 = create_emulator();
+    if (c8 == NULL)
+    {
+        return NULL;
+    }
+    memcpy(c8, node->front, FRONT_SIZE);
+    memcpy((uint8_t *)c8 + BACK_START, node->back, BACK_SIZE);
+    for (int p = 0; p < EXPLORE_PAGES; p++)
+    {
+        memcpy(c8->memory + p * EXPLORE_PAGE_SIZE, node->pages[p]->bytes, EXPLORE_PAGE_SIZE);
+    }
+    invalidate_decode_cache(c8, 0, sizeof(c8->memory));
+    return c8;
+}
+
+static bool set_path(const struct node *best, struct explore_result *result)
+{
+    for (const struct node *node = best; node->parent != NULL; node = node->parent)
+    {
+        result->steps++;
+    }
+    result->keys = malloc(result->steps + 1);
+    result->cycles = malloc((result->steps + 1) * sizeof(uint64_t));
+    if (result->keys == NULL || result->cycles == NULL)
+    {
+        return false;
+    }
+    uint32_t step = result->steps;
+    for (const struct node *node = best; node->parent != NULL; node = node->parent)
+    {
+        step--;
+        result->keys[step] = node->key;
+        result->cycles[step] = node->cycle;
+    }
+    result->score = best->score;
+    return true;
+}
+
+bool explore_run(const struct chip8 *start, const struct explore_config *config, struct explore_result *result)
+{
+    memset(result, 0, sizeof(struct explore_result));
+    int worker_count = config->threads > 0 ? config->threads : 1;
+    struct worker *workers = calloc(worker_count, sizeof(struct worker));
+    struct node *root = calloc(1, sizeof(struct node));
+    struct seen seen = { calloc(1024, sizeof(uint64_t)), 1024, 0 };
+    bool ok = workers != NULL && root != NULL && seen.hashes != NULL;
+
+    // the root owns all its pages
+    for (int p = 0; p < EXPLORE_PAGES && ok; p++)
+    {
+        root->pages[p] = new_page(start->memory + p * EXPLORE_PAGE_SIZE);
+        ok = root->pages[p] != NULL;
+    }
+    if (ok)
+    {
+        memcpy(root->front, start, FRONT_SIZE);
+        memcpy(root->back, (const uint8_t *)start + BACK_START, BACK_SIZE);
+        // the new table has room for the root
+        root->hash = state_hash(start, root->pages);
+        seen_add(&seen, root->hash);
+    }
+    for (int i = 0; i < worker_count && ok; i++)
+    {
+        workers[i].c8 = create_emulator();
+        ok = workers[i].c8 != NULL;
+        if (ok && dispatch_mode == DISPATCH_JIT)
+        {
+            jit_init(workers[i].c8);
+        }
+    }
+
+    // every level's forks are kept for the paths back to the root
+    struct node **levels = calloc(config->depth + 1, sizeof(struct node *));
+    struct node **frontiers = calloc(config->depth + 1, sizeof(struct node *));
+    uint32_t *counts = calloc(config->depth + 1, sizeof(uint32_t));
+    struct explore explore = { config, &root, 1, NULL };
+    pthread_mutex_init(&explore.lock, NULL);
+    const struct node *best = NULL;
+    ok = ok && levels != NULL && frontiers != NULL && counts != NULL;
+    for (uint32_t level = 0; level < config->depth && ok && explore.frontier_count > 0; level++)
+    {
+        counts[level] = explore.frontier_count * EXPLORE_BRANCHES;
+        ok = run_level(&explore, workers, worker_count, &seen, result);
+        levels[level] = explore.children;
+        frontiers[level] = ok ? (struct node *)explore.frontier : NULL;
+        if (!ok || explore.frontier_count == 0 || (best != NULL && explore.frontier[0]->score <= best->score))
+        {
+            continue;
+        }
+
+        // the state is released once forked, the machine is taken now
+        best = explore.frontier[0];
+        if (result->best != NULL)
+        {
+            destroy_emulator(result->best);
+        }
+        result->best = node_machine(best);
+        ok = result->best != NULL;
+    }
+    if (ok && best != NULL)
+    {
+        ok = set_path(best, result);
+    }
+
+    for (int i = 0; i < worker_count && workers != NULL; i++)
+    {
+        result->instructions += workers[i].instructions;
+        result->pages_copied += workers[i].pages_copied;
+        if (workers[i].c8 != NULL)
+        {
+            destroy_emulator(workers[i].c8);
+        }
+    }
+    if (root != NULL)
+    {
+        release_node(root);
+    }
+    for (uint32_t level = 0; levels != NULL && frontiers != NULL && counts != NULL && level <= config->depth; level++)
+    {
+        for (uint32_t i = 0; levels[level] != NULL && i < counts[level]; i++)
+        {
+            release_node(&levels[level][i]);
+        }
+        free(levels[level]);
+        free(frontiers[level]);
+    }
+    pthread_mutex_destroy(&explore.lock);
+    free(levels);
+    free(frontiers);
+    free(counts);
+    free(root);
+    free(seen.hashes);
+    free(workers);
+    return ok;
+}
+
+void explore_result_free(struct explore_result *result)
+{
+    free(result->keys);
+    free(result->cycles);
+    if (result->best != NULL)
+    {
+        destroy_emulator(result->best);
+    }
+    memset(result, 0, sizeof(struct explore_result));
+}
+
+bool explore_write_script(const struct explore_result *result, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        perror("unable to open input script");
+        return false;
+    }
+    fprintf(f, "# %u steps found by chip8-explore, score %g\n", result->steps, result->score);
+
+    // a key held across steps stays down, the events are only the changes
+    uint8_t held = EXPLORE_NO_KEY;
+    for (uint32_t step = 0; step < result->steps; step++)
+    {
+        uint8_t key = result->keys[step];
+        if (key == held)
+        {
+            continue;
+        }
+        if (held != EXPLORE_NO_KEY)
+        {
+            fprintf(f, "%llu %X up\n", (unsigned long long)result->cycles[step], held);
+        }
+        if (key != EXPLORE_NO_KEY)
+        {
+            fprintf(f, "%llu %X down\n", (unsigned long long)result->cycles[step], key);
+        }
+        held = key;
+    }
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
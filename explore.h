@@ -0,0 +1,68 @@
+#ifndef EXPLORE_H
+#define EXPLORE_H
+
+// state space search for automated playtesting. from a starting machine
+// every state is forked once per key held alone and once with no key, each
+// fork runs a number of frames, and a score callback picks the best forks
+// at each level to fork again, a beam search over key presses. forks share
+// the 256 byte pages of memory they did not write with the state they came
+// from, so only the register file and the pages a branch changed are
+// copied. forks that end in a state already seen, by a hash of memory,
+// display and registers, are dropped. the forks of a level run across
+// worker threads
+
+#define EXPLORE_PAGE_SIZE 256
+#define EXPLORE_PAGES (4096 / EXPLORE_PAGE_SIZE)
+
+// a fork holds one key down for its frames, or none
+#define EXPLORE_NO_KEY 16
+#define EXPLORE_BRANCHES 17
+
+struct explore_config
+{
+    // frames each fork runs for, and levels of forking
+    uint32_t frames;
+    uint32_t depth;
+
+    // forks kept at each level to fork again, the best scoring ones
+    uint32_t beam;
+
+    int threads;
+
+    // higher is better. called on the worker threads with the machine a
+    // fork ended in
+    double (*score)(const struct chip8 *c8, void *context);
+    void *context;
+};
+
+struct explore_result
+{
+    // keys of the best fork found and the instruction counts they went down
+    // at, from the starting machine on
+    uint32_t steps;
+    uint8_t *keys;
+    uint64_t *cycles;
+    double score;
+
+    // the machine in the best state, NULL if nothing was forked
+    struct chip8 *best;
+
+    uint64_t forks;
+    uint64_t duplicates;
+    uint64_t instructions;
+
+    // pages forks wrote and copied, and pages they shared
+    uint64_t pages_copied;
+    uint64_t pages_shared;
+};
+
+// search from the state of start, which is left as it is. false if out of
+// memory
+bool explore_run(const struct chip8 *start, const struct explore_config *config, struct explore_result *result);
+void explore_result_free(struct explore_result *result);
+
+// write the keys of the result as a headless input script, which replays
+// them on the starting machine. false if the file could not be written
+bool explore_write_script(const struct explore_result *result, const char *path);
+
+#endif
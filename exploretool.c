@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "chip8.h"
+#include "jit.h"
+#include "backend.h"
+#include "explore.h"
+
+// searches the key presses of a rom for the states that score best, to
+// playtest it or reach a part of it without playing there. the keys found
+// are written as a headless input script that replays them
+
+enum score_kind
+{
+    SCORE_PIXELS,
+    SCORE_BYTE,
+    SCORE_BCD
+};
+
+struct score
+{
+    enum score_kind kind;
+    uint16_t address;
+};
+
+static double score_state(const struct chip8 *c8, void *context)
+{
+    const struct score *score = context;
+    const uint8_t *bytes = c8->memory + score->address;
+    switch (score->kind)
+    {
+    case SCORE_BYTE:
+        return bytes[0];
+    case SCORE_BCD:
+        // three digits as Fx33 stores them, a score a game keeps to draw
+        return bytes[0] * 100 + bytes[1] * 10 + bytes[2];
+    default:
+    {
+        int pixels = 0;
+        for (int y = 0; y < 32; y++)
+        {
+            pixels += __builtin_popcountll(c8->display[y]);
+        }
+        return pixels;
+    }
+    }
+}
+
+static bool parse_score(const char *text, struct score *score)
+{
+    unsigned long address;
+    char *end;
+    if (strcmp(text, "pixels") == 0)
+    {
+        score->kind = SCORE_PIXELS;
+        return true;
+    }
+    if (strncmp(text, "byte:", 5) == 0)
+    {
+        score->kind = SCORE_BYTE;
+        address = strtoul(text + 5, &end, 0);
+    }
+    else if (strncmp(text, "bcd:", 4) == 0)
+    {
+        score->kind = SCORE_BCD;
+        address = strtoul(text + 4, &end, 0);
+    }
+    else
+    {
+        return false;
+    }
+    if (*end != '\0' || address > 4096 - 3)
+    {
+        return false;
+    }
+    score->address = address;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: ./chip8-explore [rom] [--frames=count] [--depth=count] [--beam=count]\n"
+               "       [--threads=count] [--score=pixels|byte:address|bcd:address] [--start=frames]\n"
+               "       [--seed=number] [--quirks=modern|vip|chip48|schip|xochip]\n"
+               "       [--dispatch=chain|table|threaded|cached|jit] [--script=file] [--dump-display=file]\n");
+        return EXIT_FAILURE;
+    }
+
+    struct chip8 *c8 = create_emulator();
+    if (c8 == NULL)
+    {
+        printf("out of memory\n");
+        return EXIT_FAILURE;
+    }
+    struct score score = { SCORE_PIXELS, 0 };
+    struct explore_config config = { 30, 20, 64, sysconf(_SC_NPROCESSORS_ONLN), score_state, &score };
+    uint32_t start_frames = 0;
+    const char *script_path = NULL;
+    const char *dump_path = NULL;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--frames=", 9) == 0)
+        {
+            config.frames = strtoul(argv[i] + 9, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--depth=", 8) == 0)
+        {
+            config.depth = strtoul(argv[i] + 8, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--beam=", 7) == 0)
+        {
+            config.beam = strtoul(argv[i] + 7, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            config.threads = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--score=", 8) == 0)
+        {
+            if (!parse_score(argv[i] + 8, &score))
+            {
+                printf("unknown score %s\n", argv[i] + 8);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "--start=", 8) == 0)
+        {
+            start_frames = strtoul(argv[i] + 8, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            seed_random(c8, strtoull(argv[i] + 7, NULL, 0));
+        }
+        else if (strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            enum quirk_profile quirks;
+            if (!parse_quirk_profile(argv[i] + 9, &quirks))
+            {
+                printf("unknown quirk profile %s\n", argv[i] + 9);
+                return EXIT_FAILURE;
+            }
+            set_quirk_profile(c8, quirks);
+        }
+        else if (strncmp(argv[i], "--dispatch=", 11) == 0)
+        {
+            if (!parse_dispatch_mode(argv[i] + 11, &dispatch_mode))
+            {
+                printf("unknown dispatch mode %s\n", argv[i] + 11);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "--script=", 9) == 0)
+        {
+            script_path = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--dump-display=", 15) == 0)
+        {
+            dump_path = argv[i] + 15;
+        }
+        else
+        {
+            printf("unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.frames == 0 || config.beam == 0)
+    {
+        printf("frames and beam must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+
+    reset_emulator(c8);
+    if (!load_rom(c8, argv[1]))
+    {
+        return EXIT_FAILURE;
+    }
+    if (dispatch_mode == DISPATCH_JIT)
+    {
+        jit_init(c8);
+    }
+
+    // no keys until the search starts, as a script replays it
+    for (uint32_t f = 0; f < start_frames; f++)
+    {
+        uint32_t batch = c8->frame_cycles_left;
+        uint64_t before = c8->instruction_count;
+        execute_cycles(c8, batch, false);
+        if (c8->waiting_key)
+        {
+            finish_cycles(c8, batch - (uint32_t)(c8->instruction_count - before));
+        }
+    }
+
+    struct timespec start_time;
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    struct explore_result result;
+    bool ok = explore_run(c8, &config, &result);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double seconds = (end_time.tv_sec - start_time.tv_sec) +
+                     (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    if (!ok)
+    {
+        printf("out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("forks: %llu, %llu repeats dropped\n",
+           (unsigned long long)result.forks, (unsigned long long)result.duplicates);
+    printf("instructions: %llu in %.3f s, %.1f M per second\n", (unsigned long long)result.instructions,
+           seconds, result.instructions / seconds / 1e6);
+    printf("pages: %llu copied, %llu shared\n",
+           (unsigned long long)result.pages_copied, (unsigned long long)result.pages_shared);
+    if (result.best == NULL)
+    {
+        printf("nothing explored\n");
+        return EXIT_SUCCESS;
+    }
+    printf("best: score %g after %u steps, %llu instructions\n", result.score, result.steps,
+           (unsigned long long)result.best->instruction_count);
+    printf("keys:");
+    for (uint32_t step = 0; step < result.steps; step++)
+    {
+        if (result.keys[step] == EXPLORE_NO_KEY)
+        {
+            printf(" -");
+        }
+        else
+        {
+            printf(" %X", result.keys[step]);
+        }
+    }
+    printf("\n");
+
+    if (script_path != NULL && !explore_write_script(&result, script_path))
+    {
+        return EXIT_FAILURE;
+    }
+    if (dump_path != NULL)
+    {
+        dump_display(result.best, dump_path);
+    }
+    explore_result_free(&result);
+    destroy_emulator(c8);
+    return EXIT_SUCCESS;
+}
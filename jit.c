@@ -0,0 +1,551 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include "chip8.h"
+#include "jit.h"
+#include "profile.h"
+#include "snapshot.h"
+
+// dynamic recompiler: straight-line runs of ALU and I register opcodes are
+// translated into native x86-64 blocks. a block ends at the first opcode it
+// cannot translate, or at a jump or skip which it translates as the final
+// instruction. calls, returns, DRW, key and timer opcodes are left to the
+// interpreter. Vx and I stay in the machine, the block addresses them through
+// pointers set up on entry so nothing has to be written back on exit.
+
+bool jit_verify = false;
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// longest run of instructions translated into one block
+#define JIT_MAX_BLOCK 64
+
+// size of the executable buffer holding all translated blocks
+#define JIT_CODE_SIZE (256 * 1024)
+
+// most code one block can take: about 30 bytes per instruction plus the
+// prologue
+#define JIT_MAX_BLOCK_CODE (JIT_MAX_BLOCK * 32 + 64)
+
+struct jit_block
+{
+    void (*code)(struct chip8 *c8);
+    uint16_t start;
+    uint16_t end;
+    uint16_t count;
+    uint16_t last_opcode;
+};
+
+// translations for one machine
+struct jit_state
+{
+    // translated block for each even address, or no_block when the
+    // instruction at that address cannot start a block
+    struct jit_block *blocks[2048];
+    struct jit_block block_pool[2048];
+    int block_pool_used;
+
+    // one bit per memory byte that is part of a translated block
+    uint8_t code_map[4096 / 8];
+
+    // never writable and executable at once: the pages a block is emitted
+    // into are made writable for the emission and executable after it
+    uint8_t *code_buffer;
+    size_t code_used;
+    uint8_t *emit_ptr;
+
+    // the same machine run through the interpreter, for jit_verify
+    struct chip8 *shadow;
+};
+
+static struct jit_block no_block;
+
+// change the protection of the pages holding code bytes start to end
+static bool protect_code(struct jit_state *jit, size_t start, size_t end, int prot)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t first = start & ~(page - 1);
+    if (mprotect(jit->code_buffer + first, end - first, prot) != 0)
+    {
+        perror("unable to change jit code protection");
+        return false;
+    }
+    return true;
+}
+
+static void emit(struct jit_state *jit, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    for (int i = 0; i < count; i++)
+    {
+        *jit->emit_ptr++ = (uint8_t)va_arg(args, int);
+    }
+    va_end(args);
+}
+
+static void emit_lea(struct jit_state *jit, uint8_t modrm, size_t offset)
+{
+    // lea reg, [rdi + offset]
+    uint32_t value = offset;
+    emit(jit, 3, 0x48, 0x8d, modrm);
+    memcpy(jit->emit_ptr, &value, 4);
+    jit->emit_ptr += 4;
+}
+
+static void emit_set_pc(struct jit_state *jit, uint16_t pc)
+{
+    // mov word [rdx], pc
+    emit(jit, 5, 0x66, 0xc7, 0x02, pc & 0xff, pc >> 8);
+}
+
+// emit a skip: pc is set to the next instruction, then moved past it when
+// the comparison in flags matches. jcc is the short jump that branches
+// around the skip
+static void emit_skip(struct jit_state *jit, uint16_t pc, uint8_t jcc)
+{
+    emit_set_pc(jit, pc + 2);
+    emit(jit, 2, jcc, 5);
+    emit_set_pc(jit, pc + 4);
+}
+
+// returns true if the opcode can be translated, terminates is set when it
+// has to be the last instruction of the block
+static bool translatable(uint16_t opcode, bool *terminates)
+{
+    uint8_t n = opcode & 0xf;
+    uint8_t kk = opcode & 0xff;
+    *terminates = false;
+
+    switch (opcode >> 12)
+    {
+        case 0x1:
+        case 0x3:
+        case 0x4:
+            *terminates = true;
+            return true;
+        case 0x5:
+        case 0x9:
+            *terminates = true;
+            return n == 0;
+        case 0x6:
+        case 0x7:
+        case 0xa:
+            return true;
+        case 0x8:
+            return n <= 0x7 || n == 0xe;
+        case 0xf:
+            return kk == 0x1e || kk == 0x29;
+    }
+    return false;
+}
+
+// the block is translated for the machine's quirk profile, see set_quirk_profile
+static void translate(struct jit_state *jit, uint16_t pc, uint16_t opcode, const struct quirks *quirks)
+{
+    uint8_t x = (opcode >> 8) & 0xf;
+    uint8_t y = (opcode >> 4) & 0xf;
+    uint8_t n = opcode & 0xf;
+    uint8_t kk = opcode & 0xff;
+    uint16_t nnn = opcode & 0xfff;
+
+    switch (opcode >> 12)
+    {
+        case 0x1:
+            emit_set_pc(jit, nnn);
+            break;
+        case 0x3:
+            // cmp byte [rdi+x], kk
+            emit(jit, 4, 0x80, 0x7f, x, kk);
+            emit_skip(jit, pc, 0x75);
+            break;
+        case 0x4:
+            emit(jit, 4, 0x80, 0x7f, x, kk);
+            emit_skip(jit, pc, 0x74);
+            break;
+        case 0x5:
+            // mov al, [rdi+x]; cmp al, [rdi+y]
+            emit(jit, 6, 0x8a, 0x47, x, 0x3a, 0x47, y);
+            emit_skip(jit, pc, 0x75);
+            break;
+        case 0x9:
+            emit(jit, 6, 0x8a, 0x47, x, 0x3a, 0x47, y);
+            emit_skip(jit, pc, 0x74);
+            break;
+        case 0x6:
+            // mov byte [rdi+x], kk
+            emit(jit, 4, 0xc6, 0x47, x, kk);
+            break;
+        case 0x7:
+            // add byte [rdi+x], kk
+            emit(jit, 4, 0x80, 0x47, x, kk);
+            break;
+        case 0xa:
+            // mov word [rsi], nnn
+            emit(jit, 5, 0x66, 0xc7, 0x06, nnn & 0xff, nnn >> 8);
+            break;
+        case 0x8:
+            // the handlers write Vf before the result, so Vx and Vy are
+            // reloaded after the flag store in case either of them is Vf
+            switch (n)
+            {
+                case 0x0:
+                    // mov al, [rdi+y]; mov [rdi+x], al
+                    emit(jit, 6, 0x8a, 0x47, y, 0x88, 0x47, x);
+                    break;
+                case 0x1:
+                    // mov al, [rdi+y]; or [rdi+x], al
+                    emit(jit, 6, 0x8a, 0x47, y, 0x08, 0x47, x);
+                    break;
+                case 0x2:
+                    emit(jit, 6, 0x8a, 0x47, y, 0x20, 0x47, x);
+                    break;
+                case 0x3:
+                    emit(jit, 6, 0x8a, 0x47, y, 0x30, 0x47, x);
+                    break;
+                case 0x4:
+                    // mov al, [rdi+x]; add al, [rdi+y]; setc cl; mov [rdi+15], cl
+                    emit(jit, 12, 0x8a, 0x47, x, 0x02, 0x47, y, 0x0f, 0x92, 0xc1, 0x88, 0x4f, 0x0f);
+                    // mov al, [rdi+y]; add [rdi+x], al
+                    emit(jit, 6, 0x8a, 0x47, y, 0x00, 0x47, x);
+                    break;
+                case 0x5:
+                    // mov al, [rdi+x]; cmp al, [rdi+y]; seta cl; mov [rdi+15], cl
+                    emit(jit, 12, 0x8a, 0x47, x, 0x3a, 0x47, y, 0x0f, 0x97, 0xc1, 0x88, 0x4f, 0x0f);
+                    // mov al, [rdi+y]; sub [rdi+x], al
+                    emit(jit, 6, 0x8a, 0x47, y, 0x28, 0x47, x);
+                    break;
+                case 0x6:
+                    if (quirks->shift_vy)
+                    {
+                        // mov al, [rdi+y]; and al, 1; mov [rdi+15], al
+                        emit(jit, 8, 0x8a, 0x47, y, 0x24, 0x01, 0x88, 0x47, 0x0f);
+                        // mov al, [rdi+y]; shr al, 1; mov [rdi+x], al
+                        emit(jit, 8, 0x8a, 0x47, y, 0xd0, 0xe8, 0x88, 0x47, x);
+                        break;
+                    }
+                    // mov al, [rdi+x]; and al, 1; mov [rdi+15], al; shr byte [rdi+x], 1
+                    emit(jit, 11, 0x8a, 0x47, x, 0x24, 0x01, 0x88, 0x47, 0x0f, 0xd0, 0x6f, x);
+                    break;
+                case 0x7:
+                    // mov al, [rdi+y]; cmp al, [rdi+x]; seta cl; mov [rdi+15], cl
+                    emit(jit, 12, 0x8a, 0x47, y, 0x3a, 0x47, x, 0x0f, 0x97, 0xc1, 0x88, 0x4f, 0x0f);
+                    // mov al, [rdi+y]; sub al, [rdi+x]; mov [rdi+x], al
+                    emit(jit, 9, 0x8a, 0x47, y, 0x2a, 0x47, x, 0x88, 0x47, x);
+                    break;
+                case 0xe:
+                    if (quirks->shift_vy)
+                    {
+                        // mov al, [rdi+y]; shr al, 7; mov [rdi+15], al
+                        emit(jit, 9, 0x8a, 0x47, y, 0xc0, 0xe8, 0x07, 0x88, 0x47, 0x0f);
+                        // mov al, [rdi+y]; shl al, 1; mov [rdi+x], al
+                        emit(jit, 8, 0x8a, 0x47, y, 0xd0, 0xe0, 0x88, 0x47, x);
+                        break;
+                    }
+                    // mov al, [rdi+x]; shr al, 7; mov [rdi+15], al; shl byte [rdi+x], 1
+                    emit(jit, 12, 0x8a, 0x47, x, 0xc0, 0xe8, 0x07, 0x88, 0x47, 0x0f, 0xd0, 0x67, x);
+                    break;
+            }
+            if (quirks->logic_clears_vf && n >= 0x1 && n <= 0x3)
+            {
+                // mov byte [rdi+15], 0
+                emit(jit, 4, 0xc6, 0x47, 0x0f, 0x00);
+            }
+            break;
+        case 0xf:
+            if (kk == 0x1e)
+            {
+                // movzx eax, word [rsi]; movzx ecx, byte [rdi+x]; add eax, ecx
+                emit(jit, 9, 0x0f, 0xb7, 0x06, 0x0f, 0xb6, 0x4f, x, 0x01, 0xc8);
+                // cmp eax, 0xfff; seta cl; mov [rdi+15], cl
+                emit(jit, 11, 0x3d, 0xff, 0x0f, 0x00, 0x00, 0x0f, 0x97, 0xc1, 0x88, 0x4f, 0x0f);
+                // movzx ecx, byte [rdi+x]; add word [rsi], cx
+                emit(jit, 7, 0x0f, 0xb6, 0x4f, x, 0x66, 0x01, 0x0e);
+            }
+            else
+            {
+                // movzx eax, byte [rdi+x]; lea eax, [rax+rax*4]; mov [rsi], ax
+                emit(jit, 10, 0x0f, 0xb6, 0x47, x, 0x8d, 0x04, 0x80, 0x66, 0x89, 0x06);
+            }
+            break;
+    }
+}
+
+static struct jit_block *compile_block(struct chip8 *c8, uint16_t start)
+{
+    struct jit_state *jit = c8->jit;
+    bool terminates;
+    uint16_t opcode = c8->memory[start] << 8 | c8->memory[start + 1];
+    if (!translatable(opcode, &terminates))
+    {
+        return &no_block;
+    }
+
+    if (jit->block_pool_used == 2048 || jit->code_used + JIT_MAX_BLOCK_CODE > JIT_CODE_SIZE)
+    {
+        jit_flush(c8);
+    }
+    if (!protect_code(jit, jit->code_used, jit->code_used + JIT_MAX_BLOCK_CODE, PROT_READ | PROT_WRITE))
+    {
+        return &no_block;
+    }
+
+    struct jit_block *block = &jit->block_pool[jit->block_pool_used++];
+    block->code = (void (*)(struct chip8 *))(jit->code_buffer + jit->code_used);
+    block->start = start;
+    block->count = 0;
+    jit->emit_ptr = jit->code_buffer + jit->code_used;
+
+    // the machine arrives in rdi, point rsi at I, rdx at pc and rdi at Vx
+    emit_lea(jit, 0xb7, offsetof(struct chip8, reg_i));
+    emit_lea(jit, 0x97, offsetof(struct chip8, reg_pc));
+    emit_lea(jit, 0xbf, offsetof(struct chip8, reg_vx));
+
+    uint16_t pc = start;
+    for (;;)
+    {
+        translate(jit, pc, opcode, &quirk_profiles[c8->quirks]);
+        block->last_opcode = opcode;
+        block->count++;
+        pc += 2;
+        if (terminates)
+        {
+            break;
+        }
+        if (block->count == JIT_MAX_BLOCK || pc > 4094)
+        {
+            emit_set_pc(jit, pc);
+            break;
+        }
+        opcode = c8->memory[pc] << 8 | c8->memory[pc + 1];
+        if (!translatable(opcode, &terminates))
+        {
+            emit_set_pc(jit, pc);
+            break;
+        }
+    }
+    // ret
+    emit(jit, 1, 0xc3);
+
+    // blocks already on the page the new one starts in went writable with
+    // it, they cannot run until it is executable again
+    size_t code_end = jit->emit_ptr - jit->code_buffer;
+    if (!protect_code(jit, jit->code_used, code_end, PROT_READ | PROT_EXEC))
+    {
+        jit_flush(c8);
+        return &no_block;
+    }
+
+    block->end = pc;
+    jit->code_used = code_end;
+    for (uint16_t i = start; i < pc; i++)
+    {
+        jit->code_map[i >> 3] |= 1 << (i & 0x7);
+    }
+    return block;
+}
+
+// run a block through the interpreter from the same starting state and make
+// sure both leave the whole machine the same
+static void verify_block(struct chip8 *c8, struct jit_block *block)
+{
+    struct jit_state *jit = c8->jit;
+    if (jit->shadow == NULL)
+    {
+        jit->shadow = create_emulator();
+        if (jit->shadow == NULL)
+        {
+            perror("unable to allocate jit verify machine");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct chip8 *shadow = jit->shadow;
+    c8->reg_pc = block->start;
+    memcpy(shadow, c8, SNAPSHOT_STATE_SIZE);
+
+    block->code(c8);
+
+    // the shadow has no profile, so the block is profiled once by the
+    // caller and not again here
+    for (int i = 0; i < block->count; i++)
+    {
+        decode_chain(shadow, shadow->memory[shadow->reg_pc] << 8 | shadow->memory[shadow->reg_pc + 1]);
+    }
+
+    const char *difference = snapshot_difference(c8, shadow);
+    if (difference != NULL)
+    {
+        printf("jit mismatch in block %X-%X, %s differs: pc=%X/%X I=%X/%X\n",
+               block->start, block->end, difference, c8->reg_pc, shadow->reg_pc, c8->reg_i, shadow->reg_i);
+        for (int i = 0; i < 16; i++)
+        {
+            printf("V%X=%X/%X ", i, c8->reg_vx[i], shadow->reg_vx[i]);
+        }
+        printf("\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool jit_init(struct chip8 *c8)
+{
+    if (c8->jit == NULL)
+    {
+        void *buffer = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED)
+        {
+            perror("unable to map jit code buffer");
+            return false;
+        }
+        struct jit_state *jit = malloc(sizeof(struct jit_state));
+        if (jit == NULL)
+        {
+            perror("unable to allocate jit state");
+            munmap(buffer, JIT_CODE_SIZE);
+            return false;
+        }
+        jit->code_buffer = buffer;
+        jit->shadow = NULL;
+        c8->jit = jit;
+    }
+    jit_flush(c8);
+    return true;
+}
+
+void jit_cleanup(struct chip8 *c8)
+{
+    if (c8->jit != NULL)
+    {
+        munmap(c8->jit->code_buffer, JIT_CODE_SIZE);
+        if (c8->jit->shadow != NULL)
+        {
+            destroy_emulator(c8->jit->shadow);
+        }
+        free(c8->jit);
+        c8->jit = NULL;
+    }
+}
+
+void jit_flush(struct chip8 *c8)
+{
+    struct jit_state *jit = c8->jit;
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->code_map, 0, sizeof(jit->code_map));
+    jit->block_pool_used = 0;
+    jit->code_used = 0;
+}
+
+void jit_invalidate(struct chip8 *c8, uint16_t address, uint16_t length)
+{
+    if (c8->jit == NULL)
+    {
+        return;
+    }
+
+    // writes into translated code are rare, so rather than tracking which
+    // blocks overlap the write the whole cache is thrown away
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint16_t byte = (address + i) & 0xfff;
+        if (c8->jit->code_map[byte >> 3] & (1 << (byte & 0x7)))
+        {
+            jit_flush(c8);
+            return;
+        }
+    }
+}
+
+void execute_jit(struct chip8 *c8, uint32_t count)
+{
+    struct jit_state *jit = c8->jit;
+    if (jit == NULL)
+    {
+        execute_cached(c8, count);
+        return;
+    }
+
+    c8->stop_batch = false;
+    while (count > 0 && !c8->stop_batch)
+    {
+        struct jit_block *block = NULL;
+        if ((c8->reg_pc & 0x1) == 0 && c8->reg_pc <= 4094)
+        {
+            block = jit->blocks[c8->reg_pc >> 1];
+            if (block == NULL)
+            {
+                block = compile_block(c8, c8->reg_pc);
+                jit->blocks[c8->reg_pc >> 1] = block;
+            }
+        }
+
+        if (block != NULL && block != &no_block && block->count <= count)
+        {
+            if (jit_verify)
+            {
+                verify_block(c8, block);
+            }
+            else
+            {
+                block->code(c8);
+            }
+            c8->current_opcode = block->last_opcode;
+            PROFILE_BLOCK(c8, block->start, block->count);
+
+            // no translated opcode reads the timers, so they can be caught
+            // up once for the whole block
+            finish_cycles(c8, block->count);
+            count -= block->count;
+
+            // a translated jump does not go through jump_instruction, check
+            // here whether it landed on an idle loop
+            if (c8->skip_idle && (block->last_opcode & 0xf000) == 0x1000 &&
+                c8->reg_pc == (block->last_opcode & 0xfff) && at_idle_loop(c8))
+            {
+                c8->stop_batch = true;
+            }
+        }
+        else
+        {
+            c8->current_opcode = c8->memory[c8->reg_pc] << 8 | c8->memory[c8->reg_pc + 1];
+            PROFILE_STEP(c8);
+            decode_and_execute(c8, c8->current_opcode);
+            finish_cycle(c8);
+            count--;
+        }
+    }
+}
+
+#else
+
+// no native code generator for this host, the jit mode runs the predecoded
+// interpreter instead
+
+bool jit_init(struct chip8 *c8)
+{
+    return false;
+}
+
+void jit_cleanup(struct chip8 *c8)
+{
+}
+
+void jit_flush(struct chip8 *c8)
+{
+}
+
+void jit_invalidate(struct chip8 *c8, uint16_t address, uint16_t length)
+{
+}
+
+void execute_jit(struct chip8 *c8, uint32_t count)
+{
+    execute_cached(c8, count);
+}
+
+#endif
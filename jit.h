@@ -0,0 +1,14 @@
+#ifndef JIT_H
+#define JIT_H
+
+// when set every native block is also run through the interpreter and the
+// results compared, stopping the emulator on the first difference
+extern bool jit_verify;
+
+bool jit_init(struct chip8 *c8);
+void jit_cleanup(struct chip8 *c8);
+void jit_flush(struct chip8 *c8);
+void jit_invalidate(struct chip8 *c8, uint16_t address, uint16_t length);
+void execute_jit(struct chip8 *c8, uint32_t count);
+
+#endif
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "chip8.h"
+#include "jit.h"
+#include "snapshot.h"
+#include "randrom.h"
+
+// checks the jit against the interpreter. random programs, see randrom.h,
+// and any roms given are run as every quirk profile on two machines, one
+// translating blocks and one predecoding. the whole machine is compared
+// after every batch, and each program runs a second time with jit_verify
+// checking every block as it runs
+
+static uint64_t random_state;
+
+// run count instructions with the keys held still, as libchip8 does
+static void run_batch(struct chip8 *c8, uint32_t count)
+{
+    uint64_t start = c8->instruction_count;
+    execute_cycles(c8, count, false);
+    if (c8->waiting_key)
+    {
+        finish_cycles(c8, count - (uint32_t)(c8->instruction_count - start));
+    }
+}
+
+// run a program on a machine with the jit and one without, false if their
+// states ever differ
+static bool check_program(const char *name, const uint8_t *code, size_t size, enum quirk_profile quirks,
+                          uint64_t cycles, uint64_t *instructions)
+{
+    struct chip8 *machines[2] = { create_emulator(), create_emulator() };
+    if (machines[0] == NULL || machines[1] == NULL)
+    {
+        printf("out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int m = 0; m < 2; m++)
+    {
+        set_quirk_profile(machines[m], quirks);
+        seed_random(machines[m], size);
+        reset_emulator(machines[m]);
+        load_rom_data(machines[m], code, size);
+    }
+    if (!jit_init(machines[0]))
+    {
+        printf("the jit is not available on this host\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bool ok = true;
+    while (machines[0]->instruction_count < cycles && !machines[0]->halted)
+    {
+        uint16_t keys = random_below(&random_state, 4) == 0 ? 1 << random_below(&random_state, 16) : 0;
+        uint32_t count = 1 + random_below(&random_state, 200);
+        for (int m = 0; m < 2; m++)
+        {
+            machines[m]->keys = keys;
+            run_batch(machines[m], count);
+        }
+        const char *difference = snapshot_difference(machines[0], machines[1]);
+        if (difference != NULL)
+        {
+            printf("%s as %s%s: %s differs after %llu instructions, pc %03X/%03X\n", name,
+                   quirk_profile_name(quirks), jit_verify ? " verified" : "", difference,
+                   (unsigned long long)machines[1]->instruction_count, machines[0]->reg_pc,
+                   machines[1]->reg_pc);
+            ok = false;
+            break;
+        }
+    }
+    *instructions += machines[0]->instruction_count;
+    destroy_emulator(machines[0]);
+    destroy_emulator(machines[1]);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t program_count = 100;
+    uint64_t cycles = 20000;
+    uint64_t seed = 1;
+    const char **rom_paths = calloc(argc, sizeof(char *));
+    int rom_count = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--programs=", 11) == 0)
+        {
+            program_count = strtoul(argv[i] + 11, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--cycles=", 9) == 0)
+        {
+            cycles = strtoull(argv[i] + 9, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            seed = strtoull(argv[i] + 7, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("usage: ./chip8-jitcheck [rom...] [--programs=count] [--cycles=count] [--seed=number]\n");
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            rom_paths[rom_count++] = argv[i];
+        }
+    }
+    random_state = seed != 0 ? seed : 1;
+
+    // the machine built without a jit runs the predecoded interpreter
+    dispatch_mode = DISPATCH_JIT;
+
+    int failures = 0;
+    uint32_t checked = 0;
+    uint64_t instructions = 0;
+    struct random_rom *program = malloc(sizeof(struct random_rom));
+    for (uint32_t i = 0; i < program_count + rom_count; i++)
+    {
+        char name[64];
+        const char *label = name;
+        if (i < program_count)
+        {
+            random_rom_generate(program, &random_state);
+            snprintf(name, sizeof(name), "program %u", i);
+        }
+        else
+        {
+            label = rom_paths[i - program_count];
+            FILE *f = fopen(label, "rb");
+            if (f == NULL)
+            {
+                printf("unable to open rom %s\n", label);
+                return EXIT_FAILURE;
+            }
+            program->size = fread(program->code, 1, sizeof(program->code), f);
+            fclose(f);
+        }
+        for (int quirks = 0; quirks < QUIRK_PROFILE_COUNT; quirks++)
+        {
+            for (int verify = 0; verify < 2; verify++)
+            {
+                jit_verify = verify;
+                if (!check_program(label, program->code, program->size, quirks, cycles, &instructions))
+                {
+                    failures++;
+                }
+                checked++;
+            }
+        }
+    }
+
+    printf("jit checked against the interpreter: %u runs, %llu instructions, %d differ\n", checked,
+           (unsigned long long)instructions, failures);
+    free(program);
+    free(rom_paths);
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,912 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "chip8.h"
+#include "jit.h"
+#include "lanes.h"
+
+// the rows are worked on a block of LANE_BLOCK lanes at a time with gcc
+// vector extensions, 16 bytes of 8 bit registers or 32 bytes of 16 bit ones.
+// on x86-64 Linux step_batch is built twice, for AVX2 and for the SSE2 every
+// x86-64 has, and the loader picks the one the host runs. a lane's pc stays
+// inside the 4K of memory, wrapping at the end of it
+
+#if defined(__x86_64__) && defined(__linux__)
+#define LANES_TARGETS __attribute__((target_clones("avx2", "default")))
+#else
+#define LANES_TARGETS
+#endif
+
+// the helpers step_batch runs for every instruction are inlined into it, so
+// each of its builds gets them with its own instruction set
+#define LANES_INLINE static inline __attribute__((always_inline))
+
+// a lane that is not running in the current round. pcs, instruction counts
+// and this stay below 0x8000, see less_u16
+#define NO_PC 0x7fff
+
+// no lane at the pc run_step was given
+#define NO_OPCODE 0x10000
+
+typedef uint8_t vec_u8 __attribute__((vector_size(LANE_BLOCK)));
+typedef int8_t vec_m8 __attribute__((vector_size(LANE_BLOCK)));
+typedef uint16_t vec_u16 __attribute__((vector_size(LANE_BLOCK * 2)));
+typedef int16_t vec_m16 __attribute__((vector_size(LANE_BLOCK * 2)));
+
+LANES_INLINE vec_u8 load_u8(const uint8_t *p)
+{
+    vec_u8 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+LANES_INLINE vec_u16 load_u16(const uint16_t *p)
+{
+    vec_u16 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// value in every lane. filled in through memory as gcc builds the vector
+// plus scalar form one lane at a time in a function with a target attribute
+LANES_INLINE vec_u8 splat_u8(uint8_t value)
+{
+    uint8_t lanes[LANE_BLOCK];
+    for (int i = 0; i < LANE_BLOCK; i++)
+    {
+        lanes[i] = value;
+    }
+    return load_u8(lanes);
+}
+
+LANES_INLINE vec_u16 splat_u16(uint16_t value)
+{
+    uint16_t lanes[LANE_BLOCK];
+    for (int i = 0; i < LANE_BLOCK; i++)
+    {
+        lanes[i] = value;
+    }
+    return load_u16(lanes);
+}
+
+// a mask has every bit of a lane set when the lane takes part
+LANES_INLINE vec_m16 widen_mask(vec_m8 m)
+{
+    return __builtin_convertvector(m, vec_m16);
+}
+
+LANES_INLINE vec_u16 widen_u8(vec_u8 v)
+{
+    return __builtin_convertvector(v, vec_u16);
+}
+
+// a < b for values below 0x8000, and a == b. gcc compares 16 bit vectors
+// wider than the target's registers one element at a time, the sign of the
+// difference splits into halves for SSE2 as well
+LANES_INLINE vec_m16 less_u16(vec_u16 a, vec_u16 b)
+{
+    return (vec_m16)(a - b) >> 15;
+}
+
+LANES_INLINE vec_m16 equal_u16(vec_u16 a, vec_u16 b)
+{
+    vec_m16 difference = (vec_m16)(a ^ b);
+    return ~((difference | -difference) >> 15);
+}
+
+LANES_INLINE bool any_lane(vec_m8 m)
+{
+    uint64_t words[LANE_BLOCK / 8];
+    memcpy(words, &m, sizeof(words));
+    uint64_t any = 0;
+    for (int i = 0; i < LANE_BLOCK / 8; i++)
+    {
+        any |= words[i];
+    }
+    return any != 0;
+}
+
+// 1 << (n & 0xf), from shifts by constants as there is no 16 bit shift by
+// a vector of counts before AVX-512
+LANES_INLINE vec_u16 key_bit(vec_u16 n)
+{
+    vec_u16 bit = splat_u16(1);
+    for (int b = 0; b < 4; b++)
+    {
+        vec_u16 set = -((n >> b) & 1);
+        bit = ((bit << (1 << b)) & set) | (bit & ~set);
+    }
+    return bit;
+}
+
+// the first lane in a mask with any
+LANES_INLINE int first_lane(vec_m8 m)
+{
+    int first = 0;
+    while (m[first] == 0)
+    {
+        first++;
+    }
+    return first;
+}
+
+// write value to the lanes in the mask, leaving the others as they are
+LANES_INLINE void update_u8(uint8_t *p, vec_m8 m, vec_u8 value)
+{
+    vec_u8 v = (value & (vec_u8)m) | (load_u8(p) & ~(vec_u8)m);
+    memcpy(p, &v, sizeof(v));
+}
+
+LANES_INLINE void update_u16(uint16_t *p, vec_m16 m, vec_u16 value)
+{
+    vec_u16 v = (value & (vec_u16)m) | (load_u16(p) & ~(vec_u16)m);
+    memcpy(p, &v, sizeof(v));
+}
+
+// lay the arrays out one after another from base, each on a 64 byte line so
+// every block of a row is one aligned load. returns the bytes needed, with
+// no base it only counts them
+static size_t place_arrays(struct chip8_lanes *lanes, uint8_t *base)
+{
+    size_t w = lanes->width;
+    size_t used = 0;
+#define PLACE(array, bytes) \
+    lanes->array = base != NULL ? (void *)(base + used) : NULL; \
+    used += ((bytes) + 63) & ~(size_t)63
+
+    PLACE(reg_vx, 16 * w);
+    PLACE(reg_i, 2 * w);
+    PLACE(reg_delay, w);
+    PLACE(reg_sound, w);
+    PLACE(reg_pc, 2 * w);
+    PLACE(reg_sp, w);
+    PLACE(stack, 16 * 2 * w);
+    PLACE(memory, 4096 * w);
+    PLACE(rom_size, 2 * w);
+    PLACE(display, 32 * 8 * w);
+    PLACE(current_opcode, 2 * w);
+    PLACE(instruction_count, 8 * w);
+    PLACE(cycles_per_second, 4 * w);
+    PLACE(frame_count, 8 * w);
+    PLACE(frame_cycles_left, 4 * w);
+    PLACE(halted, w);
+    PLACE(faulted, w);
+    PLACE(keys, 2 * w);
+    PLACE(waiting_key, w);
+    PLACE(random_state, 8 * w);
+    PLACE(random_seed, 8 * w);
+    PLACE(done, 2 * w);
+    PLACE(synced, 2 * w);
+    PLACE(mask, w);
+
+#undef PLACE
+    return used;
+}
+
+struct chip8_lanes *lanes_create(uint32_t count)
+{
+    struct chip8_lanes *lanes = calloc(1, sizeof(struct chip8_lanes));
+    if (lanes == NULL)
+    {
+        return NULL;
+    }
+    lanes->count = count;
+    lanes->width = (count + LANE_BLOCK - 1) / LANE_BLOCK * LANE_BLOCK;
+    size_t size = place_arrays(lanes, NULL);
+    lanes->allocation = aligned_alloc(64, size > 0 ? size : 64);
+    if (lanes->allocation == NULL)
+    {
+        free(lanes);
+        return NULL;
+    }
+    memset(lanes->allocation, 0, size);
+    place_arrays(lanes, lanes->allocation);
+    for (uint32_t l = 0; l < lanes->width; l++)
+    {
+        lanes->halted[l] = true;
+        lanes->cycles_per_second[l] = DEFAULT_CYCLES_PER_SECOND;
+    }
+    return lanes;
+}
+
+void lanes_destroy(struct chip8_lanes *lanes)
+{
+    if (lanes == NULL)
+    {
+        return;
+    }
+    free(lanes->allocation);
+    free(lanes);
+}
+
+void lanes_set(struct chip8_lanes *lanes, uint32_t lane, const struct chip8 *c8)
+{
+    size_t w = lanes->width;
+    for (int n = 0; n < 16; n++)
+    {
+        lanes->reg_vx[n * w + lane] = c8->reg_vx[n];
+        lanes->stack[n * w + lane] = c8->stack[n];
+    }
+    for (int address = 0; address < 4096; address++)
+    {
+        lanes->memory[address * w + lane] = c8->memory[address];
+    }
+    memcpy(lanes->display + 32 * (size_t)lane, c8->display, sizeof(c8->display));
+    lanes->reg_i[lane] = c8->reg_i;
+    lanes->reg_delay[lane] = c8->reg_delay;
+    lanes->reg_sound[lane] = c8->reg_sound;
+    lanes->reg_pc[lane] = c8->reg_pc & 0xfff;
+    lanes->reg_sp[lane] = c8->reg_sp;
+    lanes->rom_size[lane] = c8->rom_size;
+    lanes->current_opcode[lane] = c8->current_opcode;
+    lanes->instruction_count[lane] = c8->instruction_count;
+    lanes->cycles_per_second[lane] = c8->cycles_per_second;
+    lanes->frame_count[lane] = c8->frame_count;
+    lanes->frame_cycles_left[lane] = c8->frame_cycles_left;
+    lanes->halted[lane] = c8->halted;
+    lanes->faulted[lane] = c8->faulted;
+    lanes->keys[lane] = c8->keys;
+    lanes->waiting_key[lane] = c8->waiting_key;
+    lanes->random_state[lane] = c8->random_state;
+    lanes->random_seed[lane] = c8->random_seed;
+    lanes->quirks = c8->quirks;
+}
+
+void lanes_get(const struct chip8_lanes *lanes, uint32_t lane, struct chip8 *c8)
+{
+    size_t w = lanes->width;
+    for (int n = 0; n < 16; n++)
+    {
+        c8->reg_vx[n] = lanes->reg_vx[n * w + lane];
+        c8->stack[n] = lanes->stack[n * w + lane];
+    }
+    for (int address = 0; address < 4096; address++)
+    {
+        c8->memory[address] = lanes->memory[address * w + lane];
+    }
+    memcpy(c8->display, lanes->display + 32 * (size_t)lane, sizeof(c8->display));
+    c8->reg_i = lanes->reg_i[lane];
+    c8->reg_delay = lanes->reg_delay[lane];
+    c8->reg_sound = lanes->reg_sound[lane];
+    c8->reg_pc = lanes->reg_pc[lane];
+    c8->reg_sp = lanes->reg_sp[lane];
+    c8->rom_size = lanes->rom_size[lane];
+    c8->current_opcode = lanes->current_opcode[lane];
+    c8->instruction_count = lanes->instruction_count[lane];
+    c8->cycles_per_second = lanes->cycles_per_second[lane];
+    c8->frame_count = lanes->frame_count[lane];
+    c8->frame_cycles_left = lanes->frame_cycles_left[lane];
+    c8->halted = lanes->halted[lane];
+    c8->faulted = lanes->faulted[lane];
+    c8->fault_pc = c8->faulted ? c8->reg_pc : 0;
+    c8->fault_opcode = c8->faulted ? c8->memory[c8->reg_pc] << 8 | c8->memory[c8->reg_pc + 1] : 0;
+    c8->keys = lanes->keys[lane];
+    c8->waiting_key = lanes->waiting_key[lane];
+    c8->random_state = lanes->random_state[lane];
+    c8->random_seed = lanes->random_seed[lane];
+    c8->quirks = lanes->quirks;
+
+    // the machine's decoded and translated code is for the memory it had
+    invalidate_decode_cache(c8, 0, sizeof(c8->memory));
+    jit_invalidate(c8, 0, sizeof(c8->memory));
+    c8->display_dirty = true;
+}
+
+// frame bookkeeping for count instructions of a lane, as finish_cycles
+static void finish_lane(struct chip8_lanes *lanes, uint32_t l, uint32_t count)
+{
+    lanes->instruction_count[l] += count;
+    while (count >= lanes->frame_cycles_left[l])
+    {
+        count -= lanes->frame_cycles_left[l];
+        if (lanes->reg_delay[l] > 0)
+        {
+            lanes->reg_delay[l]--;
+        }
+        if (lanes->reg_sound[l] > 0)
+        {
+            lanes->reg_sound[l]--;
+        }
+        uint64_t frame = ++lanes->frame_count[l];
+        uint64_t rate = lanes->cycles_per_second[l];
+        lanes->frame_cycles_left[l] = (frame + 1) * rate / FRAMES_PER_SECOND - frame * rate / FRAMES_PER_SECOND;
+    }
+    lanes->frame_cycles_left[l] -= count;
+}
+
+// the bookkeeping is put off until something reads the timers. before the
+// instruction a lane is running does, catch up on the ones it ran earlier
+static void sync_timers(struct chip8_lanes *lanes, uint32_t l)
+{
+    uint16_t before = lanes->done[l] - 1;
+    finish_lane(lanes, l, (uint16_t)(before - lanes->synced[l]));
+    lanes->synced[l] = before;
+}
+
+// an unknown opcode stops its lane without counting, pc left on it
+static void halt_lane(struct chip8_lanes *lanes, uint32_t l, uint16_t round)
+{
+    lanes->halted[l] = true;
+    lanes->faulted[l] = true;
+    lanes->done[l]--;
+    finish_lane(lanes, l, (uint16_t)(lanes->done[l] - lanes->synced[l]));
+    lanes->done[l] = round;
+    lanes->synced[l] = round;
+}
+
+static uint8_t random_byte(struct chip8_lanes *lanes, uint32_t l)
+{
+    uint64_t x = lanes->random_state[l];
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    lanes->random_state[l] = x;
+    return (x * 0x2545f4914f6cdd1d) >> 56;
+}
+
+static void draw_lane(struct chip8_lanes *lanes, uint32_t l, uint8_t x, uint8_t y, uint8_t n)
+{
+    size_t w = lanes->width;
+    uint8_t *v = lanes->reg_vx + l;
+    uint64_t *display = lanes->display + 32 * (size_t)l;
+    bool wrap = quirk_profiles[lanes->quirks].wrap_sprites;
+
+    uint8_t reg_x = v[x * w] & 0x3f;
+    uint8_t reg_y = v[y * w] & 0x1f;
+    v[0xf * w] = 0;
+    for (int i = 0; i < n && (wrap || reg_y + i < 32); i++)
+    {
+        uint64_t bits = (uint64_t)lanes->memory[((lanes->reg_i[l] + i) & 0xfff) * w + l] << 56;
+        uint64_t row = bits >> reg_x;
+        if (wrap && reg_x != 0)
+        {
+            row |= bits << (64 - reg_x);
+        }
+        uint8_t line = (reg_y + i) & 0x1f;
+        if (display[line] & row)
+        {
+            v[0xf * w] = 1;
+        }
+        display[line] ^= row;
+    }
+}
+
+// the lanes of block c in the mask, one after another
+#define FOR_MASKED(l, lanes, c) \
+    for (uint32_t l = (c); l < (c) + LANE_BLOCK; l++) \
+        if ((lanes)->mask[l])
+
+// the opcodes with no vector version, run lane by lane as the interpreter
+// runs them
+static void run_lanes(struct chip8_lanes *lanes, uint32_t c, uint16_t opcode, uint16_t round)
+{
+    size_t w = lanes->width;
+    uint8_t x = (opcode >> 8) & 0xf;
+    uint8_t *vx = lanes->reg_vx + x * w;
+    uint8_t *memory = lanes->memory;
+    const struct quirks *quirks = &quirk_profiles[lanes->quirks];
+
+    switch (opcode & 0xf000)
+    {
+        case 0x0000:
+            if (opcode == 0x00e0)
+            {
+                FOR_MASKED(l, lanes, c)
+                {
+                    memset(lanes->display + 32 * (size_t)l, 0, 32 * sizeof(uint64_t));
+                }
+                break;
+            }
+            if (opcode == 0x00ee)
+            {
+                FOR_MASKED(l, lanes, c)
+                {
+                    lanes->reg_sp[l]--;
+                    lanes->reg_pc[l] = (lanes->stack[(lanes->reg_sp[l] & 0xf) * w + l] + 2) & 0xfff;
+                }
+                return;
+            }
+            FOR_MASKED(l, lanes, c)
+            {
+                halt_lane(lanes, l, round);
+            }
+            return;
+        case 0x2000:
+            FOR_MASKED(l, lanes, c)
+            {
+                lanes->stack[(lanes->reg_sp[l] & 0xf) * w + l] = lanes->reg_pc[l];
+                lanes->reg_sp[l]++;
+                lanes->reg_pc[l] = opcode & 0xfff;
+            }
+            return;
+        case 0xc000:
+            FOR_MASKED(l, lanes, c)
+            {
+                vx[l] = random_byte(lanes, l) & (opcode & 0xff);
+            }
+            break;
+        case 0xd000:
+            FOR_MASKED(l, lanes, c)
+            {
+                draw_lane(lanes, l, x, (opcode >> 4) & 0xf, opcode & 0xf);
+            }
+            break;
+        case 0xf000:
+            switch (opcode & 0xff)
+            {
+                case 0x07:
+                    FOR_MASKED(l, lanes, c)
+                    {
+                        sync_timers(lanes, l);
+                        vx[l] = lanes->reg_delay[l];
+                    }
+                    break;
+                case 0x0a:
+                    FOR_MASKED(l, lanes, c)
+                    {
+                        // with no key held the lane waits here for the rest
+                        // of the step, every pass counting as an instruction
+                        if (lanes->keys[l] == 0)
+                        {
+                            lanes->waiting_key[l] = true;
+                            lanes->done[l] = round;
+                            continue;
+                        }
+                        lanes->waiting_key[l] = false;
+                        vx[l] = __builtin_ctz(lanes->keys[l]);
+                        lanes->reg_pc[l] = (lanes->reg_pc[l] + 2) & 0xfff;
+                    }
+                    return;
+                case 0x15:
+                    FOR_MASKED(l, lanes, c)
+                    {
+                        sync_timers(lanes, l);
+                        lanes->reg_delay[l] = vx[l];
+                    }
+                    break;
+                case 0x18:
+                    FOR_MASKED(l, lanes, c)
+                    {
+                        sync_timers(lanes, l);
+                        lanes->reg_sound[l] = vx[l];
+                    }
+                    break;
+                case 0x33:
+                    FOR_MASKED(l, lanes, c)
+                    {
+                        uint16_t i = lanes->reg_i[l];
+                        memory[(i & 0xfff) * w + l] = vx[l] / 100;
+                        memory[((i + 1) & 0xfff) * w + l] = (vx[l] / 10) % 10;
+                        memory[((i + 2) & 0xfff) * w + l] = vx[l] % 10;
+                    }
+                    break;
+                case 0x55:
+                case 0x65:
+                    FOR_MASKED(l, lanes, c)
+                    {
+                        uint16_t i = lanes->reg_i[l];
+                        for (int r = 0; r <= x; r++)
+                        {
+                            if ((opcode & 0xff) == 0x55)
+                            {
+                                memory[((i + r) & 0xfff) * w + l] = lanes->reg_vx[r * w + l];
+                            }
+                            else
+                            {
+                                lanes->reg_vx[r * w + l] = memory[((i + r) & 0xfff) * w + l];
+                            }
+                        }
+                        if (quirks->load_store_moves_i)
+                        {
+                            lanes->reg_i[l] += quirks->load_store_off_by_one ? x : x + 1;
+                        }
+                    }
+                    break;
+                default:
+                    FOR_MASKED(l, lanes, c)
+                    {
+                        halt_lane(lanes, l, round);
+                    }
+                    return;
+            }
+            break;
+        default:
+            FOR_MASKED(l, lanes, c)
+            {
+                halt_lane(lanes, l, round);
+            }
+            return;
+    }
+    FOR_MASKED(l, lanes, c)
+    {
+        lanes->reg_pc[l] = (lanes->reg_pc[l] + 2) & 0xfff;
+    }
+}
+
+// pc += 4 where the condition holds and 2 where it does not
+LANES_INLINE void skip_lanes(uint16_t *reg_pc, vec_m16 m, vec_m16 condition)
+{
+    vec_u16 step = 2 + ((vec_u16)condition & 2);
+    update_u16(reg_pc, m, (load_u16(reg_pc) + step) & 0xfff);
+}
+
+// run the opcode on the lanes of block c in the mask as vector operations.
+// false if it has no vector version, the order of the writes is the
+// interpreter's so the same register as x, y and Vf comes out the same
+LANES_INLINE bool run_vector(struct chip8_lanes *lanes, uint32_t c, vec_m8 m, uint16_t opcode,
+                             uint16_t pc, uint16_t round)
+{
+    size_t w = lanes->width;
+    uint8_t x = (opcode >> 8) & 0xf;
+    uint8_t y = (opcode >> 4) & 0xf;
+    uint8_t kk = opcode & 0xff;
+    uint16_t nnn = opcode & 0xfff;
+    const struct quirks *quirks = &quirk_profiles[lanes->quirks];
+    uint8_t *vx = lanes->reg_vx + x * w + c;
+    uint8_t *vy = lanes->reg_vx + y * w + c;
+    uint8_t *vf = lanes->reg_vx + 0xf * w + c;
+    uint16_t *reg_pc = lanes->reg_pc + c;
+    uint16_t *reg_i = lanes->reg_i + c;
+    vec_m16 m16 = widen_mask(m);
+
+    switch (opcode >> 12)
+    {
+        case 0x0:
+        case 0x2:
+        {
+            // lanes that went the same way nearly always have the same
+            // depth of stack, which then is one row for all of them
+            if (opcode != 0x00ee && (opcode >> 12) != 0x2)
+            {
+                return false;
+            }
+            uint8_t *reg_sp = lanes->reg_sp + c;
+            uint8_t sp = reg_sp[first_lane(m)];
+            if (any_lane(m & (load_u8(reg_sp) != sp)))
+            {
+                return false;
+            }
+            if (opcode == 0x00ee)
+            {
+                sp--;
+                update_u8(reg_sp, m, splat_u8(sp));
+                update_u16(reg_pc, m16, (load_u16(lanes->stack + (sp & 0xf) * w + c) + 2) & 0xfff);
+                return true;
+            }
+            update_u16(lanes->stack + (sp & 0xf) * w + c, m16, load_u16(reg_pc));
+            update_u8(reg_sp, m, splat_u8(sp + 1));
+            update_u16(reg_pc, m16, splat_u16(nnn));
+            return true;
+        }
+        case 0x1:
+            update_u16(reg_pc, m16, splat_u16(nnn));
+            if (nnn == pc)
+            {
+                // a jump to itself spins for the rest of the step
+                update_u16(lanes->done + c, m16, splat_u16(round));
+            }
+            return true;
+        case 0x3:
+            skip_lanes(reg_pc, m16, widen_mask(load_u8(vx) == kk));
+            return true;
+        case 0x4:
+            skip_lanes(reg_pc, m16, widen_mask(load_u8(vx) != kk));
+            return true;
+        case 0x5:
+            if ((opcode & 0xf) != 0)
+            {
+                return false;
+            }
+            skip_lanes(reg_pc, m16, widen_mask(load_u8(vx) == load_u8(vy)));
+            return true;
+        case 0x6:
+            update_u8(vx, m, splat_u8(kk));
+            break;
+        case 0x7:
+            update_u8(vx, m, load_u8(vx) + kk);
+            break;
+        case 0x8:
+        {
+            uint8_t *source = quirks->shift_vy ? vy : vx;
+            switch (opcode & 0xf)
+            {
+                case 0x0:
+                    update_u8(vx, m, load_u8(vy));
+                    break;
+                case 0x1:
+                    update_u8(vx, m, load_u8(vx) | load_u8(vy));
+                    break;
+                case 0x2:
+                    update_u8(vx, m, load_u8(vx) & load_u8(vy));
+                    break;
+                case 0x3:
+                    update_u8(vx, m, load_u8(vx) ^ load_u8(vy));
+                    break;
+                case 0x4:
+                    update_u8(vf, m, (vec_u8)(load_u8(vx) > splat_u8(0xff) - load_u8(vy)) & 1);
+                    update_u8(vx, m, load_u8(vx) + load_u8(vy));
+                    break;
+                case 0x5:
+                    update_u8(vf, m, (vec_u8)(load_u8(vx) > load_u8(vy)) & 1);
+                    update_u8(vx, m, load_u8(vx) - load_u8(vy));
+                    break;
+                case 0x6:
+                    update_u8(vf, m, load_u8(source) & 1);
+                    update_u8(vx, m, load_u8(source) >> 1);
+                    break;
+                case 0x7:
+                    update_u8(vf, m, (vec_u8)(load_u8(vy) > load_u8(vx)) & 1);
+                    update_u8(vx, m, load_u8(vy) - load_u8(vx));
+                    break;
+                case 0xe:
+                    update_u8(vf, m, load_u8(source) >> 7);
+                    update_u8(vx, m, load_u8(source) << 1);
+                    break;
+                default:
+                    return false;
+            }
+            uint8_t n = opcode & 0xf;
+            if (quirks->logic_clears_vf && n >= 0x1 && n <= 0x3)
+            {
+                update_u8(vf, m, splat_u8(0));
+            }
+            break;
+        }
+        case 0x9:
+            if ((opcode & 0xf) != 0)
+            {
+                return false;
+            }
+            skip_lanes(reg_pc, m16, widen_mask(load_u8(vx) != load_u8(vy)));
+            return true;
+        case 0xa:
+            update_u16(reg_i, m16, splat_u16(nnn));
+            break;
+        case 0xb:
+        {
+            const uint8_t *base = quirks->jump_vx ? vx : lanes->reg_vx + c;
+            update_u16(reg_pc, m16, (widen_u8(load_u8(base)) + nnn) & 0xfff);
+            return true;
+        }
+        case 0xe:
+        {
+            vec_m16 up = equal_u16(load_u16(lanes->keys + c) & key_bit(widen_u8(load_u8(vx))), splat_u16(0));
+            if (kk == 0x9e)
+            {
+                skip_lanes(reg_pc, m16, ~up);
+                return true;
+            }
+            if (kk == 0xa1)
+            {
+                skip_lanes(reg_pc, m16, up);
+                return true;
+            }
+            return false;
+        }
+        case 0xf:
+            if (kk == 0x1e)
+            {
+                // Vf is whether I + Vx goes past 0xfff, I is added to after.
+                // I can be anything, the bits past 12 are looked at apart
+                vec_u16 i = load_u16(reg_i);
+                vec_u16 past = (((i & 0xfff) + widen_u8(load_u8(vx))) | i) >> 12;
+                vec_m16 over = ~equal_u16(past, splat_u16(0));
+                update_u8(vf, m, (vec_u8)__builtin_convertvector(over, vec_m8) & 1);
+                update_u16(reg_i, m16, load_u16(reg_i) + widen_u8(load_u8(vx)));
+                break;
+            }
+            if (kk == 0x29)
+            {
+                update_u16(reg_i, m16, widen_u8(load_u8(vx)) * 5);
+                break;
+            }
+            if (kk == 0x33 || kk == 0x55 || kk == 0x65)
+            {
+                // as with the stack, lanes together nearly always point I
+                // at the same address, the bytes there are a row each
+                uint16_t i = reg_i[first_lane(m)];
+                if (any_lane(__builtin_convertvector(m16 & ~equal_u16(load_u16(reg_i), splat_u16(i)), vec_m8)))
+                {
+                    return false;
+                }
+                uint8_t *memory = lanes->memory + c;
+                if (kk == 0x33)
+                {
+                    // n * 205 >> 11 is n / 10 for every n up to a byte,
+                    // without a division
+                    vec_u16 value = widen_u8(load_u8(vx));
+                    vec_u16 tens = (value * 205) >> 11;
+                    vec_u16 hundreds = (tens * 205) >> 11;
+                    update_u8(memory + (i & 0xfff) * w, m, __builtin_convertvector(hundreds, vec_u8));
+                    update_u8(memory + ((i + 1) & 0xfff) * w, m, __builtin_convertvector(tens - hundreds * 10, vec_u8));
+                    update_u8(memory + ((i + 2) & 0xfff) * w, m, __builtin_convertvector(value - tens * 10, vec_u8));
+                    break;
+                }
+                for (int r = 0; r <= x; r++)
+                {
+                    uint8_t *address = memory + ((i + r) & 0xfff) * w;
+                    uint8_t *reg = lanes->reg_vx + r * w + c;
+                    if (kk == 0x55)
+                    {
+                        update_u8(address, m, load_u8(reg));
+                    }
+                    else
+                    {
+                        update_u8(reg, m, load_u8(address));
+                    }
+                }
+                if (quirks->load_store_moves_i)
+                {
+                    update_u16(reg_i, m16, splat_u16(i + (quirks->load_store_off_by_one ? x : x + 1)));
+                }
+                break;
+            }
+            return false;
+        default:
+            return false;
+    }
+    update_u16(reg_pc, m16, (load_u16(reg_pc) + 2) & 0xfff);
+    return true;
+}
+
+// the lowest pc of the lanes still running this round, NO_PC once they all
+// have run it. taking the lowest first lets lanes that went different ways
+// through a branch meet again where the paths join. converged is set when
+// every running lane is at that pc
+LANES_INLINE uint16_t lowest_pc(const struct chip8_lanes *lanes, uint16_t round, bool *converged)
+{
+    vec_u16 lowest = splat_u16(NO_PC);
+    vec_u16 highest = splat_u16(0);
+    for (uint32_t c = 0; c < lanes->width; c += LANE_BLOCK)
+    {
+        vec_u16 running = (vec_u16)less_u16(load_u16(lanes->done + c), splat_u16(round));
+        vec_u16 pc = load_u16(lanes->reg_pc + c);
+        vec_u16 low = (pc & running) | (splat_u16(NO_PC) & ~running);
+        vec_u16 lower = (vec_u16)less_u16(low, lowest);
+        lowest = (low & lower) | (lowest & ~lower);
+        vec_u16 high = pc & running;
+        vec_u16 higher = (vec_u16)less_u16(highest, high);
+        highest = (high & higher) | (highest & ~higher);
+    }
+    uint16_t result = NO_PC;
+    uint16_t top = 0;
+    for (int i = 0; i < LANE_BLOCK; i++)
+    {
+        result = lowest[i] < result ? lowest[i] : result;
+        top = highest[i] > top ? highest[i] : top;
+    }
+    *converged = result == top;
+    return result;
+}
+
+// where every lane that runs the opcode at pc goes next, or NO_PC if that
+// depends on the lane
+LANES_INLINE uint16_t next_pc(uint16_t opcode, uint16_t pc)
+{
+    switch (opcode >> 12)
+    {
+        case 0x0:
+            return opcode == 0x00e0 ? (pc + 2) & 0xfff : NO_PC;
+        case 0x1:
+        case 0x2:
+            return opcode & 0xfff;
+        case 0x6:
+        case 0x7:
+        case 0x8:
+        case 0xa:
+        case 0xc:
+        case 0xd:
+        case 0xf:
+            return (pc + 2) & 0xfff;
+        default:
+            return NO_PC;
+    }
+}
+
+// run the instruction at pc on the running lanes there, masking out a lane
+// holding a different opcode than the first of them because it rewrote its
+// code, which then runs on its own later. all is cleared if that left any
+// out. returns the opcode, NO_OPCODE if no lane is at pc
+LANES_INLINE uint32_t run_step(struct chip8_lanes *lanes, uint16_t pc, uint16_t round, bool *all)
+{
+    size_t w = lanes->width;
+    const uint8_t *high = lanes->memory + pc * w;
+    const uint8_t *low = lanes->memory + ((pc + 1) & 0xfff) * w;
+    uint32_t opcode = NO_OPCODE;
+    *all = true;
+    for (uint32_t c = 0; c < w; c += LANE_BLOCK)
+    {
+        vec_m16 at = equal_u16(load_u16(lanes->reg_pc + c), splat_u16(pc)) &
+                     less_u16(load_u16(lanes->done + c), splat_u16(round));
+        vec_m8 m = __builtin_convertvector(at, vec_m8);
+        if (!any_lane(m))
+        {
+            continue;
+        }
+        if (opcode == NO_OPCODE)
+        {
+            int first = first_lane(m);
+            opcode = high[c + first] << 8 | low[c + first];
+        }
+        vec_m8 same = (load_u8(high + c) == (uint8_t)(opcode >> 8)) & (load_u8(low + c) == (uint8_t)opcode);
+        *all &= !any_lane(m & ~same);
+        m &= same;
+
+        // counted before running it, as the interpreter does
+        vec_m16 m16 = widen_mask(m);
+        vec_u16 done = load_u16(lanes->done + c) - (vec_u16)m16;
+        memcpy(lanes->done + c, &done, sizeof(done));
+        update_u16(lanes->current_opcode + c, m16, splat_u16(opcode));
+
+        if (!run_vector(lanes, c, m, opcode, pc, round))
+        {
+            memcpy(lanes->mask + c, &m, sizeof(m));
+            run_lanes(lanes, c, opcode, round);
+        }
+    }
+    return opcode;
+}
+
+// run every lane that is not halted for round instructions
+LANES_INLINE void run_round(struct chip8_lanes *lanes, uint16_t round)
+{
+    for (uint32_t c = 0; c < lanes->width; c += LANE_BLOCK)
+    {
+        vec_u16 done = splat_u16(round) & -widen_u8(load_u8(lanes->halted + c));
+        memcpy(lanes->done + c, &done, sizeof(done));
+        memcpy(lanes->synced + c, &done, sizeof(done));
+    }
+
+    bool converged;
+    uint16_t pc = lowest_pc(lanes, round, &converged);
+    while (pc != NO_PC)
+    {
+        bool all;
+        uint32_t opcode = run_step(lanes, pc, round, &all);
+        if (opcode == NO_OPCODE)
+        {
+            pc = lowest_pc(lanes, round, &converged);
+            continue;
+        }
+
+        // while the lanes run together they stay together up to a branch,
+        // and the ones left there are the lowest without looking for it.
+        // those that finished the round drop out, if all did none is found
+        uint16_t next = converged && all ? next_pc(opcode, pc) : NO_PC;
+        pc = next != NO_PC ? next : lowest_pc(lanes, round, &converged);
+    }
+
+    for (uint32_t l = 0; l < lanes->width; l++)
+    {
+        uint16_t count = lanes->done[l] - lanes->synced[l];
+        if (count < lanes->frame_cycles_left[l])
+        {
+            lanes->instruction_count[l] += count;
+            lanes->frame_cycles_left[l] -= count;
+            continue;
+        }
+        finish_lane(lanes, l, count);
+    }
+}
+
+LANES_TARGETS const uint64_t *step_batch(struct chip8_lanes *lanes, uint32_t count)
+{
+    // as execute_cycles, a lane waiting for a key tries Fx0A again
+    for (uint32_t c = 0; c < lanes->width; c += LANE_BLOCK)
+    {
+        vec_u8 waiting = load_u8(lanes->waiting_key + c) & -load_u8(lanes->halted + c);
+        memcpy(lanes->waiting_key + c, &waiting, sizeof(waiting));
+    }
+
+    // the per lane counts are 15 bit, longer steps run in rounds
+    while (count > 0)
+    {
+        uint16_t round = count < 0x7fff ? count : 0x7fff;
+        run_round(lanes, round);
+        count -= round;
+    }
+    return lanes->display;
+}
@@ -0,0 +1,85 @@
+#ifndef LANES_H
+#define LANES_H
+
+// lockstep core: many machines running the same program, e.g. one rom with
+// different seeds and inputs for a search, stored as structure of arrays so
+// register n of every machine sits in one row. each step the machines that
+// are at the same pc with the same opcode there run it together, the ALU,
+// skip, jump and I register opcodes as vector operations over the rows with
+// the other machines masked out. the rest run machine by machine. every
+// machine ends up exactly where it would running alone
+
+// machines are processed in blocks of this many, the width of the vectors
+#define LANE_BLOCK 16
+
+struct chip8_lanes
+{
+    // machines in use, and the lanes allocated for them rounded up to a
+    // whole block. the lanes past count stay halted
+    uint32_t count;
+    uint32_t width;
+
+    // every lane runs as the profile of the machine last set on it
+    enum quirk_profile quirks;
+
+    // register n of lane l is at reg_vx[n * width + l], stack entries and
+    // memory bytes the same way
+    uint8_t *reg_vx;
+    uint16_t *reg_i;
+    uint8_t *reg_delay;
+    uint8_t *reg_sound;
+    uint16_t *reg_pc;
+    uint8_t *reg_sp;
+    uint16_t *stack;
+    uint8_t *memory;
+    uint16_t *rom_size;
+
+    // the display of lane l is the 32 rows at display + 32 * l, laid out as
+    // struct chip8 has them
+    uint64_t *display;
+
+    uint16_t *current_opcode;
+    uint64_t *instruction_count;
+    uint32_t *cycles_per_second;
+    uint64_t *frame_count;
+    uint32_t *frame_cycles_left;
+    uint8_t *halted;
+
+    // set on a lane halted by an unknown opcode, pc is left on it
+    uint8_t *faulted;
+
+    // set by the caller between steps, bit n is set while key n is held
+    uint16_t *keys;
+    uint8_t *waiting_key;
+    uint64_t *random_state;
+    uint64_t *random_seed;
+
+    // step_batch working state: instructions each lane has run and has done
+    // the frame bookkeeping for in the current round, and which lanes run
+    // the current instruction
+    uint16_t *done;
+    uint16_t *synced;
+    uint8_t *mask;
+
+    void *allocation;
+};
+
+// count lanes, all halted until a machine is set on them. NULL if out of
+// memory
+struct chip8_lanes *lanes_create(uint32_t count);
+void lanes_destroy(struct chip8_lanes *lanes);
+
+// copy the emulated part of a machine into a lane, e.g. one freshly loaded
+// and seeded, or read from a snapshot. the lanes take its quirk profile
+void lanes_set(struct chip8_lanes *lanes, uint32_t lane, const struct chip8 *c8);
+
+// copy a lane out into a machine, to hash, save or keep running it alone
+void lanes_get(const struct chip8_lanes *lanes, uint32_t lane, struct chip8 *c8);
+
+// run count instructions on every lane that is not halted, with the keys
+// held still. a lane at Fx0A with no key held waits in place and one on a
+// jump to itself spins, both to the end of the step. an unknown opcode
+// halts its lane instead of the program. returns the displays of all lanes
+const uint64_t *step_batch(struct chip8_lanes *lanes, uint32_t count);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "chip8.h"
+#include "snapshot.h"
+#include "lanes.h"
+#include "randrom.h"
+
+// checks the lockstep core against machines running alone. random programs,
+// see randrom.h, and any roms given are run as every quirk profile on a set
+// of lanes, each with its own seed and keys so their paths split apart, and
+// on one scalar machine per lane. every lane is copied out and compared
+// with its machine, registers, memory, display and all, after every step
+
+static uint64_t random_state;
+
+// run count instructions with the keys held still. a machine that starts
+// waiting for a key spins there for the rest of them, as a lane does
+static void run_batch(struct chip8 *c8, uint32_t count)
+{
+    uint64_t start = c8->instruction_count;
+    execute_cycles(c8, count, false);
+    if (c8->waiting_key)
+    {
+        finish_cycles(c8, count - (uint32_t)(c8->instruction_count - start));
+    }
+}
+
+// run a program on the lanes and alone, false if any lane ever differs
+// from its machine
+static bool check_program(const char *name, const uint8_t *code, size_t size, enum quirk_profile quirks,
+                          uint32_t lane_count, uint32_t steps, uint64_t *instructions)
+{
+    struct chip8_lanes *lanes = lanes_create(lane_count);
+    struct chip8 **machines = calloc(lane_count, sizeof(struct chip8 *));
+    struct chip8 *lane = create_emulator();
+    if (lanes == NULL || machines == NULL || lane == NULL)
+    {
+        printf("out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t l = 0; l < lane_count; l++)
+    {
+        machines[l] = create_emulator();
+        if (machines[l] == NULL)
+        {
+            printf("out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        set_quirk_profile(machines[l], quirks);
+        seed_random(machines[l], l + 1);
+        reset_emulator(machines[l]);
+        load_rom_data(machines[l], code, size);
+        lanes_set(lanes, l, machines[l]);
+    }
+
+    bool ok = true;
+    for (uint32_t step = 0; ok && step < steps; step++)
+    {
+        // a third of the lanes hold no key, the rest one each
+        uint32_t count = 1 + random_below(&random_state, 200);
+        for (uint32_t l = 0; l < lane_count; l++)
+        {
+            uint16_t keys = random_below(&random_state, 3) == 0 ? 0 : 1 << random_below(&random_state, 16);
+            machines[l]->keys = keys;
+            lanes->keys[l] = keys;
+            run_batch(machines[l], count);
+        }
+        step_batch(lanes, count);
+
+        for (uint32_t l = 0; l < lane_count; l++)
+        {
+            lanes_get(lanes, l, lane);
+            const char *difference = snapshot_difference(lane, machines[l]);
+            if (difference != NULL)
+            {
+                printf("%s as %s: lane %u %s differs after step %u, %llu instructions, pc %03X/%03X\n", name,
+                       quirk_profile_name(quirks), l, difference, step,
+                       (unsigned long long)machines[l]->instruction_count, lane->reg_pc, machines[l]->reg_pc);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    for (uint32_t l = 0; l < lane_count; l++)
+    {
+        *instructions += machines[l]->instruction_count;
+        destroy_emulator(machines[l]);
+    }
+    destroy_emulator(lane);
+    free(machines);
+    lanes_destroy(lanes);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t program_count = 40;
+    uint32_t lane_count = 48;
+    uint32_t steps = 100;
+    uint64_t seed = 1;
+    const char **rom_paths = calloc(argc, sizeof(char *));
+    int rom_count = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--programs=", 11) == 0)
+        {
+            program_count = strtoul(argv[i] + 11, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--lanes=", 8) == 0)
+        {
+            lane_count = strtoul(argv[i] + 8, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--steps=", 8) == 0)
+        {
+            steps = strtoul(argv[i] + 8, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            seed = strtoull(argv[i] + 7, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("usage: ./chip8-lanescheck [rom...] [--programs=count] [--lanes=count] [--steps=count]\n"
+                   "       [--seed=number]\n");
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            rom_paths[rom_count++] = argv[i];
+        }
+    }
+    if (lane_count == 0)
+    {
+        printf("lanes must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+    random_state = seed != 0 ? seed : 1;
+
+    int failures = 0;
+    uint32_t checked = 0;
+    uint64_t instructions = 0;
+    struct random_rom *program = malloc(sizeof(struct random_rom));
+    for (uint32_t i = 0; i < program_count + rom_count; i++)
+    {
+        char name[64];
+        const char *label = name;
+        if (i < program_count)
+        {
+            random_rom_generate(program, &random_state);
+            snprintf(name, sizeof(name), "program %u", i);
+        }
+        else
+        {
+            label = rom_paths[i - program_count];
+            FILE *f = fopen(label, "rb");
+            if (f == NULL)
+            {
+                printf("unable to open rom %s\n", label);
+                return EXIT_FAILURE;
+            }
+            program->size = fread(program->code, 1, sizeof(program->code), f);
+            fclose(f);
+        }
+        for (int quirks = 0; quirks < QUIRK_PROFILE_COUNT; quirks++)
+        {
+            if (!check_program(label, program->code, program->size, quirks, lane_count, steps, &instructions))
+            {
+                failures++;
+            }
+            checked++;
+        }
+    }
+
+    printf("lanes checked against scalar machines: %u runs of %u lanes, %llu instructions, %d differ\n", checked,
+           lane_count, (unsigned long long)instructions, failures);
+    free(program);
+    free(rom_paths);
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
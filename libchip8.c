@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "chip8.h"
+#include "jit.h"
+#include "libchip8.h"
+
+struct chip8 *chip8_create(void)
+{
+    struct chip8 *c8 = create_emulator();
+    if (c8 != NULL && dispatch_mode == DISPATCH_JIT)
+    {
+        // without a jit the machine runs the predecoded interpreter
+        jit_init(c8);
+    }
+    return c8;
+}
+
+void chip8_destroy(struct chip8 *c8)
+{
+    if (c8 != NULL)
+    {
+        destroy_emulator(c8);
+    }
+}
+
+bool chip8_load(struct chip8 *c8, const uint8_t *rom, size_t size)
+{
+    reset_emulator(c8);
+    return load_rom_data(c8, rom, size);
+}
+
+void chip8_seed(struct chip8 *c8, uint64_t seed)
+{
+    seed_random(c8, seed);
+}
+
+bool chip8_set_quirks(struct chip8 *c8, const char *profile)
+{
+    enum quirk_profile quirks;
+    if (!parse_quirk_profile(profile, &quirks))
+    {
+        return false;
+    }
+    set_quirk_profile(c8, quirks);
+    return true;
+}
+
+void chip8_set_speed(struct chip8 *c8, uint32_t cycles_per_second)
+{
+    set_cycles_per_second(c8, cycles_per_second > FRAMES_PER_SECOND ? cycles_per_second : FRAMES_PER_SECOND);
+}
+
+bool chip8_set_dispatch(const char *name)
+{
+    return parse_dispatch_mode(name, &dispatch_mode);
+}
+
+void chip8_set_keys(struct chip8 *c8, uint16_t keys)
+{
+    c8->keys = keys;
+}
+
+void chip8_set_key(struct chip8 *c8, uint8_t key, bool down)
+{
+    uint16_t bit = 1 << (key & 0xf);
+    c8->keys = down ? c8->keys | bit : c8->keys & ~bit;
+}
+
+// run count instructions with the keys held still. a machine that starts
+// waiting for a key spins there for the rest of them, as run_emulator does
+// for the rest of a frame
+static void run_batch(struct chip8 *c8, uint32_t count)
+{
+    uint64_t start = c8->instruction_count;
+    execute_cycles(c8, count, false);
+    if (c8->waiting_key)
+    {
+        finish_cycles(c8, count - (uint32_t)(c8->instruction_count - start));
+    }
+}
+
+bool chip8_run_cycles(struct chip8 *c8, uint64_t count)
+{
+    while (count > 0 && !c8->halted)
+    {
+        uint32_t batch = count < UINT32_MAX ? count : UINT32_MAX;
+        run_batch(c8, batch);
+        count -= batch;
+    }
+    return !c8->halted;
+}
+
+enum chip8_stop chip8_run_until(struct chip8 *c8, const struct chip8_until *until)
+{
+    uint64_t start = c8->instruction_count;
+    uint64_t last_frame = c8->frame_count + until->frames;
+    bool stepping = until->at_pc || until->predicate != NULL;
+    if (until->cycles == 0 && until->frames == 0 && !stepping)
+    {
+        return CHIP8_STOP_CYCLES;
+    }
+    while (true)
+    {
+        if (c8->halted)
+        {
+            return CHIP8_STOP_HALTED;
+        }
+        uint64_t ran = c8->instruction_count - start;
+        if (until->cycles != 0 && ran >= until->cycles)
+        {
+            return CHIP8_STOP_CYCLES;
+        }
+        if (until->frames != 0 && c8->frame_count >= last_frame)
+        {
+            return CHIP8_STOP_FRAMES;
+        }
+
+        // the pc the run starts on is left before it can stop there
+        if (until->at_pc && ran > 0 && c8->reg_pc == until->pc)
+        {
+            return CHIP8_STOP_PC;
+        }
+
+        // a frame at a time, ending with the frame so the timers and the
+        // frame count are where a frame condition expects them
+        uint64_t batch = stepping ? 1 : c8->frame_cycles_left;
+        if (until->cycles != 0 && until->cycles - ran < batch)
+        {
+            batch = until->cycles - ran;
+        }
+        run_batch(c8, batch);
+
+        if (until->predicate != NULL && until->predicate(c8, until->context))
+        {
+            return CHIP8_STOP_PREDICATE;
+        }
+    }
+}
+
+const uint64_t *chip8_display(const struct chip8 *c8)
+{
+    return c8->display;
+}
+
+bool chip8_display_changed(struct chip8 *c8)
+{
+    bool changed = c8->display_dirty;
+    c8->display_dirty = false;
+    return changed;
+}
+
+uint8_t *chip8_memory(struct chip8 *c8)
+{
+    return c8->memory;
+}
+
+void chip8_memory_written(struct chip8 *c8, uint16_t address, uint16_t length)
+{
+    invalidate_decode_cache(c8, address, length);
+    jit_invalidate(c8, address, length);
+}
+
+uint8_t *chip8_registers(struct chip8 *c8)
+{
+    return c8->reg_vx;
+}
+
+uint16_t chip8_pc(const struct chip8 *c8)
+{
+    return c8->reg_pc;
+}
+
+uint16_t chip8_i(const struct chip8 *c8)
+{
+    return c8->reg_i;
+}
+
+uint64_t chip8_instruction_count(const struct chip8 *c8)
+{
+    return c8->instruction_count;
+}
+
+uint64_t chip8_frame_count(const struct chip8 *c8)
+{
+    return c8->frame_count;
+}
+
+bool chip8_waiting_key(const struct chip8 *c8)
+{
+    return c8->waiting_key;
+}
+
+bool chip8_fault(const struct chip8 *c8, uint16_t *pc, uint16_t *opcode)
+{
+    if (!c8->faulted)
+    {
+        return false;
+    }
+    *pc = c8->fault_pc;
+    *opcode = c8->fault_opcode;
+    return true;
+}
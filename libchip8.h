@@ -0,0 +1,116 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// the emulator core as a library, for hosts that drive machines directly
+// instead of running the chip8 binary: a search, a test harness, a
+// frontend of their own. machines run headless with no backend, the host
+// sets the keys and reads the display and memory in place between runs.
+// build with "make libchip8.a" or "make libchip8.so" and include only this
+// header. separate machines can run on separate threads. a program that
+// reaches an unknown opcode halts its machine, which runs no further until
+// the next load
+
+struct chip8;
+
+// why chip8_run_until returned
+enum chip8_stop
+{
+    CHIP8_STOP_CYCLES,
+    CHIP8_STOP_FRAMES,
+    CHIP8_STOP_PC,
+    CHIP8_STOP_PREDICATE,
+
+    // halted on an unknown opcode, chip8_fault says which
+    CHIP8_STOP_HALTED
+};
+
+// when chip8_run_until returns, whichever comes first. a field left 0 or
+// NULL does not stop it, with all of them left so it returns at once
+struct chip8_until
+{
+    // instructions to run at most
+    uint64_t cycles;
+
+    // 60 Hz frames of emulated time to run to the end of
+    uint64_t frames;
+
+    // with at_pc set, stop on coming to pc before the instruction there
+    // runs. the pc the run starts on does not count
+    bool at_pc;
+    uint16_t pc;
+
+    // called after every instruction, stops the run by returning true. it
+    // can change the keys and read the machine through this api
+    bool (*predicate)(struct chip8 *c8, void *context);
+    void *context;
+};
+
+// a machine in its power on state with no program loaded, NULL if out of
+// memory. it runs with the decoder picked by chip8_set_dispatch
+struct chip8 *chip8_create(void);
+void chip8_destroy(struct chip8 *c8);
+
+// reset the machine and load a rom from host memory at 0x200. false if it
+// does not fit
+bool chip8_load(struct chip8 *c8, const uint8_t *rom, size_t size);
+
+// the Cxkk sequence, kept across loads. loading starts it over
+void chip8_seed(struct chip8 *c8, uint64_t seed);
+
+// run as a quirk profile by name (modern, vip, chip48, schip, xochip),
+// false if there is no such profile
+bool chip8_set_quirks(struct chip8 *c8, const char *profile);
+
+// instructions per second of emulated time, 600 unless set
+void chip8_set_speed(struct chip8 *c8, uint32_t cycles_per_second);
+
+// decoder for machines created from now on by name (chain, table,
+// threaded, cached, jit), false if there is no such decoder. the choice is
+// shared by every machine in the process
+bool chip8_set_dispatch(const char *name);
+
+// the keys held while the machine runs, bit n for key n
+void chip8_set_keys(struct chip8 *c8, uint16_t keys);
+void chip8_set_key(struct chip8 *c8, uint8_t key, bool down);
+
+// run count instructions. a program waiting for a key spins in place, each
+// pass counting as an instruction, as it would on the real machine. false
+// if the machine is halted before they all ran
+bool chip8_run_cycles(struct chip8 *c8, uint64_t count);
+
+// run until one of the conditions holds. with a pc or predicate the machine
+// runs an instruction at a time, otherwise a frame at a time
+enum chip8_stop chip8_run_until(struct chip8 *c8, const struct chip8_until *until);
+
+// the display in place: 32 rows of 64 pixels, column 0 in the most
+// significant bit. valid for the life of the machine, changed by runs
+const uint64_t *chip8_display(const struct chip8 *c8);
+
+// true if the display was cleared or drawn to since the last call
+bool chip8_display_changed(struct chip8 *c8);
+
+// the 4K of memory in place. after writing to it, tell the machine which
+// bytes changed so code it already decoded there is decoded again
+uint8_t *chip8_memory(struct chip8 *c8);
+void chip8_memory_written(struct chip8 *c8, uint16_t address, uint16_t length);
+
+// V0 to VF in place
+uint8_t *chip8_registers(struct chip8 *c8);
+
+uint16_t chip8_pc(const struct chip8 *c8);
+uint16_t chip8_i(const struct chip8 *c8);
+uint64_t chip8_instruction_count(const struct chip8 *c8);
+uint64_t chip8_frame_count(const struct chip8 *c8);
+
+// true while Fx0A waits for a key
+bool chip8_waiting_key(const struct chip8 *c8);
+
+// true if the machine halted on an unknown opcode, with the address and
+// the opcode there. pc stays on it and it is not counted as run
+bool chip8_fault(const struct chip8 *c8, uint16_t *pc, uint16_t *opcode);
+
+#endif
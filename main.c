@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "chip8.h"
+#include "jit.h"
+#include "backend.h"
+#include "timing.h"
+#include "trace.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "profile.h"
+#include "replay.h"
+#include "capture.h"
+
+int main(int argc, char *argv[])
+{
+    char *path;
+    bool debug = false;
+    uint64_t cycle_limit = 0;
+    const char *input_path = NULL;
+    const char *dump_path = NULL;
+    int turbo = -1;
+    const char *load_snapshot = NULL;
+    const char *save_snapshot = NULL;
+    size_t rewind_budget = 0;
+    uint32_t rewind_interval = DEFAULT_REWIND_INTERVAL;
+    bool profile = false;
+    bool seeded = false;
+    uint64_t seed = 0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *capture_path = NULL;
+    uint32_t capture_scale = DEFAULT_CAPTURE_SCALE;
+    if (argc >= 3)
+    {
+        path = argv[1];
+        if (strcmp(argv[2], "true") == 0)
+        {
+            debug = true;
+        }
+    }
+    else
+    {
+        printf("usage: ./chip8 [full path to rom] [debug] [--dispatch=chain|table|threaded|cached|jit] [--jit-verify]\n"
+               "       [--quirks=modern|vip|chip48|schip|xochip] [--no-idle-skip]\n"
+               "       [--headless] [--input=script] [--cycles=count] [--dump-display=file.pbm]\n"
+               "       [--ips=count] [--turbo] [--paced] [--scale=factor] [--window=widthxheight] [--vsync]\n"
+               "       [--keymap=hex|cosmac|file] [--terminal[=half|braille]]\n"
+               "       [--trace=file] [--trace-last=records]\n"
+               "       [--snapshot=file] [--load-snapshot=file] [--save-snapshot=file]\n"
+               "       [--rewind[=megabytes]] [--rewind-interval=frames]\n"
+               "       [--profile[=file.csv|file.json]] [--profile-top=count]\n"
+               "       [--seed=number] [--record=file] [--replay=file]\n"
+               "       [--capture=file.y4m|file.raw|frame%%05d.png] [--capture-scale=factor]\n");
+        return EXIT_FAILURE;
+    }
+
+    struct chip8 *c8 = create_emulator();
+    if (c8 == NULL)
+    {
+        perror("unable to allocate emulator");
+        return EXIT_FAILURE;
+    }
+#ifdef CHIP8_NO_SDL
+    c8->backend = &headless_backend;
+#else
+    c8->backend = &sdl_backend;
+#endif
+
+    // optional settings follow the rom path and debug flag
+    for (int i = 3; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--dispatch=", 11) == 0)
+        {
+            if (!parse_dispatch_mode(argv[i] + 11, &dispatch_mode))
+            {
+                printf("unknown dispatch mode %s\n", argv[i] + 11);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "--quirks=", 9) == 0)
+        {
+            enum quirk_profile quirks;
+            if (!parse_quirk_profile(argv[i] + 9, &quirks))
+            {
+                printf("unknown quirk profile %s\n", argv[i] + 9);
+                return EXIT_FAILURE;
+            }
+            set_quirk_profile(c8, quirks);
+        }
+        else if (strcmp(argv[i], "--jit-verify") == 0)
+        {
+            jit_verify = true;
+        }
+        else if (strcmp(argv[i], "--no-idle-skip") == 0)
+        {
+            idle_skip = false;
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            c8->backend = &headless_backend;
+        }
+        else if (strcmp(argv[i], "--terminal") == 0 || strcmp(argv[i], "--terminal=half") == 0)
+        {
+            c8->backend = &terminal_backend;
+        }
+        else if (strcmp(argv[i], "--terminal=braille") == 0)
+        {
+            c8->backend = &terminal_backend;
+            terminal_braille = true;
+        }
+        else if (strncmp(argv[i], "--input=", 8) == 0)
+        {
+            input_path = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--cycles=", 9) == 0)
+        {
+            cycle_limit = strtoull(argv[i] + 9, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--dump-display=", 15) == 0)
+        {
+            dump_path = argv[i] + 15;
+        }
+        else if (strncmp(argv[i], "--ips=", 6) == 0)
+        {
+            int rate = atoi(argv[i] + 6);
+            if (rate < FRAMES_PER_SECOND)
+            {
+                printf("bad instructions per second %s, must be at least %d\n", argv[i] + 6, FRAMES_PER_SECOND);
+                return EXIT_FAILURE;
+            }
+            set_cycles_per_second(c8, rate);
+        }
+        else if (strcmp(argv[i], "--turbo") == 0)
+        {
+            turbo = 1;
+        }
+        else if (strcmp(argv[i], "--paced") == 0)
+        {
+            turbo = 0;
+        }
+        else if (strncmp(argv[i], "--trace=", 8) == 0)
+        {
+            trace_path = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--trace-last=", 13) == 0)
+        {
+            trace_last = strtoul(argv[i] + 13, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--snapshot=", 11) == 0)
+        {
+            snapshot_path = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "--load-snapshot=", 16) == 0)
+        {
+            load_snapshot = argv[i] + 16;
+        }
+        else if (strncmp(argv[i], "--save-snapshot=", 16) == 0)
+        {
+            save_snapshot = argv[i] + 16;
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            profile = true;
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0)
+        {
+            profile = true;
+            profile_path = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "--profile-top=", 14) == 0)
+        {
+            profile_top = strtoul(argv[i] + 14, NULL, 10);
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            seeded = true;
+            seed = strtoull(argv[i] + 7, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--record=", 9) == 0)
+        {
+            record_path = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--replay=", 9) == 0)
+        {
+            // replays run headless, as fast as the host allows
+            replay_path = argv[i] + 9;
+            c8->backend = &headless_backend;
+        }
+        else if (strncmp(argv[i], "--capture=", 10) == 0)
+        {
+            capture_path = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "--capture-scale=", 16) == 0)
+        {
+            capture_scale = atoi(argv[i] + 16);
+        }
+        else if (strcmp(argv[i], "--rewind") == 0)
+        {
+            rewind_budget = DEFAULT_REWIND_BUDGET;
+        }
+        else if (strncmp(argv[i], "--rewind=", 9) == 0)
+        {
+            rewind_budget = strtoul(argv[i] + 9, NULL, 10) * 1024 * 1024;
+        }
+        else if (strncmp(argv[i], "--rewind-interval=", 18) == 0)
+        {
+            rewind_interval = strtoul(argv[i] + 18, NULL, 10);
+        }
+#ifndef CHIP8_NO_SDL
+        else if (strncmp(argv[i], "--scale=", 8) == 0)
+        {
+            int scale = atoi(argv[i] + 8);
+            if (scale < 1)
+            {
+                printf("bad scale %s\n", argv[i] + 8);
+                return EXIT_FAILURE;
+            }
+            sdl_window_width = 64 * scale;
+            sdl_window_height = 32 * scale;
+        }
+        else if (strncmp(argv[i], "--window=", 9) == 0)
+        {
+            if (sscanf(argv[i] + 9, "%dx%d", &sdl_window_width, &sdl_window_height) != 2 ||
+                sdl_window_width < 1 || sdl_window_height < 1)
+            {
+                printf("bad window size %s\n", argv[i] + 9);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--vsync") == 0)
+        {
+            sdl_vsync = true;
+        }
+#endif
+        else if (strncmp(argv[i], "--keymap=", 9) == 0)
+        {
+            // the terminal only takes the named layouts, a window files too
+#ifndef CHIP8_NO_SDL
+            terminal_load_keymap(argv[i] + 9);
+            if (!sdl_load_keymap(argv[i] + 9))
+            {
+                return EXIT_FAILURE;
+            }
+#else
+            if (!terminal_load_keymap(argv[i] + 9))
+            {
+                printf("unknown keymap %s, the terminal takes hex or cosmac\n", argv[i] + 9);
+                return EXIT_FAILURE;
+            }
+#endif
+        }
+        else
+        {
+            printf("unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (seeded)
+    {
+        seed_random(c8, seed);
+    }
+    init_emulator(c8, path, debug);
+    if (load_snapshot != NULL && !snapshot_read(c8, load_snapshot))
+    {
+        printf("unable to load snapshot %s\n", load_snapshot);
+        return EXIT_FAILURE;
+    }
+    if (profile && !profile_open(c8))
+    {
+        return EXIT_FAILURE;
+    }
+    if (rewind_budget != 0 && !rewind_open(c8, rewind_budget, rewind_interval))
+    {
+        printf("unable to start rewind, the budget is too small or the interval is 0\n");
+        return EXIT_FAILURE;
+    }
+    bool headless = c8->backend == &headless_backend;
+    if (headless && input_path != NULL && !headless_load_input(c8, input_path))
+    {
+        return EXIT_FAILURE;
+    }
+    if (replay_path != NULL)
+    {
+        uint64_t end;
+        if (!replay_load(c8, replay_path, &end))
+        {
+            return EXIT_FAILURE;
+        }
+        if (cycle_limit == 0)
+        {
+            cycle_limit = end;
+        }
+    }
+    if (record_path != NULL && !record_open(c8, record_path))
+    {
+        printf("unable to start recording\n");
+        return EXIT_FAILURE;
+    }
+    if (capture_path != NULL && !capture_open(c8, capture_path, capture_scale))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // headless runs are uncapped unless asked otherwise, a window runs at
+    // the emulated rate unless asked otherwise
+    if (turbo == -1)
+    {
+        turbo = headless;
+    }
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    struct frame_clock clock;
+    frame_clock_start(&clock, FRAMES_PER_SECOND);
+
+    run_emulator(c8, cycle_limit, turbo ? NULL : &clock, debug);
+    if (c8->faulted)
+    {
+        printf("unknown opcode %04X at %03X\n", c8->fault_opcode, c8->fault_pc);
+    }
+
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double seconds = (end_time.tv_sec - start_time.tv_sec) +
+                     (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+
+    printf("instructions: %llu\n", (unsigned long long)c8->instruction_count);
+    printf("wall time: %.3f s\n", seconds);
+    if (c8->idle_skipped != 0)
+    {
+        printf("idle loops skipped: %llu instructions, %.3f s of emulated time\n",
+               (unsigned long long)c8->idle_skipped, (double)c8->idle_skipped / c8->cycles_per_second);
+    }
+    if (turbo)
+    {
+        if (seconds > 0)
+        {
+            printf("instructions/sec: %.0f\n", c8->instruction_count / seconds);
+        }
+    }
+    else
+    {
+        frame_clock_report(&clock, c8->instruction_count, stdout);
+    }
+    if (headless && dump_path != NULL)
+    {
+        dump_display(c8, dump_path);
+    }
+    if (record_path != NULL || replay_path != NULL)
+    {
+        // a replay that matches its recording ends with the same hash
+        printf("state hash: %016llx\n", (unsigned long long)snapshot_hash(c8));
+    }
+    if (rewind_budget != 0)
+    {
+        printf("rewind history: %u frames in %zu bytes\n", rewind_frames(c8), rewind_bytes(c8));
+    }
+    if (save_snapshot != NULL && !snapshot_write(c8, save_snapshot))
+    {
+        printf("unable to save snapshot %s\n", save_snapshot);
+    }
+    capture_close(c8, stdout);
+
+    bool faulted = c8->faulted;
+    cleanup(c8);
+    destroy_emulator(c8);
+    return faulted ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "chip8.h"
+#include "disasm.h"
+#include "profile.h"
+
+const char *profile_path = NULL;
+uint32_t profile_top = 20;
+
+#ifdef CHIP8_PROFILE
+
+// the machine written out by exit() or SIGUSR1, the first one opened
+static struct chip8 *profiled;
+static volatile sig_atomic_t dump_requested;
+
+uint64_t profile_clock()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void profile_draw(struct chip8 *c8, uint8_t x, uint8_t y, uint8_t n)
+{
+    struct profile *p = c8->profile;
+    if (p == NULL)
+    {
+        return;
+    }
+    p->draws++;
+
+    // only the part of the sprite that is on screen is drawn
+    for (int i = 0; i < n && y + i < 32; i++)
+    {
+        uint64_t row = ((uint64_t)c8->memory[(c8->reg_i + i) & 0xfff] << 56) >> x;
+        p->pixels_drawn += __builtin_popcountll(row);
+    }
+}
+
+void profile_block(struct chip8 *c8, uint16_t start, uint16_t count)
+{
+    struct profile *p = c8->profile;
+    if (p == NULL)
+    {
+        return;
+    }
+    uint16_t opcode = 0;
+    uint16_t pc = start;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        pc = (start + 2 * i) & 0xfff;
+        opcode = c8->memory[pc] << 8 | c8->memory[(pc + 1) & 0xfff];
+        p->opcodes[opcode]++;
+        p->addresses[pc]++;
+    }
+
+    uint8_t group = opcode >> 12;
+    if (group == 0x3 || group == 0x4 || group == 0x5 || group == 0x9)
+    {
+        if (c8->reg_pc == ((pc + 4) & 0xfff))
+        {
+            p->skips_taken++;
+        }
+        else
+        {
+            p->skips_not_taken++;
+        }
+    }
+}
+
+static void write_all(const struct chip8 *c8)
+{
+    profile_report(c8, stdout);
+    fflush(stdout);
+    if (profile_path == NULL)
+    {
+        return;
+    }
+    FILE *f = fopen(profile_path, "w");
+    if (f == NULL)
+    {
+        perror("unable to open profile export");
+        return;
+    }
+    size_t length = strlen(profile_path);
+    if (length >= 5 && strcmp(profile_path + length - 5, ".json") == 0)
+    {
+        profile_write_json(c8, f);
+    }
+    else
+    {
+        profile_write_csv(c8, f);
+    }
+    fclose(f);
+}
+
+static void request_dump(int sig)
+{
+    dump_requested = 1;
+}
+
+void profile_poll(struct chip8 *c8)
+{
+    // the signal only sets a flag, the report is written here between
+    // batches where stdio is safe to use
+    if (dump_requested && c8 == profiled)
+    {
+        dump_requested = 0;
+        write_all(c8);
+    }
+}
+
+static void close_at_exit()
+{
+    // e.g. exit() on a jit verify mismatch
+    if (profiled != NULL)
+    {
+        profile_close(profiled);
+    }
+}
+
+bool profile_open(struct chip8 *c8)
+{
+    c8->profile = calloc(1, sizeof(struct profile));
+    if (c8->profile == NULL)
+    {
+        return false;
+    }
+    if (profiled == NULL)
+    {
+        static bool handlers_installed = false;
+        if (!handlers_installed)
+        {
+            handlers_installed = true;
+            atexit(close_at_exit);
+            signal(SIGUSR1, request_dump);
+        }
+        profiled = c8;
+    }
+    return true;
+}
+
+void profile_close(struct chip8 *c8)
+{
+    if (c8->profile == NULL)
+    {
+        return;
+    }
+    if (profiled == c8)
+    {
+        write_all(c8);
+        profiled = NULL;
+    }
+    free(c8->profile);
+    c8->profile = NULL;
+}
+
+#else
+
+bool profile_open(struct chip8 *c8)
+{
+    printf("this build has no profiler, build it with make chip8-profile\n");
+    return false;
+}
+
+void profile_close(struct chip8 *c8)
+{
+}
+
+#endif
+
+static uint64_t total_instructions(const struct profile *p)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < 4096; i++)
+    {
+        total += p->addresses[i];
+    }
+    return total;
+}
+
+static void count_classes(const struct profile *p, uint64_t *classes)
+{
+    memset(classes, 0, DISASM_CLASS_COUNT * sizeof(uint64_t));
+    for (int op = 0; op < 65536; op++)
+    {
+        if (p->opcodes[op] != 0)
+        {
+            classes[opcode_class(op)] += p->opcodes[op];
+        }
+    }
+}
+
+// addresses that executed, most executed first
+static const uint64_t *sort_counts;
+
+static int compare_addresses(const void *a, const void *b)
+{
+    uint64_t x = sort_counts[*(const uint16_t *)a];
+    uint64_t y = sort_counts[*(const uint16_t *)b];
+    if (x != y)
+    {
+        return x < y ? 1 : -1;
+    }
+    return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+static int hot_addresses(const struct profile *p, uint16_t *order)
+{
+    int count = 0;
+    for (int pc = 0; pc < 4096; pc++)
+    {
+        if (p->addresses[pc] != 0)
+        {
+            order[count++] = pc;
+        }
+    }
+    sort_counts = p->addresses;
+    qsort(order, count, sizeof(uint16_t), compare_addresses);
+    return count;
+}
+
+static uint16_t opcode_at(const struct chip8 *c8, uint16_t pc)
+{
+    return c8->memory[pc] << 8 | c8->memory[(pc + 1) & 0xfff];
+}
+
+void profile_report(const struct chip8 *c8, FILE *f)
+{
+    const struct profile *p = c8->profile;
+    if (p == NULL)
+    {
+        return;
+    }
+    uint64_t total = total_instructions(p);
+    double scale = total != 0 ? 100.0 / total : 0;
+    char text[DISASM_OP_MAX];
+
+    fprintf(f, "profile: %llu instructions\n", (unsigned long long)total);
+    fprintf(f, "\nhottest addresses:\n");
+    uint16_t order[4096];
+    int count = hot_addresses(p, order);
+    for (int i = 0; i < count && i < (int)profile_top; i++)
+    {
+        uint16_t pc = order[i];
+        format_op(opcode_at(c8, pc), text);
+        fprintf(f, "  %03X  %12llu %6.2f%%  %04X  %s\n", pc, (unsigned long long)p->addresses[pc],
+                p->addresses[pc] * scale, opcode_at(c8, pc), text);
+    }
+
+    fprintf(f, "\ninstructions:\n");
+    uint64_t classes[DISASM_CLASS_COUNT];
+    count_classes(p, classes);
+    for (int i = 0; i < DISASM_CLASS_COUNT; i++)
+    {
+        if (classes[i] != 0)
+        {
+            format_class(i, text);
+            fprintf(f, "  %-16s %12llu %6.2f%%\n", text, (unsigned long long)classes[i], classes[i] * scale);
+        }
+    }
+
+    uint64_t skips = p->skips_taken + p->skips_not_taken;
+    fprintf(f, "\nskips: %llu taken, %llu not taken (%.1f%% taken)\n",
+            (unsigned long long)p->skips_taken, (unsigned long long)p->skips_not_taken,
+            skips != 0 ? 100.0 * p->skips_taken / skips : 0);
+    fprintf(f, "draws: %llu, %llu pixels (%.1f per draw)\n",
+            (unsigned long long)p->draws, (unsigned long long)p->pixels_drawn,
+            p->draws != 0 ? (double)p->pixels_drawn / p->draws : 0);
+    fprintf(f, "presents: %llu, %.3f ms (%.1f us per present)\n",
+            (unsigned long long)p->presents, p->present_ns / 1e6,
+            p->presents != 0 ? p->present_ns / 1e3 / p->presents : 0);
+}
+
+// one row per counter: the kind of counter, what it counts (an address, an
+// instruction class or a name), the count and the disassembly
+void profile_write_csv(const struct chip8 *c8, FILE *f)
+{
+    const struct profile *p = c8->profile;
+    if (p == NULL)
+    {
+        return;
+    }
+    char text[DISASM_OP_MAX];
+    fprintf(f, "kind,key,count,opcode,disassembly\n");
+    uint16_t order[4096];
+    int count = hot_addresses(p, order);
+    for (int i = 0; i < count; i++)
+    {
+        uint16_t pc = order[i];
+        format_op(opcode_at(c8, pc), text);
+        fprintf(f, "address,0x%03X,%llu,0x%04X,\"%s\"\n", pc, (unsigned long long)p->addresses[pc],
+                opcode_at(c8, pc), text);
+    }
+
+    uint64_t classes[DISASM_CLASS_COUNT];
+    count_classes(p, classes);
+    for (int i = 0; i < DISASM_CLASS_COUNT; i++)
+    {
+        if (classes[i] != 0)
+        {
+            format_class(i, text);
+            fprintf(f, "class,\"%s\",%llu,,\n", text, (unsigned long long)classes[i]);
+        }
+    }
+
+    fprintf(f, "counter,skips_taken,%llu,,\n", (unsigned long long)p->skips_taken);
+    fprintf(f, "counter,skips_not_taken,%llu,,\n", (unsigned long long)p->skips_not_taken);
+    fprintf(f, "counter,draws,%llu,,\n", (unsigned long long)p->draws);
+    fprintf(f, "counter,pixels_drawn,%llu,,\n", (unsigned long long)p->pixels_drawn);
+    fprintf(f, "counter,presents,%llu,,\n", (unsigned long long)p->presents);
+    fprintf(f, "counter,present_ns,%llu,,\n", (unsigned long long)p->present_ns);
+}
+
+void profile_write_json(const struct chip8 *c8, FILE *f)
+{
+    const struct profile *p = c8->profile;
+    if (p == NULL)
+    {
+        return;
+    }
+    char text[DISASM_OP_MAX];
+    fprintf(f, "{\n  \"instructions\": %llu,\n  \"addresses\": [", (unsigned long long)total_instructions(p));
+    uint16_t order[4096];
+    int count = hot_addresses(p, order);
+    for (int i = 0; i < count; i++)
+    {
+        uint16_t pc = order[i];
+        format_op(opcode_at(c8, pc), text);
+        fprintf(f, "%s\n    { \"pc\": %u, \"count\": %llu, \"opcode\": %u, \"disassembly\": \"%s\" }",
+                i == 0 ? "" : ",", pc, (unsigned long long)p->addresses[pc], opcode_at(c8, pc), text);
+    }
+
+    fprintf(f, "\n  ],\n  \"classes\": [");
+    uint64_t classes[DISASM_CLASS_COUNT];
+    count_classes(p, classes);
+    bool first = true;
+    for (int i = 0; i < DISASM_CLASS_COUNT; i++)
+    {
+        if (classes[i] != 0)
+        {
+            format_class(i, text);
+            fprintf(f, "%s\n    { \"class\": \"%s\", \"count\": %llu }", first ? "" : ",", text,
+                    (unsigned long long)classes[i]);
+            first = false;
+        }
+    }
+
+    fprintf(f, "\n  ],\n  \"skips_taken\": %llu,\n  \"skips_not_taken\": %llu,\n",
+            (unsigned long long)p->skips_taken, (unsigned long long)p->skips_not_taken);
+    fprintf(f, "  \"draws\": %llu,\n  \"pixels_drawn\": %llu,\n",
+            (unsigned long long)p->draws, (unsigned long long)p->pixels_drawn);
+    fprintf(f, "  \"presents\": %llu,\n  \"present_ns\": %llu\n}\n",
+            (unsigned long long)p->presents, (unsigned long long)p->present_ns);
+}
@@ -0,0 +1,116 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// execution profiler. counts every instruction by opcode and by address,
+// skips taken and not taken, DRW calls and the pixels they draw, and
+// presents with the time spent in them. the counting hooks only exist in
+// builds with CHIP8_PROFILE defined (make chip8-profile), elsewhere they
+// compile to nothing and profile_open fails
+
+struct profile
+{
+    // executions of each opcode value and of the instruction at each
+    // address. opcodes are grouped into handler classes for the report
+    uint64_t opcodes[65536];
+    uint64_t addresses[4096];
+
+    uint64_t skips_taken;
+    uint64_t skips_not_taken;
+
+    uint64_t draws;
+    uint64_t pixels_drawn;
+
+    uint64_t presents;
+    uint64_t present_ns;
+};
+
+#ifdef CHIP8_PROFILE
+
+#define PROFILE_STEP(c8) \
+    do \
+    { \
+        if ((c8)->profile != NULL) \
+        { \
+            (c8)->profile->opcodes[(c8)->current_opcode]++; \
+            (c8)->profile->addresses[(c8)->reg_pc & 0xfff]++; \
+        } \
+    } while (0)
+
+#define PROFILE_SKIP(c8, taken) \
+    do \
+    { \
+        if ((c8)->profile != NULL) \
+        { \
+            if (taken) \
+            { \
+                (c8)->profile->skips_taken++; \
+            } \
+            else \
+            { \
+                (c8)->profile->skips_not_taken++; \
+            } \
+        } \
+    } while (0)
+
+// a sprite of n rows drawn at column x, row y
+#define PROFILE_DRAW(c8, x, y, n) profile_draw(c8, x, y, n)
+
+// time a present of the display
+#define PROFILE_PRESENT(c8, present) \
+    do \
+    { \
+        if ((c8)->profile != NULL) \
+        { \
+            uint64_t profile_start = profile_clock(); \
+            present; \
+            (c8)->profile->presents++; \
+            (c8)->profile->present_ns += profile_clock() - profile_start; \
+        } \
+        else \
+        { \
+            present; \
+        } \
+    } while (0)
+
+// count every instruction of a translated block of count instructions
+// starting at start, which all run, once the block has run. a skip ending
+// the block was taken if it left pc past the next instruction
+#define PROFILE_BLOCK(c8, start, count) profile_block(c8, start, count)
+
+// write the report and export if SIGUSR1 has arrived since the last poll
+#define PROFILE_POLL(c8) profile_poll(c8)
+
+uint64_t profile_clock();
+void profile_draw(struct chip8 *c8, uint8_t x, uint8_t y, uint8_t n);
+void profile_block(struct chip8 *c8, uint16_t start, uint16_t count);
+void profile_poll(struct chip8 *c8);
+
+#else
+
+#define PROFILE_STEP(c8) ((void)0)
+#define PROFILE_SKIP(c8, taken) ((void)0)
+#define PROFILE_DRAW(c8, x, y, n) ((void)0)
+#define PROFILE_PRESENT(c8, present) present
+#define PROFILE_BLOCK(c8, start, count) ((void)0)
+#define PROFILE_POLL(c8) ((void)0)
+
+#endif
+
+// file the counters are exported to, as csv or json by its extension, and
+// the number of addresses listed in the hotspot report. NULL skips the
+// export
+extern const char *profile_path;
+extern uint32_t profile_top;
+
+// start counting on a machine, false if this build has no profiler
+bool profile_open(struct chip8 *c8);
+
+// write the report and the export, then stop counting
+void profile_close(struct chip8 *c8);
+
+// write the hotspot report, and the counters as csv or json
+void profile_report(const struct chip8 *c8, FILE *f);
+void profile_write_csv(const struct chip8 *c8, FILE *f);
+void profile_write_json(const struct chip8 *c8, FILE *f);
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "randrom.h"
+
+// subroutines after the program, each a few ALU opcodes and a return
+#define RANDOM_ROM_SUBROUTINES 4
+
+// random programs keep their data from here up, away from the code
+#define RANDOM_ROM_DATA 0x600
+
+uint32_t random_next(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (*state * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+uint32_t random_below(uint64_t *state, uint32_t limit)
+{
+    return random_next(state) % limit;
+}
+
+struct generator
+{
+    struct random_rom *rom;
+    uint64_t *state;
+
+    // the kk byte of every 6xkk and 7xkk, for writes that change code
+    uint16_t operands[2 * RANDOM_ROM_UNITS];
+    int operand_count;
+};
+
+static void put(struct generator *g, uint16_t opcode)
+{
+    g->rom->code[g->rom->size++] = opcode >> 8;
+    g->rom->code[g->rom->size++] = opcode & 0xff;
+}
+
+// a register operation the jit and the lanes run natively
+static void put_alu(struct generator *g)
+{
+    static const uint8_t alu_ops[9] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xe };
+    uint16_t x = random_below(g->state, 16) << 8;
+    uint16_t y = random_below(g->state, 16) << 4;
+    switch (random_below(g->state, 8))
+    {
+    case 0:
+    case 1:
+        g->operands[g->operand_count++] = 0x200 + g->rom->size + 1;
+        put(g, 0x6000 | x | random_below(g->state, 256));
+        break;
+    case 2:
+    case 3:
+        g->operands[g->operand_count++] = 0x200 + g->rom->size + 1;
+        put(g, 0x7000 | x | random_below(g->state, 256));
+        break;
+    case 4:
+        put(g, 0xc000 | x | random_below(g->state, 256));
+        break;
+    default:
+        put(g, 0x8000 | x | y | alu_ops[random_below(g->state, 9)]);
+        break;
+    }
+}
+
+void random_rom_generate(struct random_rom *rom, uint64_t *state)
+{
+    struct generator g = { rom, state, { 0 }, 0 };
+    rom->size = 0;
+
+    // jumps and calls are written once the units and subroutines they go
+    // to are placed
+    uint16_t units[RANDOM_ROM_UNITS + 1];
+    int unit_count = 0;
+    uint16_t jumps[RANDOM_ROM_UNITS];
+    int jump_units[RANDOM_ROM_UNITS];
+    int jump_count = 0;
+    uint16_t calls[RANDOM_ROM_UNITS];
+    int call_count = 0;
+
+    while (unit_count < RANDOM_ROM_UNITS)
+    {
+        units[unit_count++] = 0x200 + rom->size;
+        uint16_t x = random_below(state, 16) << 8;
+        uint16_t y = random_below(state, 16) << 4;
+        uint32_t kind = random_below(state, 32);
+        if (kind < 11)
+        {
+            put_alu(&g);
+        }
+        else if (kind < 14)
+        {
+            static const uint16_t i_ops[3] = { 0xa000, 0xf01e, 0xf029 };
+            uint16_t op = i_ops[random_below(state, 3)];
+            put(&g, op == 0xa000 ? op | random_below(state, 4096) : op | x);
+        }
+        else if (kind < 19)
+        {
+            // a skip and the unit it skips, small values so both ways are
+            // taken
+            static const uint16_t skips[6] = { 0x3000, 0x4000, 0x5000, 0x9000, 0xe09e, 0xe0a1 };
+            uint16_t op = skips[random_below(state, 6)] | x;
+            if (op >> 12 == 0x5 || op >> 12 == 0x9)
+            {
+                op |= y;
+            }
+            else if (op >> 12 != 0xe)
+            {
+                op |= random_below(state, 4);
+            }
+            put(&g, op);
+            if (random_below(state, 4) == 0)
+            {
+                // a loop back that the skip can leave
+                jump_units[jump_count] = -1;
+                jumps[jump_count++] = rom->size;
+                put(&g, 0x1000);
+            }
+            else
+            {
+                put_alu(&g);
+            }
+        }
+        else if (kind < 22)
+        {
+            jump_units[jump_count] = unit_count;
+            jumps[jump_count++] = rom->size;
+            put(&g, 0x1000);
+        }
+        else if (kind < 23)
+        {
+            calls[call_count++] = rom->size;
+            put(&g, 0x2000);
+        }
+        else if (kind < 25)
+        {
+            static const uint16_t timer_ops[3] = { 0xf007, 0xf015, 0xf018 };
+            put(&g, timer_ops[random_below(state, 3)] | x);
+        }
+        else if (kind < 27)
+        {
+            if (random_below(state, 4) == 0)
+            {
+                // VF as a coordinate, nonzero before the collision flag
+                // overwrites it
+                put(&g, 0x6f00 | (1 + random_below(state, 255)));
+                if (random_below(state, 2) == 0)
+                {
+                    x = 0xf00;
+                }
+                else
+                {
+                    y = 0xf0;
+                }
+            }
+            put(&g, 0xa000 | random_below(state, 4096));
+            put(&g, 0xd000 | x | y | random_below(state, 16));
+        }
+        else if (kind < 28)
+        {
+            put(&g, 0xa000 | (RANDOM_ROM_DATA + random_below(state, 0x100)));
+            put(&g, 0xf033 | x);
+        }
+        else if (kind < 29)
+        {
+            put(&g, 0xa000 | (RANDOM_ROM_DATA + random_below(state, 0x100)));
+            put(&g, 0xf055 | x);
+        }
+        else if (kind < 30)
+        {
+            put(&g, 0xa000 | random_below(state, 4096));
+            put(&g, 0xf065 | x);
+        }
+        else if (kind < 31 && g.operand_count > 0)
+        {
+            // V0 over the operand of an earlier 6xkk or 7xkk, code that may
+            // have been translated or decoded already
+            put(&g, 0xa000 | g.operands[random_below(state, g.operand_count)]);
+            put(&g, 0xf055);
+        }
+        else if (random_below(state, 4) == 0)
+        {
+            put(&g, 0xf00a | x);
+        }
+        else
+        {
+            put_alu(&g);
+        }
+    }
+
+    // the end jumps back to the start, so pc never runs off the program. a
+    // jump on its own goes forward and only one behind a skip goes back,
+    // so every loop has a way out and the whole program runs
+    units[unit_count] = 0x200 + rom->size;
+    put(&g, 0x1200);
+    for (int i = 0; i < jump_count; i++)
+    {
+        uint16_t target;
+        if (jump_units[i] < 0)
+        {
+            int before = 0;
+            while (before < unit_count && units[before] < 0x200 + jumps[i])
+            {
+                before++;
+            }
+            target = units[random_below(state, before)];
+        }
+        else
+        {
+            target = units[jump_units[i] + random_below(state, unit_count + 1 - jump_units[i])];
+        }
+        rom->code[jumps[i]] = 0x10 | target >> 8;
+        rom->code[jumps[i] + 1] = target & 0xff;
+    }
+
+    uint16_t subroutines[RANDOM_ROM_SUBROUTINES];
+    for (int i = 0; i < RANDOM_ROM_SUBROUTINES; i++)
+    {
+        subroutines[i] = 0x200 + rom->size;
+        for (uint32_t n = 1 + random_below(state, 4); n > 0; n--)
+        {
+            put_alu(&g);
+        }
+        put(&g, 0x00ee);
+    }
+    for (int i = 0; i < call_count; i++)
+    {
+        uint16_t target = subroutines[random_below(state, RANDOM_ROM_SUBROUTINES)];
+        rom->code[calls[i]] = 0x20 | target >> 8;
+        rom->code[calls[i] + 1] = target & 0xff;
+    }
+}
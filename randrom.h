@@ -0,0 +1,28 @@
+#ifndef RANDROM_H
+#define RANDROM_H
+
+// random programs for the differential checks, which run one program two
+// ways and compare the machines. a program is a run of units of one or two
+// instructions: ALU and I register opcodes, skips, jumps, timers, DRW, key
+// waits, BCD, register stores and loads, calls to short subroutines and
+// Fx55 writes over the operands of its own 6xkk and 7xkk. a jump only lands
+// on the start of a unit and a skip skips a whole one, so the Annn in front
+// of a memory write always runs and the write lands where it was meant to.
+// pc never leaves the program, the stack never goes deeper than one call
+// and no opcode is unknown
+
+#define RANDOM_ROM_UNITS 128
+
+struct random_rom
+{
+    uint8_t code[4096 - 0x200];
+    size_t size;
+};
+
+// xorshift64*, the state is never 0
+uint32_t random_next(uint64_t *state);
+uint32_t random_below(uint64_t *state, uint32_t limit);
+
+void random_rom_generate(struct random_rom *rom, uint64_t *state);
+
+#endif
@@ -0,0 +1,608 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "chip8.h"
+#include "jit.h"
+#include "backend.h"
+#include "replay.h"
+
+// regression runner: runs every rom of a manifest headless across all cores,
+// hashes the display and chosen memory regions at checkpoints and compares
+// the hashes with a golden file, or writes a new golden file with --update
+
+#define MAX_CHECKPOINTS 32
+#define MAX_REGIONS 8
+
+// the state of a run at one checkpoint
+struct checkpoint
+{
+    uint64_t cycle;
+    uint64_t instructions;
+    uint64_t display_hash;
+    uint64_t memory_hash;
+};
+
+struct region
+{
+    uint16_t start;
+    uint16_t end;
+};
+
+struct test
+{
+    char *rom_path;
+    char *input_path;
+    uint64_t seed;
+    struct checkpoint checkpoints[MAX_CHECKPOINTS];
+    int checkpoint_count;
+    struct region regions[MAX_REGIONS];
+    int region_count;
+
+    // results
+    bool ran;
+    bool faulted;
+    uint16_t fault_pc;
+    uint16_t fault_opcode;
+    uint64_t idle_skipped;
+    double seconds;
+};
+
+// a line of the golden file
+struct golden
+{
+    char *rom_path;
+    char *input_path;
+    uint64_t seed;
+    struct checkpoint checkpoint;
+};
+
+static struct test *tests;
+static size_t test_count;
+static struct golden *goldens;
+static size_t golden_count;
+
+// tests are handed out in manifest order, one at a time
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t next_test;
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// "1000,50000,200000", in increasing order
+static bool parse_checkpoints(char *text, struct test *test)
+{
+    for (char *item = strtok(text, ","); item != NULL; item = strtok(NULL, ","))
+    {
+        char *end;
+        uint64_t cycle = strtoull(item, &end, 10);
+        if (*end != '\0' || cycle == 0 || test->checkpoint_count == MAX_CHECKPOINTS ||
+            (test->checkpoint_count > 0 && cycle <= test->checkpoints[test->checkpoint_count - 1].cycle))
+        {
+            return false;
+        }
+        test->checkpoints[test->checkpoint_count++].cycle = cycle;
+    }
+    return test->checkpoint_count > 0;
+}
+
+// "200-2ff,ea0-eff", inclusive hex addresses
+static bool parse_regions(char *text, struct test *test)
+{
+    for (char *item = strtok(text, ","); item != NULL; item = strtok(NULL, ","))
+    {
+        unsigned int start;
+        unsigned int end;
+        if (sscanf(item, "%x-%x", &start, &end) != 2 || start > end || end > 0xfff ||
+            test->region_count == MAX_REGIONS)
+        {
+            return false;
+        }
+        test->regions[test->region_count].start = start;
+        test->regions[test->region_count].end = end;
+        test->region_count++;
+    }
+    return true;
+}
+
+// reads lines of the form "<rom> <input script or recording, - for none>
+// <checkpoints> [seed=N] [mem=regions]", blank lines and lines starting
+// with # are ignored
+static bool load_manifest(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror("unable to open manifest");
+        return false;
+    }
+
+    size_t capacity = 0;
+    char line[1024];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        char rom_path[512];
+        char input_path[512];
+        char checkpoints[256];
+        char options[2][256];
+        int fields = sscanf(line, "%511s %511s %255s %255s %255s", rom_path, input_path, checkpoints,
+                            options[0], options[1]);
+
+        if (test_count == capacity)
+        {
+            size_t grown_capacity = capacity == 0 ? 256 : capacity * 2;
+            struct test *grown = realloc(tests, grown_capacity * sizeof(struct test));
+            if (grown == NULL)
+            {
+                printf("out of memory reading manifest line %d\n", line_number);
+                fclose(f);
+                return false;
+            }
+            tests = grown;
+            capacity = grown_capacity;
+        }
+        struct test *test = &tests[test_count];
+        memset(test, 0, sizeof(struct test));
+        bool ok = fields >= 3 && parse_checkpoints(checkpoints, test);
+        for (int i = 0; ok && i < fields - 3; i++)
+        {
+            if (strncmp(options[i], "seed=", 5) == 0)
+            {
+                test->seed = strtoull(options[i] + 5, NULL, 0);
+            }
+            else if (strncmp(options[i], "mem=", 4) == 0)
+            {
+                ok = parse_regions(options[i] + 4, test);
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+        if (!ok)
+        {
+            printf("bad manifest line %d: %s", line_number, line);
+            fclose(f);
+            return false;
+        }
+        test->rom_path = strdup(rom_path);
+        test->input_path = strdup(input_path);
+        if (test->rom_path == NULL || test->input_path == NULL)
+        {
+            printf("out of memory reading manifest line %d\n", line_number);
+            free(test->rom_path);
+            free(test->input_path);
+            fclose(f);
+            return false;
+        }
+        test_count++;
+    }
+    fclose(f);
+    return true;
+}
+
+// reads lines of the form "<rom> <input> <seed> <checkpoint> <instructions>
+// <display hash> <memory hash>" as written by --update
+static bool load_goldens(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        perror("unable to open golden file");
+        return false;
+    }
+
+    size_t capacity = 0;
+    char line[1024];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line_number++;
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        char rom_path[512];
+        char input_path[512];
+        unsigned long long seed;
+        unsigned long long cycle;
+        unsigned long long instructions;
+        unsigned long long display;
+        unsigned long long memory;
+        if (sscanf(line, "%511s %511s %llu %llu %llu %llx %llx", rom_path, input_path, &seed, &cycle,
+                   &instructions, &display, &memory) != 7)
+        {
+            printf("bad golden file line %d: %s", line_number, line);
+            fclose(f);
+            return false;
+        }
+
+        if (golden_count == capacity)
+        {
+            size_t grown_capacity = capacity == 0 ? 256 : capacity * 2;
+            struct golden *grown = realloc(goldens, grown_capacity * sizeof(struct golden));
+            if (grown == NULL)
+            {
+                printf("out of memory reading golden file line %d\n", line_number);
+                fclose(f);
+                return false;
+            }
+            goldens = grown;
+            capacity = grown_capacity;
+        }
+        struct golden *golden = &goldens[golden_count];
+        golden->rom_path = strdup(rom_path);
+        golden->input_path = strdup(input_path);
+        if (golden->rom_path == NULL || golden->input_path == NULL)
+        {
+            printf("out of memory reading golden file line %d\n", line_number);
+            free(golden->rom_path);
+            free(golden->input_path);
+            fclose(f);
+            return false;
+        }
+        golden_count++;
+        golden->seed = seed;
+        golden->checkpoint.cycle = cycle;
+        golden->checkpoint.instructions = instructions;
+        golden->checkpoint.display_hash = display;
+        golden->checkpoint.memory_hash = memory;
+    }
+    fclose(f);
+    return true;
+}
+
+static const struct golden *find_golden(const struct test *test, uint64_t cycle)
+{
+    for (size_t i = 0; i < golden_count; i++)
+    {
+        const struct golden *golden = &goldens[i];
+        if (golden->checkpoint.cycle == cycle && golden->seed == test->seed &&
+            strcmp(golden->rom_path, test->rom_path) == 0 && strcmp(golden->input_path, test->input_path) == 0)
+        {
+            return golden;
+        }
+    }
+    return NULL;
+}
+
+static bool write_goldens(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        perror("unable to write golden file");
+        return false;
+    }
+    fprintf(f, "# rom input seed checkpoint instructions display_hash memory_hash\n");
+    for (size_t i = 0; i < test_count; i++)
+    {
+        const struct test *test = &tests[i];
+        for (int j = 0; test->ran && !test->faulted && j < test->checkpoint_count; j++)
+        {
+            const struct checkpoint *c = &test->checkpoints[j];
+            fprintf(f, "%s %s %llu %llu %llu %016llx %016llx\n", test->rom_path, test->input_path,
+                    (unsigned long long)test->seed, (unsigned long long)c->cycle,
+                    (unsigned long long)c->instructions, (unsigned long long)c->display_hash,
+                    (unsigned long long)c->memory_hash);
+        }
+    }
+    return fclose(f) == 0;
+}
+
+// fnv-1a over the chosen memory regions
+static uint64_t memory_hash(const struct chip8 *c8, const struct test *test)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (int i = 0; i < test->region_count; i++)
+    {
+        for (int address = test->regions[i].start; address <= test->regions[i].end; address++)
+        {
+            hash = (hash ^ c8->memory[address]) * 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+static void run_test(struct chip8 *c8, struct test *test)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the worker's machine ran other tests, and a recording sets its own
+    // rate and profile, so every test starts from the defaults
+    set_cycles_per_second(c8, DEFAULT_CYCLES_PER_SECOND);
+    if (c8->quirks != QUIRKS_MODERN)
+    {
+        set_quirk_profile(c8, QUIRKS_MODERN);
+    }
+    seed_random(c8, test->seed);
+    reset_emulator(c8);
+    c8->backend = &headless_backend;
+    if (!load_rom(c8, test->rom_path))
+    {
+        printf("unable to open rom %s\n", test->rom_path);
+        return;
+    }
+    if (!c8->backend->init(c8))
+    {
+        return;
+    }
+
+    bool loaded = true;
+    if (strcmp(test->input_path, "-") != 0)
+    {
+        if (replay_is_recording(test->input_path))
+        {
+            // the checkpoints decide how long it runs, not the recording
+            uint64_t end;
+            loaded = replay_load(c8, test->input_path, &end);
+        }
+        else
+        {
+            loaded = headless_load_input(c8, test->input_path);
+        }
+    }
+    if (loaded)
+    {
+        for (int i = 0; i < test->checkpoint_count; i++)
+        {
+            struct checkpoint *c = &test->checkpoints[i];
+            run_emulator(c8, c->cycle, NULL, false);
+            c->instructions = c8->instruction_count;
+            c->display_hash = display_hash(c8);
+            c->memory_hash = memory_hash(c8, test);
+        }
+        test->ran = true;
+        test->faulted = c8->faulted;
+        test->fault_pc = c8->fault_pc;
+        test->fault_opcode = c8->fault_opcode;
+        test->idle_skipped = c8->idle_skipped;
+    }
+    c8->backend->cleanup(c8);
+
+    test->seconds = elapsed_seconds(&start);
+}
+
+static void *worker_main(void *arg)
+{
+    struct chip8 *c8 = create_emulator();
+    if (c8 == NULL)
+    {
+        return NULL;
+    }
+    if (dispatch_mode == DISPATCH_JIT)
+    {
+        jit_init(c8);
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&next_lock);
+        size_t test = next_test++;
+        pthread_mutex_unlock(&next_lock);
+        if (test >= test_count)
+        {
+            break;
+        }
+        run_test(c8, &tests[test]);
+    }
+
+    destroy_emulator(c8);
+    return NULL;
+}
+
+// compare a test with its goldens, false if any checkpoint differs or has
+// no golden. with report set the differences are printed
+static bool check_test(const struct test *test, bool report)
+{
+    bool ok = true;
+    for (int i = 0; i < test->checkpoint_count; i++)
+    {
+        const struct checkpoint *c = &test->checkpoints[i];
+        const struct golden *golden = find_golden(test, c->cycle);
+        if (golden == NULL)
+        {
+            if (report)
+            {
+                printf("    %llu: no golden\n", (unsigned long long)c->cycle);
+            }
+            ok = false;
+            continue;
+        }
+        const struct checkpoint *g = &golden->checkpoint;
+        if (c->instructions != g->instructions)
+        {
+            if (report)
+            {
+                printf("    %llu: stopped after %llu instructions, expected %llu\n", (unsigned long long)c->cycle,
+                       (unsigned long long)c->instructions, (unsigned long long)g->instructions);
+            }
+            ok = false;
+        }
+        if (c->display_hash != g->display_hash)
+        {
+            if (report)
+            {
+                printf("    %llu: display %016llx, expected %016llx\n", (unsigned long long)c->cycle,
+                       (unsigned long long)c->display_hash, (unsigned long long)g->display_hash);
+            }
+            ok = false;
+        }
+        if (c->memory_hash != g->memory_hash)
+        {
+            if (report)
+            {
+                printf("    %llu: memory %016llx, expected %016llx\n", (unsigned long long)c->cycle,
+                       (unsigned long long)c->memory_hash, (unsigned long long)g->memory_hash);
+            }
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: ./chip8-regress [manifest] [--golden=file] [--update] [--threads=count]\n"
+               "                       [--dispatch=chain|table|threaded|cached|jit] [--no-idle-skip]\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *manifest_path = argv[1];
+    char *golden_path = NULL;
+    bool update = false;
+    int worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--golden=", 9) == 0)
+        {
+            golden_path = strdup(argv[i] + 9);
+        }
+        else if (strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if (strcmp(argv[i], "--no-idle-skip") == 0)
+        {
+            idle_skip = false;
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            worker_count = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--dispatch=", 11) == 0)
+        {
+            if (!parse_dispatch_mode(argv[i] + 11, &dispatch_mode))
+            {
+                printf("unknown dispatch mode %s\n", argv[i] + 11);
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            printf("unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (worker_count < 1)
+    {
+        worker_count = 1;
+    }
+
+    // the goldens live next to the manifest unless given
+    if (golden_path == NULL)
+    {
+        golden_path = malloc(strlen(manifest_path) + 8);
+        if (golden_path == NULL)
+        {
+            printf("out of memory\n");
+            return EXIT_FAILURE;
+        }
+        sprintf(golden_path, "%s.golden", manifest_path);
+    }
+
+    if (!load_manifest(manifest_path) || (!update && !load_goldens(golden_path)))
+    {
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t *workers = calloc(worker_count, sizeof(pthread_t));
+    int started = 0;
+    while (started < worker_count && pthread_create(&workers[started], NULL, worker_main, NULL) == 0)
+    {
+        started++;
+    }
+    // the main thread stands in for the workers that could not start
+    if (started < worker_count)
+    {
+        worker_main(NULL);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    double seconds = elapsed_seconds(&start);
+
+    int failures = 0;
+    uint64_t total_instructions = 0;
+    uint64_t total_skipped = 0;
+    for (size_t i = 0; i < test_count; i++)
+    {
+        struct test *test = &tests[i];
+        total_skipped += test->idle_skipped;
+        bool passed = test->ran && !test->faulted && (update || check_test(test, false));
+        printf("%s %s %s seed=%llu %.3f s\n", passed ? (update ? "RUN " : "PASS") : "FAIL", test->rom_path,
+               test->input_path, (unsigned long long)test->seed, test->seconds);
+        if (test->ran)
+        {
+            total_instructions += test->checkpoints[test->checkpoint_count - 1].instructions;
+        }
+        if (!passed)
+        {
+            if (test->faulted)
+            {
+                printf("    unknown opcode %04X at %03X\n", test->fault_opcode, test->fault_pc);
+            }
+            else if (test->ran)
+            {
+                check_test(test, true);
+            }
+            failures++;
+        }
+    }
+
+    printf("tests: %zu (%d failed)\n", test_count, failures);
+    printf("threads: %d\n", worker_count);
+    printf("instructions: %llu (%llu skipped in idle loops)\n", (unsigned long long)total_instructions,
+           (unsigned long long)total_skipped);
+    printf("wall time: %.3f s\n", seconds);
+
+    if (update)
+    {
+        if (!write_goldens(golden_path))
+        {
+            return EXIT_FAILURE;
+        }
+        printf("goldens written to %s\n", golden_path);
+    }
+
+    for (size_t i = 0; i < test_count; i++)
+    {
+        free(tests[i].rom_path);
+        free(tests[i].input_path);
+    }
+    free(tests);
+    for (size_t i = 0; i < golden_count; i++)
+    {
+        free(goldens[i].rom_path);
+        free(goldens[i].input_path);
+    }
+    free(goldens);
+    free(workers);
+    free(golden_path);
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
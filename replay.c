@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "chip8.h"
+#include "backend.h"
+#include "replay.h"
+
+// a point in emulated time: a frame and the instructions run into it
+struct stamp
+{
+    uint64_t frame;
+    uint32_t offset;
+};
+
+// the key state from a stamp on
+struct key_change
+{
+    struct stamp at;
+    uint16_t keys;
+};
+
+// what the machine started from, the first part of the file
+struct recording_header
+{
+    uint32_t cycles_per_second;
+    uint64_t random_seed;
+    uint64_t random_state;
+    uint8_t quirks;
+    uint16_t rom_size;
+    uint64_t program_hash;
+    uint64_t start_instruction;
+    uint64_t start_frame;
+    uint32_t start_frame_cycles_left;
+    uint16_t start_keys;
+    struct stamp end;
+    bool halted;
+    uint32_t change_count;
+};
+
+struct recorder
+{
+    char *path;
+    struct recording_header header;
+    struct key_change *changes;
+    size_t change_count;
+    size_t change_capacity;
+};
+
+// header, then per change the frame as a varint delta from the one before
+// (the start frame for the first), the offset as a varint and the keys
+#define HEADER_SIZE (4 + 2 + 4 + 8 + 8 + 1 + 2 + 8 + 8 + 8 + 4 + 2 + 8 + 4 + 1 + 4)
+#define MAX_CHANGE_SIZE (10 + 5 + 2)
+
+static uint8_t *put(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        *p++ = value >> (8 * i);
+    }
+    return p;
+}
+
+static const uint8_t *get(const uint8_t *p, uint64_t *value, int bytes)
+{
+    *value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        *value |= (uint64_t)*p++ << (8 * i);
+    }
+    return p;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+// NULL if the varint runs past end
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        *value |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static struct stamp current_stamp(const struct chip8 *c8)
+{
+    struct stamp stamp;
+    stamp.frame = c8->frame_count;
+    stamp.offset = frame_cycles(c8, c8->frame_count) - c8->frame_cycles_left;
+    return stamp;
+}
+
+static bool stamp_before(struct stamp a, struct stamp b)
+{
+    return a.frame < b.frame || (a.frame == b.frame && a.offset < b.offset);
+}
+
+// fnv-1a of the rom area, a recording only fits the program it was made on
+static uint64_t program_hash(const struct chip8 *c8)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (int i = 0; i < c8->rom_size; i++)
+    {
+        hash = (hash ^ c8->memory[0x200 + i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+bool record_open(struct chip8 *c8, const char *path)
+{
+    struct recorder *r = calloc(1, sizeof(struct recorder));
+    if (r == NULL)
+    {
+        return false;
+    }
+    r->path = strdup(path);
+    if (r->path == NULL)
+    {
+        free(r);
+        return false;
+    }
+
+    struct recording_header *h = &r->header;
+    h->cycles_per_second = c8->cycles_per_second;
+    h->random_seed = c8->random_seed;
+    h->random_state = c8->random_state;
+    h->quirks = c8->quirks;
+    h->rom_size = c8->rom_size;
+    h->program_hash = program_hash(c8);
+    h->start_instruction = c8->instruction_count;
+    h->start_frame = c8->frame_count;
+    h->start_frame_cycles_left = c8->frame_cycles_left;
+    h->start_keys = c8->keys;
+    c8->recorder = r;
+    return true;
+}
+
+void record_input(struct chip8 *c8)
+{
+    struct recorder *r = c8->recorder;
+    struct stamp now = current_stamp(c8);
+
+    // after a rewind the machine is back before changes that were logged,
+    // they are not part of the session that goes on from here. a change
+    // logged at this very stamp is replaced by the state polled now
+    while (r->change_count > 0 && !stamp_before(r->changes[r->change_count - 1].at, now))
+    {
+        r->change_count--;
+    }
+
+    uint16_t keys = r->change_count > 0 ? r->changes[r->change_count - 1].keys : r->header.start_keys;
+    if (c8->keys == keys)
+    {
+        return;
+    }
+    if (r->change_count == r->change_capacity)
+    {
+        size_t capacity = r->change_capacity == 0 ? 256 : r->change_capacity * 2;
+        struct key_change *changes = realloc(r->changes, capacity * sizeof(struct key_change));
+        if (changes == NULL)
+        {
+            // keep the session up to here, it replays as far as it goes
+            printf("out of memory for key changes, recording stopped\n");
+            record_close(c8);
+            return;
+        }
+        r->changes = changes;
+        r->change_capacity = capacity;
+    }
+    struct key_change *change = &r->changes[r->change_count++];
+    change->at = now;
+    change->keys = c8->keys;
+}
+
+bool record_close(struct chip8 *c8)
+{
+    struct recorder *r = c8->recorder;
+    if (r == NULL)
+    {
+        return true;
+    }
+    c8->recorder = NULL;
+
+    // the session ends here, whatever a rewind left after it did not happen
+    struct recording_header *h = &r->header;
+    h->end = current_stamp(c8);
+    h->halted = c8->halted;
+    while (r->change_count > 0 && stamp_before(h->end, r->changes[r->change_count - 1].at))
+    {
+        r->change_count--;
+    }
+    h->change_count = r->change_count;
+
+    uint8_t *data = malloc(HEADER_SIZE + r->change_count * MAX_CHANGE_SIZE);
+    bool ok = data != NULL;
+    if (ok)
+    {
+        uint8_t *p = data;
+        memcpy(p, REPLAY_MAGIC, 4);
+        p += 4;
+        p = put(p, REPLAY_VERSION, 2);
+        p = put(p, h->cycles_per_second, 4);
+        p = put(p, h->random_seed, 8);
+        p = put(p, h->random_state, 8);
+        p = put(p, h->quirks, 1);
+        p = put(p, h->rom_size, 2);
+        p = put(p, h->program_hash, 8);
+        p = put(p, h->start_instruction, 8);
+        p = put(p, h->start_frame, 8);
+        p = put(p, h->start_frame_cycles_left, 4);
+        p = put(p, h->start_keys, 2);
+        p = put(p, h->end.frame, 8);
+        p = put(p, h->end.offset, 4);
+        p = put(p, h->halted, 1);
+        p = put(p, h->change_count, 4);
+
+        uint64_t frame = h->start_frame;
+        for (size_t i = 0; i < r->change_count; i++)
+        {
+            p = put_varint(p, r->changes[i].at.frame - frame);
+            p = put_varint(p, r->changes[i].at.offset);
+            p = put(p, r->changes[i].keys, 2);
+            frame = r->changes[i].at.frame;
+        }
+
+        FILE *f = fopen(r->path, "wb");
+        ok = f != NULL && fwrite(data, 1, p - data, f) == (size_t)(p - data);
+        if (f != NULL && fclose(f) != 0)
+        {
+            ok = false;
+        }
+    }
+    if (!ok)
+    {
+        printf("unable to write recording %s\n", r->path);
+    }
+
+    free(data);
+    free(r->changes);
+    free(r->path);
+    free(r);
+    return ok;
+}
+
+// the instruction count a stamp falls on. frame f starts f * rate / 60
+// instructions after frame 0 did (see frame_cycles), counted here from the
+// frame the recording started in
+static uint64_t stamp_cycle(const struct chip8 *c8, const struct recording_header *h, struct stamp stamp)
+{
+    uint64_t rate = h->cycles_per_second;
+    uint64_t start_done = frame_cycles(c8, h->start_frame) - h->start_frame_cycles_left;
+    return h->start_instruction - start_done +
+           (stamp.frame * rate / FRAMES_PER_SECOND - h->start_frame * rate / FRAMES_PER_SECOND) + stamp.offset;
+}
+
+// queue headless events that take the keys from one state to another,
+// false if out of memory
+static bool queue_keys(struct chip8 *c8, uint64_t cycle, uint16_t from, uint16_t to)
+{
+    for (int key = 0; key < 16; key++)
+    {
+        if (((from ^ to) >> key) & 1 && !headless_add_event(c8, cycle, key, (to >> key) & 1))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    uint8_t *data = NULL;
+    long length = -1;
+    if (fseek(f, 0, SEEK_END) == 0 && (length = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0)
+    {
+        data = malloc(length > 0 ? length : 1);
+    }
+    if (data != NULL && fread(data, 1, length, f) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = length;
+    return data;
+}
+
+bool replay_is_recording(const char *path)
+{
+    char magic[4];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    bool recording = fread(magic, 1, 4, f) == 4 && memcmp(magic, REPLAY_MAGIC, 4) == 0;
+    fclose(f);
+    return recording;
+}
+
+bool replay_load(struct chip8 *c8, const char *path, uint64_t *end)
+{
+    size_t size;
+    uint8_t *data = read_file(path, &size);
+    if (data == NULL)
+    {
+        printf("unable to read recording %s\n", path);
+        return false;
+    }
+
+    const uint8_t *p = data;
+    const uint8_t *data_end = data + size;
+    uint64_t value;
+    struct recording_header h;
+    if (size >= HEADER_SIZE && memcmp(p, REPLAY_MAGIC, 4) == 0)
+    {
+        p = get(p + 4, &value, 2);
+    }
+    if (p == data || value != REPLAY_VERSION)
+    {
+        printf("%s is not a version %d recording\n", path, REPLAY_VERSION);
+        free(data);
+        return false;
+    }
+    p = get(p, &value, 4);
+    h.cycles_per_second = value;
+    p = get(p, &h.random_seed, 8);
+    p = get(p, &h.random_state, 8);
+    p = get(p, &value, 1);
+    h.quirks = value;
+    p = get(p, &value, 2);
+    h.rom_size = value;
+    p = get(p, &h.program_hash, 8);
+    p = get(p, &h.start_instruction, 8);
+    p = get(p, &h.start_frame, 8);
+    p = get(p, &value, 4);
+    h.start_frame_cycles_left = value;
+    p = get(p, &value, 2);
+    h.start_keys = value;
+    p = get(p, &h.end.frame, 8);
+    p = get(p, &value, 4);
+    h.end.offset = value;
+    p = get(p, &value, 1);
+    h.halted = value;
+    p = get(p, &value, 4);
+    h.change_count = value;
+
+    if (h.rom_size != c8->rom_size || h.program_hash != program_hash(c8))
+    {
+        printf("%s was recorded with a different rom\n", path);
+        free(data);
+        return false;
+    }
+    if (h.cycles_per_second < FRAMES_PER_SECOND || h.random_state == 0 || h.quirks >= QUIRK_PROFILE_COUNT)
+    {
+        printf("%s is damaged\n", path);
+        free(data);
+        return false;
+    }
+    set_cycles_per_second(c8, h.cycles_per_second);
+    if (c8->quirks != h.quirks)
+    {
+        set_quirk_profile(c8, h.quirks);
+    }
+    if (c8->instruction_count != h.start_instruction || c8->frame_count != h.start_frame ||
+        c8->frame_cycles_left != h.start_frame_cycles_left)
+    {
+        printf("%s starts at instruction %llu, load the snapshot it was recorded from\n", path,
+               (unsigned long long)h.start_instruction);
+        free(data);
+        return false;
+    }
+    c8->random_seed = h.random_seed;
+    c8->random_state = h.random_state;
+    c8->keys = h.start_keys;
+
+    struct stamp start = current_stamp(c8);
+    struct stamp last = start;
+    uint16_t keys = h.start_keys;
+    for (uint32_t i = 0; i < h.change_count; i++)
+    {
+        struct stamp at;
+        uint64_t delta;
+        uint64_t offset;
+        p = get_varint(p, data_end, &delta);
+        p = p != NULL ? get_varint(p, data_end, &offset) : NULL;
+        if (p == NULL || data_end - p < 2)
+        {
+            printf("%s is damaged\n", path);
+            free(data);
+            return false;
+        }
+        p = get(p, &value, 2);
+        at.frame = last.frame + delta;
+        at.offset = offset;
+        if (stamp_before(at, last) || offset >= frame_cycles(c8, at.frame))
+        {
+            printf("%s is damaged\n", path);
+            free(data);
+            return false;
+        }
+        if (!queue_keys(c8, stamp_cycle(c8, &h, at), keys, value))
+        {
+            printf("out of memory loading %s\n", path);
+            free(data);
+            return false;
+        }
+        keys = value;
+        last = at;
+    }
+    if (stamp_before(h.end, last))
+    {
+        printf("%s is damaged\n", path);
+        free(data);
+        return false;
+    }
+
+    if (h.halted)
+    {
+        // the input ran out with the machine waiting for a key, the replay
+        // halts at the same place by itself
+        *end = 0;
+    }
+    else
+    {
+        // the session may have stopped waiting for a key. an event that
+        // changes nothing at the end keeps the headless backend from halting
+        // the machine before it gets there
+        *end = stamp_cycle(c8, &h, h.end);
+        if (!headless_add_event(c8, *end, 0, keys & 1))
+        {
+            printf("out of memory loading %s\n", path);
+            free(data);
+            return false;
+        }
+    }
+
+    free(data);
+    return true;
+}
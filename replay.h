@@ -0,0 +1,37 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// input recording and replay. while recording, every change of the key
+// state is logged with the frame it happened in and how many instructions
+// into that frame, along with what the machine started from: the program,
+// the instruction rate, the quirk profile and the random number generator.
+// replaying the log on a headless machine started from the same state
+// reproduces the session instruction for instruction, as fast as the host
+// can run it
+
+#define REPLAY_MAGIC "C8IR"
+#define REPLAY_VERSION 2
+
+// start recording the keys of a machine from its current state, the log is
+// written to path when recording stops
+bool record_open(struct chip8 *c8, const char *path);
+
+// stop recording and write the log, false if it could not be written
+bool record_close(struct chip8 *c8);
+
+// log the key state after the backend has polled input
+void record_input(struct chip8 *c8);
+
+// queue the key changes of a recording on a machine using the headless
+// backend and restore the instruction rate, quirk profile and random number
+// generator it was recorded with. the machine has to be in the state the
+// recording started from, e.g. the rom freshly loaded. end is set to the
+// instruction count the recording stopped at, or 0 if it stopped because the
+// machine halted, which the replay then does as well. false, with a message,
+// if the file is bad or the machine does not match
+bool replay_load(struct chip8 *c8, const char *path, uint64_t *end);
+
+// true if the file is a recording rather than an input script
+bool replay_is_recording(const char *path);
+
+#endif
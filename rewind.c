@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "chip8.h"
+#include "snapshot.h"
+#include "rewind.h"
+
+// an encoded frame in the data ring
+struct rewind_entry
+{
+    uint32_t offset;
+    uint32_t length;
+    bool key;
+};
+
+struct rewind_buffer
+{
+    // encoded frames, written in order and wrapping to the start when the
+    // next one does not fit before the end
+    uint8_t *data;
+    size_t size;
+    size_t write_pos;
+    size_t used;
+
+    // entries[(first + i) % entry_capacity] is the i-th oldest frame
+    struct rewind_entry *entries;
+    uint32_t entry_capacity;
+    uint32_t first;
+    uint32_t count;
+
+    uint32_t interval;
+    uint32_t since_key;
+
+    // state of the newest frame, deltas are taken against it
+    struct snapshot last;
+
+    // scratch space for encoding a frame
+    uint8_t *encoded;
+};
+
+// a frame encodes as runs of "<unchanged bytes> <changed bytes> <xor of the
+// changed bytes>", with the counts as little endian base 128 varints. a
+// keyframe is the same encoding against all zero bytes
+static uint8_t *put_varint(uint8_t *p, size_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, size_t *value)
+{
+    *value = 0;
+    int shift = 0;
+    while (*p & 0x80)
+    {
+        *value |= (size_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *value |= (size_t)*p++ << shift;
+    return p;
+}
+
+static bool words_equal(const uint8_t *a, const uint8_t *b)
+{
+    uint64_t x;
+    uint64_t y;
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    return x == y;
+}
+
+// encode state against base. if update is set the changed bytes are copied
+// into it as well, leaving it equal to state
+static size_t encode(const uint8_t *state, const uint8_t *base, uint8_t *out, uint8_t *update)
+{
+    uint8_t *p = out;
+    size_t i = 0;
+    while (i < SNAPSHOT_STATE_SIZE)
+    {
+        // skip what did not change, a word at a time while possible
+        size_t start = i;
+        while (i + 8 <= SNAPSHOT_STATE_SIZE && words_equal(state + i, base + i))
+        {
+            i += 8;
+        }
+        while (i < SNAPSHOT_STATE_SIZE && state[i] == base[i])
+        {
+            i++;
+        }
+        if (i == SNAPSHOT_STATE_SIZE)
+        {
+            break;
+        }
+        size_t same = i - start;
+
+        // a changed run ends at the first pair of unchanged bytes, a
+        // single equal byte is cheaper to keep in the run
+        start = i;
+        while (i < SNAPSHOT_STATE_SIZE &&
+               (state[i] != base[i] || (i + 1 < SNAPSHOT_STATE_SIZE && state[i + 1] != base[i + 1])))
+        {
+            i++;
+        }
+        p = put_varint(p, same);
+        p = put_varint(p, i - start);
+        for (size_t j = start; j < i; j++)
+        {
+            *p++ = state[j] ^ base[j];
+        }
+        if (update != NULL)
+        {
+            memcpy(update + start, state + start, i - start);
+        }
+    }
+    return p - out;
+}
+
+// xor an encoded frame into state
+static void apply(const uint8_t *encoded, size_t length, uint8_t *state)
+{
+    const uint8_t *p = encoded;
+    const uint8_t *end = encoded + length;
+    size_t i = 0;
+    while (p < end)
+    {
+        size_t same;
+        size_t changed;
+        p = get_varint(p, &same);
+        p = get_varint(p, &changed);
+        i += same;
+        for (size_t j = 0; j < changed; j++)
+        {
+            state[i++] ^= *p++;
+        }
+    }
+}
+
+static struct rewind_entry *entry(struct rewind_buffer *r, uint32_t index)
+{
+    return &r->entries[(r->first + index) % r->entry_capacity];
+}
+
+// drop the oldest frame. the deltas after a keyframe are useless without
+// it, so they go too
+static void drop_oldest(struct rewind_buffer *r)
+{
+    do
+    {
+        r->used -= entry(r, 0)->length;
+        r->first = (r->first + 1) % r->entry_capacity;
+        r->count--;
+    } while (r->count > 0 && !entry(r, 0)->key);
+}
+
+// find room for length bytes in the data ring, dropping old frames
+static size_t allocate(struct rewind_buffer *r, size_t length)
+{
+    if (r->write_pos + length > r->size)
+    {
+        // frames between here and the end of the ring are the oldest, they
+        // have to go before the ring wraps over the frames at the start
+        while (r->count > 0 && entry(r, 0)->offset >= r->write_pos)
+        {
+            drop_oldest(r);
+        }
+        r->write_pos = 0;
+    }
+    while (r->count > 0 && entry(r, 0)->offset >= r->write_pos &&
+           entry(r, 0)->offset < r->write_pos + length)
+    {
+        drop_oldest(r);
+    }
+    if (r->count == r->entry_capacity)
+    {
+        drop_oldest(r);
+    }
+
+    size_t offset = r->write_pos;
+    r->write_pos += length;
+    return offset;
+}
+
+static void push_keyframe(struct rewind_buffer *r);
+
+static void push(struct rewind_buffer *r, const uint8_t *encoded, size_t length, bool key)
+{
+    size_t offset = allocate(r, length);
+    memcpy(r->data + offset, encoded, length);
+
+    struct rewind_entry *e = entry(r, r->count++);
+    e->offset = offset;
+    e->length = length;
+    e->key = key;
+    r->used += length;
+    r->since_key = key ? 0 : r->since_key + 1;
+
+    // a delta that needed the whole ring pushed out its own keyframe, so
+    // start again from a keyframe of the newest state
+    if (!entry(r, 0)->key)
+    {
+        r->count = 0;
+        r->used = 0;
+        push_keyframe(r);
+    }
+}
+
+static void push_keyframe(struct rewind_buffer *r)
+{
+    static const uint8_t zero[SNAPSHOT_STATE_SIZE];
+    push(r, r->encoded, encode(r->last.state, zero, r->encoded, NULL), true);
+}
+
+bool rewind_open(struct chip8 *c8, size_t budget, uint32_t interval)
+{
+    // a keyframe has to fit however badly the state compresses
+    size_t worst_case = SNAPSHOT_STATE_SIZE * 2 + 16;
+    if (budget < 4 * worst_case || interval == 0)
+    {
+        return false;
+    }
+
+    struct rewind_buffer *r = calloc(1, sizeof(struct rewind_buffer));
+    if (r == NULL)
+    {
+        return false;
+    }
+    r->size = budget;
+    r->data = malloc(budget);
+
+    // even an idle frame changes the instruction and frame counters, so
+    // a frame costs at least a few bytes
+    r->entry_capacity = budget / 8;
+    r->entries = malloc(r->entry_capacity * sizeof(struct rewind_entry));
+    r->encoded = malloc(worst_case);
+    r->interval = interval;
+    if (r->data == NULL || r->entries == NULL || r->encoded == NULL)
+    {
+        free(r->data);
+        free(r->entries);
+        free(r->encoded);
+        free(r);
+        return false;
+    }
+
+    c8->rewind = r;
+    snapshot_save(c8, &r->last);
+    push_keyframe(r);
+    return true;
+}
+
+void rewind_close(struct chip8 *c8)
+{
+    struct rewind_buffer *r = c8->rewind;
+    if (r != NULL)
+    {
+        free(r->data);
+        free(r->entries);
+        free(r->encoded);
+        free(r);
+        c8->rewind = NULL;
+    }
+}
+
+void rewind_capture(struct chip8 *c8)
+{
+    struct rewind_buffer *r = c8->rewind;
+    if (r->since_key + 1 >= r->interval)
+    {
+        snapshot_save(c8, &r->last);
+        push_keyframe(r);
+    }
+    else
+    {
+        // the machine state is the front of struct chip8, so it can be
+        // compared with the last frame where it is. encoding brings the
+        // last frame up to date without copying the whole state
+        size_t length = encode((const uint8_t *)c8, r->last.state, r->encoded, r->last.state);
+        push(r, r->encoded, length, false);
+    }
+}
+
+bool rewind_step_back(struct chip8 *c8)
+{
+    struct rewind_buffer *r = c8->rewind;
+    if (r->count < 2)
+    {
+        return false;
+    }
+
+    uint32_t newest = r->count - 1;
+    struct rewind_entry *e = entry(r, newest);
+    if (!e->key)
+    {
+        // the delta takes the newest frame back to the one before it
+        apply(r->data + e->offset, e->length, r->last.state);
+    }
+    else
+    {
+        // replay forwards from the keyframe before this one
+        uint32_t key = newest - 1;
+        while (!entry(r, key)->key)
+        {
+            key--;
+        }
+        memset(r->last.state, 0, SNAPSHOT_STATE_SIZE);
+        for (uint32_t i = key; i < newest; i++)
+        {
+            apply(r->data + entry(r, i)->offset, entry(r, i)->length, r->last.state);
+        }
+    }
+
+    // forget the newest frame, its space is reused by the next capture
+    r->write_pos = e->offset;
+    r->used -= e->length;
+    r->count--;
+    r->since_key = 0;
+    for (uint32_t i = r->count - 1; !entry(r, i)->key; i--)
+    {
+        r->since_key++;
+    }
+
+    snapshot_restore(c8, &r->last);
+    return true;
+}
+
+uint32_t rewind_frames(const struct chip8 *c8)
+{
+    return c8->rewind != NULL ? c8->rewind->count : 0;
+}
+
+size_t rewind_bytes(const struct chip8 *c8)
+{
+    return c8->rewind != NULL ? c8->rewind->used : 0;
+}
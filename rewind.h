@@ -0,0 +1,29 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+// rewind history. after every frame the machine state is recorded, as a
+// full keyframe every interval frames and as an xor delta against the frame
+// before otherwise, run length encoded so the bytes a frame did not touch
+// cost next to nothing. entries go into a fixed size ring and the oldest
+// frames are dropped when it is full
+
+#define DEFAULT_REWIND_BUDGET (4 * 1024 * 1024)
+#define DEFAULT_REWIND_INTERVAL 60
+
+// start recording history for a machine, the current state is the first
+// frame. budget is in bytes
+bool rewind_open(struct chip8 *c8, size_t budget, uint32_t interval);
+void rewind_close(struct chip8 *c8);
+
+// record the state at the end of a frame
+void rewind_capture(struct chip8 *c8);
+
+// go back to the previous recorded frame, false once the oldest frame is
+// reached
+bool rewind_step_back(struct chip8 *c8);
+
+// frames held and bytes of the budget in use
+uint32_t rewind_frames(const struct chip8 *c8);
+size_t rewind_bytes(const struct chip8 *c8);
+
+#endif
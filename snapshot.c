@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "chip8.h"
+#include "jit.h"
+#include "snapshot.h"
+
+const char *snapshot_path = "snapshot.c8s";
+
+// size of a version 5 file: header, then the fields in the order written
+#define SNAPSHOT_FILE_SIZE \
+    (4 + 2 + 16 + 2 + 1 + 1 + 2 + 1 + 32 + 4096 + 2 + 256 + 2 + 8 + 4 + 8 + 4 + 1 + 2 + 1 + 8 + 1 + 1 + 2 + 2)
+
+void snapshot_save(const struct chip8 *c8, struct snapshot *snapshot)
+{
+    memcpy(snapshot->state, c8, SNAPSHOT_STATE_SIZE);
+}
+
+void snapshot_restore(struct chip8 *c8, const struct snapshot *snapshot)
+{
+    // restoring the same program as the same profile, e.g. rewinding a few
+    // frames, keeps the decoded and translated code
+    bool same_code = memcmp(c8->memory, snapshot->state + offsetof(struct chip8, memory),
+                            sizeof(c8->memory)) == 0 &&
+                     c8->quirks == snapshot->state[offsetof(struct chip8, quirks)];
+    memcpy(c8, snapshot->state, SNAPSHOT_STATE_SIZE);
+    if (!same_code)
+    {
+        invalidate_decode_cache(c8, 0, sizeof(c8->memory));
+        jit_invalidate(c8, 0, sizeof(c8->memory));
+    }
+    c8->display_dirty = true;
+}
+
+static uint8_t *put(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        *p++ = value >> (8 * i);
+    }
+    return p;
+}
+
+static const uint8_t *get(const uint8_t *p, uint64_t *value, int bytes)
+{
+    *value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        *value |= (uint64_t)*p++ << (8 * i);
+    }
+    return p;
+}
+
+// lay the machine out as it is written to a file
+static void serialize(const struct chip8 *c8, uint8_t *data)
+{
+    uint8_t *p = data;
+    memcpy(p, SNAPSHOT_MAGIC, 4);
+    p += 4;
+    p = put(p, SNAPSHOT_VERSION, 2);
+
+    memcpy(p, c8->reg_vx, 16);
+    p += 16;
+    p = put(p, c8->reg_i, 2);
+    p = put(p, c8->reg_delay, 1);
+    p = put(p, c8->reg_sound, 1);
+    p = put(p, c8->reg_pc, 2);
+    p = put(p, c8->reg_sp, 1);
+    for (int i = 0; i < 16; i++)
+    {
+        p = put(p, c8->stack[i], 2);
+    }
+    memcpy(p, c8->memory, 4096);
+    p += 4096;
+    p = put(p, c8->rom_size, 2);
+    for (int i = 0; i < 32; i++)
+    {
+        p = put(p, c8->display[i], 8);
+    }
+    p = put(p, c8->current_opcode, 2);
+    p = put(p, c8->instruction_count, 8);
+    p = put(p, c8->cycles_per_second, 4);
+    p = put(p, c8->frame_count, 8);
+    p = put(p, c8->frame_cycles_left, 4);
+    p = put(p, c8->halted, 1);
+    p = put(p, c8->keys, 2);
+    p = put(p, c8->waiting_key, 1);
+    p = put(p, c8->random_state, 8);
+    p = put(p, c8->quirks, 1);
+    p = put(p, c8->faulted, 1);
+    p = put(p, c8->fault_pc, 2);
+    p = put(p, c8->fault_opcode, 2);
+}
+
+bool snapshot_write(const struct chip8 *c8, const char *path)
+{
+    uint8_t data[SNAPSHOT_FILE_SIZE];
+    serialize(c8, data);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(data, 1, sizeof(data), f) == sizeof(data);
+    return fclose(f) == 0 && ok;
+}
+
+bool snapshot_read(struct chip8 *c8, const char *path)
+{
+    uint8_t data[SNAPSHOT_FILE_SIZE];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    const uint8_t *p = data;
+    uint64_t value;
+    if (size != sizeof(data) || memcmp(p, SNAPSHOT_MAGIC, 4) != 0)
+    {
+        return false;
+    }
+    p = get(p + 4, &value, 2);
+    if (value != SNAPSHOT_VERSION)
+    {
+        return false;
+    }
+
+    // read into a copy so a bad file leaves the machine alone
+    struct chip8 *s = malloc(sizeof(struct chip8));
+    if (s == NULL)
+    {
+        return false;
+    }
+    memcpy(s, c8, SNAPSHOT_STATE_SIZE);
+
+    memcpy(s->reg_vx, p, 16);
+    p += 16;
+    p = get(p, &value, 2);
+    s->reg_i = value;
+    p = get(p, &value, 1);
+    s->reg_delay = value;
+    p = get(p, &value, 1);
+    s->reg_sound = value;
+    p = get(p, &value, 2);
+    s->reg_pc = value & 0xfff;
+    p = get(p, &value, 1);
+    s->reg_sp = value;
+    for (int i = 0; i < 16; i++)
+    {
+        p = get(p, &value, 2);
+        s->stack[i] = value;
+    }
+    memcpy(s->memory, p, 4096);
+    p += 4096;
+    p = get(p, &value, 2);
+    s->rom_size = value;
+    for (int i = 0; i < 32; i++)
+    {
+        p = get(p, &s->display[i], 8);
+    }
+    p = get(p, &value, 2);
+    s->current_opcode = value;
+    p = get(p, &s->instruction_count, 8);
+    p = get(p, &value, 4);
+    s->cycles_per_second = value;
+    p = get(p, &s->frame_count, 8);
+    p = get(p, &value, 4);
+    s->frame_cycles_left = value;
+    p = get(p, &value, 1);
+    s->halted = value;
+    p = get(p, &value, 2);
+    s->keys = value;
+    p = get(p, &value, 1);
+    s->waiting_key = value;
+    p = get(p, &s->random_state, 8);
+    p = get(p, &value, 1);
+    s->quirks = value;
+    p = get(p, &value, 1);
+    s->faulted = value;
+    p = get(p, &value, 2);
+    s->fault_pc = value;
+    p = get(p, &value, 2);
+    s->fault_opcode = value;
+
+    bool ok = s->reg_sp <= 16 && s->rom_size <= 4096 - 0x200 &&
+              s->cycles_per_second >= FRAMES_PER_SECOND && s->frame_cycles_left != 0 &&
+              s->random_state != 0 && s->quirks < QUIRK_PROFILE_COUNT && (s->halted || !s->faulted);
+    if (ok)
+    {
+        struct snapshot snapshot;
+        snapshot_save(s, &snapshot);
+        snapshot_restore(c8, &snapshot);
+    }
+    free(s);
+    return ok;
+}
+
+uint64_t snapshot_hash(const struct chip8 *c8)
+{
+    // fnv-1a over the file layout, which unlike the struct has no padding
+    uint8_t data[SNAPSHOT_FILE_SIZE];
+    serialize(c8, data);
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+const char *snapshot_difference(const struct chip8 *a, const struct chip8 *b)
+{
+    if (memcmp(a->reg_vx, b->reg_vx, sizeof(a->reg_vx)) != 0)
+    {
+        return "registers";
+    }
+    if (a->reg_i != b->reg_i)
+    {
+        return "I";
+    }
+    if (a->reg_pc != b->reg_pc)
+    {
+        return "pc";
+    }
+    if (a->reg_sp != b->reg_sp || memcmp(a->stack, b->stack, sizeof(a->stack)) != 0)
+    {
+        return "stack";
+    }
+    if (a->reg_delay != b->reg_delay || a->reg_sound != b->reg_sound)
+    {
+        return "timers";
+    }
+    if (memcmp(a->memory, b->memory, sizeof(a->memory)) != 0)
+    {
+        return "memory";
+    }
+    if (memcmp(a->display, b->display, sizeof(a->display)) != 0)
+    {
+        return "display";
+    }
+    if (a->instruction_count != b->instruction_count || a->frame_count != b->frame_count ||
+        a->frame_cycles_left != b->frame_cycles_left)
+    {
+        return "instruction count";
+    }
+
+    // anything else, in the file layout so padding does not count
+    uint8_t data_a[SNAPSHOT_FILE_SIZE];
+    uint8_t data_b[SNAPSHOT_FILE_SIZE];
+    serialize(a, data_a);
+    serialize(b, data_b);
+    return memcmp(data_a, data_b, sizeof(data_a)) != 0 ? "other state" : NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// save states. the emulated machine is the front of struct chip8, up to
+// decode_cache, so a snapshot in memory is a single copy of it. on disk the
+// fields are written one by one in a fixed little endian layout so files
+// move between builds and hosts
+
+#define SNAPSHOT_MAGIC "C8SS"
+#define SNAPSHOT_VERSION 5
+
+#define SNAPSHOT_STATE_SIZE offsetof(struct chip8, decode_cache)
+
+struct snapshot
+{
+    uint8_t state[SNAPSHOT_STATE_SIZE];
+};
+
+// default file for the save and load hotkeys
+extern const char *snapshot_path;
+
+void snapshot_save(const struct chip8 *c8, struct snapshot *snapshot);
+void snapshot_restore(struct chip8 *c8, const struct snapshot *snapshot);
+
+// write the machine to a file or replace it with one, false on failure
+bool snapshot_write(const struct chip8 *c8, const char *path);
+bool snapshot_read(struct chip8 *c8, const char *path);
+
+// hash of the whole machine, equal for two machines in the same state. used
+// to check that a replay ended where the recorded session did
+uint64_t snapshot_hash(const struct chip8 *c8);
+
+// the first part of the machine that differs between two machines, NULL if
+// they are in the same state. for checks that run one program two ways
+const char *snapshot_difference(const struct chip8 *a, const struct chip8 *b);
+
+#endif
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include "timing.h"
+
+static int64_t diff_ns(const struct timespec *a, const struct timespec *b)
+{
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+}
+
+void frame_clock_start(struct frame_clock *clock, int frames_per_second)
+{
+    clock->frame_ns = 1000000000L / frames_per_second;
+    clock_gettime(CLOCK_MONOTONIC, &clock->start);
+    clock->next_frame = clock->start;
+    clock->frames = 0;
+    clock->jitter_total_ns = 0;
+    clock->jitter_max_ns = 0;
+    clock->late_frames = 0;
+}
+
+void frame_clock_wait(struct frame_clock *clock)
+{
+    clock->frames++;
+    clock->next_frame.tv_nsec += clock->frame_ns;
+    if (clock->next_frame.tv_nsec >= 1000000000L)
+    {
+        clock->next_frame.tv_sec++;
+        clock->next_frame.tv_nsec -= 1000000000L;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (diff_ns(&now, &clock->next_frame) > clock->frame_ns)
+    {
+        clock->late_frames++;
+        clock->next_frame = now;
+        return;
+    }
+
+    // clock_nanosleep returns the error rather than setting errno. only a
+    // signal is worth sleeping again for, any other error would repeat
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &clock->next_frame, NULL) == EINTR)
+    {
+        // interrupted by a signal, go back to sleep
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t late = diff_ns(&now, &clock->next_frame);
+    if (late > 0)
+    {
+        clock->jitter_total_ns += late;
+        if ((uint64_t)late > clock->jitter_max_ns)
+        {
+            clock->jitter_max_ns = late;
+        }
+    }
+}
+
+void frame_clock_report(const struct frame_clock *clock, uint64_t instructions, FILE *f)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = diff_ns(&now, &clock->start) / 1e9;
+
+    fprintf(f, "frames: %llu (%llu late)\n", (unsigned long long)clock->frames,
+            (unsigned long long)clock->late_frames);
+    if (seconds > 0)
+    {
+        fprintf(f, "frames/sec: %.2f\n", clock->frames / seconds);
+        fprintf(f, "instructions/sec: %.0f\n", instructions / seconds);
+    }
+    uint64_t waits = clock->frames - clock->late_frames;
+    if (waits > 0)
+    {
+        fprintf(f, "pacing jitter: mean %.3f ms, max %.3f ms\n",
+                clock->jitter_total_ns / 1e6 / waits, clock->jitter_max_ns / 1e6);
+    }
+}
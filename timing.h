@@ -0,0 +1,34 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+// wall clock pacing for the emulator. frames are due at fixed points on the
+// monotonic clock and the emulator only sleeps between frames, so a slow
+// frame is made up by sleeping less afterwards rather than drifting
+struct frame_clock
+{
+    // time the next frame is due and the length of a frame
+    struct timespec next_frame;
+    long frame_ns;
+
+    struct timespec start;
+    uint64_t frames;
+
+    // how late each wake up was compared to its deadline
+    uint64_t jitter_total_ns;
+    uint64_t jitter_max_ns;
+
+    // frames that started more than a frame late, after which the clock
+    // starts again from the current time instead of running a burst of
+    // frames to catch up
+    uint64_t late_frames;
+};
+
+void frame_clock_start(struct frame_clock *clock, int frames_per_second);
+
+// sleep until the next frame is due
+void frame_clock_wait(struct frame_clock *clock);
+
+// print frames, achieved instruction and frame rates and pacing jitter
+void frame_clock_report(const struct frame_clock *clock, uint64_t instructions, FILE *f);
+
+#endif
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include "chip8.h"
+#include "trace.h"
+
+const char *trace_path = "debug.trace";
+uint32_t trace_last = 0;
+
+// records the emulator may write before handing them to the writer thread
+#define TRACE_PUBLISH_BATCH 256
+
+// ring size when writing the whole run, in records
+#define TRACE_STREAM_CAPACITY (1 << 16)
+
+struct tracer
+{
+    union trace_record *ring;
+
+    // a power of two, slots are ring[index & (capacity - 1)]
+    uint64_t capacity;
+
+    // records written by the emulator. only the emulator thread touches
+    // head and known_tail, which is a possibly stale copy of tail
+    uint64_t head;
+    uint64_t known_tail;
+
+    // last-N mode keeps overwriting the ring and has no writer thread
+    uint32_t last_n;
+    int fd;
+
+    // shared with the writer thread under lock: records handed over and
+    // records written to the file
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t space;
+    uint64_t published;
+    uint64_t tail;
+    bool stopping;
+    pthread_t writer;
+
+    // registers as of the last record, to work out which ones changed
+    uint8_t vx[16];
+};
+
+// the tracer that is flushed if the process exits or crashes without
+// closing it
+static struct tracer *active;
+
+static void write_all(int fd, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    while (size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0)
+        {
+            return;
+        }
+        bytes += written;
+        size -= written;
+    }
+}
+
+static void write_header(int fd, uint32_t flags)
+{
+    struct trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, 4);
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(union trace_record);
+    header.flags = flags;
+    write_all(fd, &header, sizeof(header));
+}
+
+// write records [start, end) of the ring
+static void write_records(struct tracer *t, uint64_t start, uint64_t end)
+{
+    while (start < end)
+    {
+        uint64_t offset = start & (t->capacity - 1);
+        uint64_t count = end - start;
+        if (count > t->capacity - offset)
+        {
+            count = t->capacity - offset;
+        }
+        write_all(t->fd, &t->ring[offset], count * sizeof(union trace_record));
+        start += count;
+    }
+}
+
+// write the newest records of a last-N trace. only uses write() so it is
+// safe to call from a signal handler
+static void dump_last(struct tracer *t)
+{
+    uint64_t start = t->head > t->last_n ? t->head - t->last_n : 0;
+    write_header(t->fd, TRACE_FLAG_LAST_N);
+    write_records(t, start, t->head);
+}
+
+static void *writer_main(void *arg)
+{
+    struct tracer *t = arg;
+    pthread_mutex_lock(&t->lock);
+    for (;;)
+    {
+        while (t->published == t->tail && !t->stopping)
+        {
+            pthread_cond_wait(&t->work, &t->lock);
+        }
+        if (t->published == t->tail)
+        {
+            break;
+        }
+
+        // the emulator does not touch published records until tail moves
+        // past them, so they can be written without holding the lock
+        uint64_t start = t->tail;
+        uint64_t end = t->published;
+        pthread_mutex_unlock(&t->lock);
+        write_records(t, start, end);
+        pthread_mutex_lock(&t->lock);
+
+        t->tail = end;
+        pthread_cond_signal(&t->space);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+// hand written records to the writer, waiting for it if the ring is full
+static void publish(struct tracer *t, bool wait_for_space)
+{
+    pthread_mutex_lock(&t->lock);
+    t->published = t->head;
+    pthread_cond_signal(&t->work);
+    while (wait_for_space && t->head - t->tail == t->capacity)
+    {
+        pthread_cond_wait(&t->space, &t->lock);
+    }
+    t->known_tail = t->tail;
+    pthread_mutex_unlock(&t->lock);
+}
+
+static void fatal_signal(int sig)
+{
+    // keep what the last-N ring holds, then crash as we would have
+    if (active != NULL && active->last_n != 0)
+    {
+        dump_last(active);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void close_tracer(struct tracer *t)
+{
+    if (active == t)
+    {
+        active = NULL;
+    }
+
+    if (t->last_n != 0)
+    {
+        dump_last(t);
+    }
+    else
+    {
+        pthread_mutex_lock(&t->lock);
+        t->published = t->head;
+        t->stopping = true;
+        pthread_cond_signal(&t->work);
+        pthread_mutex_unlock(&t->lock);
+        pthread_join(t->writer, NULL);
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->work);
+        pthread_cond_destroy(&t->space);
+    }
+    close(t->fd);
+    free(t->ring);
+    free(t);
+}
+
+static void close_at_exit()
+{
+    // e.g. exit() on a jit verify mismatch
+    if (active != NULL)
+    {
+        close_tracer(active);
+    }
+}
+
+bool trace_open(struct chip8 *c8, const char *path, uint32_t last_n)
+{
+    struct tracer *t = calloc(1, sizeof(struct tracer));
+    if (t == NULL)
+    {
+        return false;
+    }
+    t->last_n = last_n;
+    t->capacity = TRACE_STREAM_CAPACITY;
+    if (last_n != 0)
+    {
+        t->capacity = 1;
+        while (t->capacity < last_n)
+        {
+            t->capacity <<= 1;
+        }
+    }
+    t->ring = malloc(t->capacity * sizeof(union trace_record));
+    t->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (t->ring == NULL || t->fd < 0)
+    {
+        perror("unable to open trace");
+        if (t->fd >= 0)
+        {
+            close(t->fd);
+        }
+        free(t->ring);
+        free(t);
+        return false;
+    }
+    memcpy(t->vx, c8->reg_vx, sizeof(t->vx));
+
+    if (last_n == 0)
+    {
+        write_header(t->fd, 0);
+        pthread_mutex_init(&t->lock, NULL);
+        pthread_cond_init(&t->work, NULL);
+        pthread_cond_init(&t->space, NULL);
+        // pthread_create returns the error rather than setting errno
+        int error = pthread_create(&t->writer, NULL, writer_main, t);
+        if (error != 0)
+        {
+            printf("unable to start trace writer: %s\n", strerror(error));
+            pthread_mutex_destroy(&t->lock);
+            pthread_cond_destroy(&t->work);
+            pthread_cond_destroy(&t->space);
+            close(t->fd);
+            free(t->ring);
+            free(t);
+            return false;
+        }
+    }
+
+    if (active == NULL)
+    {
+        static bool handlers_installed = false;
+        if (!handlers_installed)
+        {
+            handlers_installed = true;
+            atexit(close_at_exit);
+            signal(SIGSEGV, fatal_signal);
+            signal(SIGBUS, fatal_signal);
+            signal(SIGILL, fatal_signal);
+            signal(SIGFPE, fatal_signal);
+            signal(SIGABRT, fatal_signal);
+        }
+        active = t;
+    }
+    c8->trace = t;
+    return true;
+}
+
+void trace_close(struct chip8 *c8)
+{
+    if (c8->trace != NULL)
+    {
+        close_tracer(c8->trace);
+        c8->trace = NULL;
+    }
+}
+
+// the next free slot, in streaming mode waits for the writer if the ring is
+// full
+static union trace_record *next_record(struct tracer *t)
+{
+    if (t->last_n == 0)
+    {
+        if (t->head - t->known_tail == t->capacity)
+        {
+            publish(t, true);
+        }
+        else if ((t->head & (TRACE_PUBLISH_BATCH - 1)) == 0)
+        {
+            publish(t, false);
+        }
+    }
+    return &t->ring[t->head++ & (t->capacity - 1)];
+}
+
+void trace_step(struct chip8 *c8)
+{
+    struct tracer *t = c8->trace;
+    if (t == NULL)
+    {
+        return;
+    }
+
+    struct trace_step *step = &next_record(t)->step;
+    step->kind = TRACE_STEP;
+    step->sp = c8->reg_sp;
+    step->delay = c8->reg_delay;
+    step->sound = c8->reg_sound;
+    step->pc = c8->reg_pc;
+    step->opcode = c8->current_opcode;
+    step->i = c8->reg_i;
+    step->changed = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        if (c8->reg_vx[i] != t->vx[i])
+        {
+            step->changed |= 1 << i;
+        }
+    }
+    step->instruction = c8->instruction_count;
+    memcpy(step->vx, c8->reg_vx, sizeof(step->vx));
+    memcpy(step->stack, c8->stack, sizeof(step->stack));
+    memcpy(t->vx, c8->reg_vx, sizeof(t->vx));
+
+    if (c8->current_opcode >> 12 == 0xd)
+    {
+        for (int row = 0; row < 32; row += TRACE_DISPLAY_ROWS)
+        {
+            struct trace_display *display = &next_record(t)->display;
+            memset(display, 0, sizeof(*display));
+            display->kind = TRACE_DISPLAY;
+            display->first_row = row;
+            for (int i = 0; i < TRACE_DISPLAY_ROWS && row + i < 32; i++)
+            {
+                display->rows[i] = c8->display[row + i];
+            }
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// debug trace of every executed instruction. records are fixed size and go
+// into a ring buffer in memory; a background thread writes them out, or in
+// last-N mode only the newest records are kept and written when the
+// emulator exits or crashes. chip8-trace turns a trace file into text
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+
+// the file was written in last-N mode and may start part way through a run
+#define TRACE_FLAG_LAST_N 0x1
+
+enum trace_kind
+{
+    TRACE_STEP = 1,
+    TRACE_DISPLAY = 2
+};
+
+// one executed instruction and the machine state after it
+struct trace_step
+{
+    uint8_t kind;
+    uint8_t sp;
+    uint8_t delay;
+    uint8_t sound;
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t i;
+
+    // bit n is set when the instruction changed Vn
+    uint16_t changed;
+
+    // low 32 bits of the instruction count
+    uint32_t instruction;
+
+    uint8_t vx[16];
+    uint16_t stack[16];
+};
+
+// part of the display after a DRW, the step record of the DRW is followed by
+// enough of these to cover all 32 rows
+#define TRACE_DISPLAY_ROWS 7
+struct trace_display
+{
+    uint8_t kind;
+    uint8_t first_row;
+    uint8_t reserved[6];
+    uint64_t rows[TRACE_DISPLAY_ROWS];
+};
+
+union trace_record
+{
+    uint8_t kind;
+    struct trace_step step;
+    struct trace_display display;
+};
+
+// start of a trace file, followed by the records
+struct trace_header
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+// where init_emulator writes the trace in debug mode, and the number of
+// records kept in last-N mode (0 writes the whole run)
+extern const char *trace_path;
+extern uint32_t trace_last;
+
+bool trace_open(struct chip8 *c8, const char *path, uint32_t last_n);
+void trace_close(struct chip8 *c8);
+
+// record the instruction that just executed
+void trace_step(struct chip8 *c8);
+
+#endif
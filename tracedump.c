@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "chip8.h"
+#include "trace.h"
+#include "disasm.h"
+
+// renders a binary trace written in debug mode as text, in the format debug
+// mode used to write directly: the disassembled instruction, pc and opcode,
+// the registers and stack after it, and the display after every DRW
+
+static void print_step(const struct trace_step *step, const uint64_t *display, FILE *f)
+{
+    // print disassembled instruction
+    disassemble(step->opcode, f);
+
+    // print pc and opcode
+    fprintf(f, "pc=%X opcode=%X\n", step->pc, step->opcode);
+
+    // print Vx registers
+    for (int i = 0; i < 16; i++)
+    {
+        fprintf(f, "V%X=%X ", i, step->vx[i]);
+    }
+    fprintf(f, "\n");
+
+    // print index, stack pointer, delay, sound timer
+    fprintf(f, "I=%X sp=%X delay=%X sound=%X\n", step->i, step->sp, step->delay, step->sound);
+
+    // print the stack
+    for (int i = 0; i < 16; i++)
+    {
+        fprintf(f, "S%X=%X ", i, step->stack[i]);
+    }
+    fprintf(f, "\n");
+
+    if (step->opcode >> 12 == 0xd)
+    {
+        for (int i = 0; i < 32; i++)
+        {
+            for (int j = 0; j < 64; j++)
+            {
+                fprintf(f, "%X ", (int)((display[i] >> (63 - j)) & 0x1));
+            }
+            fprintf(f, "\n");
+        }
+    }
+    fprintf(f, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: ./chip8-trace [trace file] [output file, default stdout]\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        perror("unable to open trace");
+        return EXIT_FAILURE;
+    }
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, 4) != 0 ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(union trace_record))
+    {
+        printf("%s is not a trace this tool can read\n", argv[1]);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = stdout;
+    if (argc >= 3)
+    {
+        out = fopen(argv[2], "w");
+        if (out == NULL)
+        {
+            perror("unable to open output");
+            fclose(in);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // a DRW step is printed once the display records after it have been
+    // read. a last-N trace can start in the middle of those, any display
+    // records before the first step are skipped
+    uint64_t display[32];
+    memset(display, 0, sizeof(display));
+    struct trace_step pending;
+    bool have_pending = false;
+    union trace_record record;
+    uint64_t steps = 0;
+    while (fread(&record, sizeof(record), 1, in) == 1)
+    {
+        if (record.kind == TRACE_DISPLAY)
+        {
+            for (int i = 0; i < TRACE_DISPLAY_ROWS && record.display.first_row + i < 32; i++)
+            {
+                display[record.display.first_row + i] = record.display.rows[i];
+            }
+            continue;
+        }
+        if (record.kind != TRACE_STEP)
+        {
+            printf("bad record after %llu instructions\n", (unsigned long long)steps);
+            break;
+        }
+
+        if (have_pending)
+        {
+            print_step(&pending, display, out);
+        }
+        pending = record.step;
+        have_pending = true;
+        steps++;
+    }
+    if (have_pending)
+    {
+        print_step(&pending, display, out);
+    }
+
+    fclose(in);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return 0;
+}